@@ -0,0 +1,502 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file bench.h Shared helpers of the benchmarks: timing, options, inputs and the JSON report. */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/frame_listener_impl.h>
+#include <libfreenect2/packet_pipeline.h>
+#include <libfreenect2/depth_packet_generator.h>
+#include <libfreenect2/depth_packet_processor.h>
+#include <libfreenect2/stream_recorder.h>
+#include <libfreenect2/protocol/response.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace bench
+{
+
+static const size_t DEPTH_PACKET_SIZE = 10 * 512 * 424 * 11 / 8;
+
+/** Monotonic time in seconds. */
+inline double now()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / frequency.QuadPart;
+#else
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+/** Sleep for a number of seconds. */
+inline void sleep(double seconds)
+{
+  if (seconds <= 0)
+    return;
+#ifdef _WIN32
+  Sleep((DWORD)(seconds * 1000));
+#else
+  timespec t;
+  t.tv_sec = (time_t)seconds;
+  t.tv_nsec = (long)((seconds - t.tv_sec) * 1e9);
+  nanosleep(&t, NULL);
+#endif
+}
+
+/** Command line options common to all benchmarks. */
+struct Options
+{
+  int warmup;            ///< Untimed iterations before measuring.
+  int iterations;        ///< Timed iterations.
+  size_t frames;         ///< Distinct input frames to cycle through.
+  std::string recording; ///< Recording made with `LIBFREENECT2_RECORD`, empty for synthetic input.
+  std::string output;    ///< File to write the report to, empty for stdout.
+
+  Options(): warmup(10), iterations(100), frames(30) {}
+
+  /** Parse the common options.
+   * Arguments not recognized are left in @p rest for the benchmark.
+   */
+  bool parse(int argc, char *argv[], std::vector<std::string> &rest)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg(argv[i]);
+      const bool has_value = i + 1 < argc;
+      if (arg == "-warmup" && has_value)
+        warmup = std::atoi(argv[++i]);
+      else if (arg == "-iterations" && has_value)
+        iterations = std::atoi(argv[++i]);
+      else if (arg == "-frames" && has_value)
+        frames = std::strtoul(argv[++i], NULL, 0);
+      else if (arg == "-recording" && has_value)
+        recording = argv[++i];
+      else if (arg == "-o" && has_value)
+        output = argv[++i];
+      else
+        rest.push_back(arg);
+    }
+    if (frames == 0)
+      frames = 1;
+    return warmup >= 0 && iterations > 0;
+  }
+
+  static const char *usage()
+  {
+    return "[-warmup <n>] [-iterations <n>] [-frames <n>] [-recording <file>] [-o <file.json>]";
+  }
+};
+
+/** Run @p f warmup times, then time @p iterations calls.
+ * @return Duration of each timed call in seconds.
+ */
+template<typename F>
+std::vector<double> measure(const Options &options, F &f)
+{
+  for (int i = 0; i < options.warmup; ++i)
+    f(i);
+
+  std::vector<double> samples(options.iterations);
+  for (int i = 0; i < options.iterations; ++i)
+  {
+    double start = now();
+    f(i);
+    samples[i] = now() - start;
+  }
+  return samples;
+}
+
+/** Collects the statistics of each measurement and writes them as JSON. */
+class Report
+{
+public:
+  Report(const std::string &benchmark, const Options &options):
+    benchmark_(benchmark), options_(options) {}
+
+  /** Add a string to the "info" object, e.g. the processor name. */
+  void info(const std::string &key, const std::string &value)
+  {
+    info_.push_back(std::make_pair(key, value));
+  }
+
+  /** Add a measurement.
+   * @param name Name of the measured operation.
+   * @param samples Durations from measure().
+   * @param items Work done per iteration, in @p unit.
+   * @param unit Unit of the throughput, per second.
+   */
+  void add(const std::string &name, std::vector<double> samples, double items, const std::string &unit)
+  {
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i)
+      sum += samples[i];
+
+    std::ostringstream os;
+    os << "{\"name\": " << quote(name)
+       << ", \"min_ms\": " << samples[0] * 1e3
+       << ", \"median_ms\": " << percentile(samples, 50) * 1e3
+       << ", \"p99_ms\": " << percentile(samples, 99) * 1e3
+       << ", \"mean_ms\": " << sum / n * 1e3
+       << ", \"throughput\": " << items * n / sum
+       << ", \"unit\": " << quote(unit + "/s") << "}";
+    results_.push_back(os.str());
+  }
+
+  bool write() const
+  {
+    std::ostringstream os;
+    os << "{\n"
+       << "  \"benchmark\": " << quote(benchmark_) << ",\n"
+       << "  \"source\": " << quote(options_.recording.empty() ? "synthetic" : options_.recording) << ",\n"
+       << "  \"warmup\": " << options_.warmup << ",\n"
+       << "  \"iterations\": " << options_.iterations << ",\n"
+       << "  \"info\": {";
+    for (size_t i = 0; i < info_.size(); ++i)
+      os << (i ? ", " : "") << quote(info_[i].first) << ": " << quote(info_[i].second);
+    os << "},\n"
+       << "  \"results\": [\n";
+    for (size_t i = 0; i < results_.size(); ++i)
+      os << "    " << results_[i] << (i + 1 < results_.size() ? "," : "") << "\n";
+    os << "  ]\n"
+       << "}\n";
+
+    if (options_.output.empty())
+    {
+      std::cout << os.str();
+      return true;
+    }
+    FILE *file = std::fopen(options_.output.c_str(), "w");
+    if (file == NULL)
+    {
+      std::cerr << "cannot write " << options_.output << std::endl;
+      return false;
+    }
+    const std::string s = os.str();
+    bool ok = std::fwrite(s.data(), 1, s.size(), file) == s.size();
+    ok = std::fclose(file) == 0 && ok;
+    return ok;
+  }
+
+private:
+  /* Nearest-rank percentile of sorted samples. */
+  static double percentile(const std::vector<double> &sorted, double p)
+  {
+    size_t rank = (size_t)std::ceil(p / 100 * sorted.size());
+    return sorted[rank > 0 ? rank - 1 : 0];
+  }
+
+  static std::string quote(const std::string &s)
+  {
+    std::string out("\"");
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+      const unsigned char c = s[i];
+      if (c == '"' || c == '\\')
+      {
+        out += '\\';
+        out += c;
+      }
+      else if (c < 0x20)
+      {
+        char escaped[8];
+        std::sprintf(escaped, "\\u%04x", c);
+        out += escaped;
+      }
+      else
+      {
+        out += c;
+      }
+    }
+    return out + "\"";
+  }
+
+  std::string benchmark_;
+  Options options_;
+  std::vector<std::pair<std::string, std::string> > info_;
+  std::vector<std::string> results_;
+};
+
+/** Declines all frames, so processors reuse their output frames. */
+class DiscardFrameListener : public libfreenect2::FrameListener
+{
+public:
+  virtual bool onNewFrame(libfreenect2::Frame::Type type, libfreenect2::Frame *frame) { return false; }
+};
+
+/** Calibration of a device, and raw transfers if read from a recording. */
+struct Device
+{
+  libfreenect2::Freenect2Device::IrCameraParams ir;
+  libfreenect2::Freenect2Device::ColorCameraParams color;
+  std::vector<unsigned char> p0_tables;
+  std::vector<float> xtable;
+  std::vector<float> ztable;
+  std::vector<short> lut;
+
+  std::vector<std::vector<unsigned char> > rgb_transfers;
+  std::vector<std::vector<unsigned char> > ir_transfers;
+
+  /** Typical factory calibration. The x/z tables ignore lens distortion,
+   * which does not matter for timing.
+   */
+  Device()
+  {
+    std::memset(&ir, 0, sizeof(ir));
+    ir.fx = ir.fy = 365.5f;
+    ir.cx = 254.9f;
+    ir.cy = 205.4f;
+    ir.k1 = 0.09f;
+    ir.k2 = -0.27f;
+    ir.k3 = 0.095f;
+
+    std::memset(&color, 0, sizeof(color));
+    color.fx = color.fy = 1081.37f;
+    color.cx = 959.5f;
+    color.cy = 539.5f;
+    color.shift_d = 863.0f;
+    color.shift_m = 52.0f;
+    color.mx_x1y0 = 0.6336f;
+    color.mx_x0y0 = 0.1393f;
+    color.my_x0y1 = 0.6338f;
+    color.my_x0y0 = 0.0112f;
+
+    p0_tables.assign(sizeof(libfreenect2::protocol::P0TablesResponse), 0);
+
+    const size_t table_size = libfreenect2::DepthPacketProcessor::TABLE_SIZE;
+    xtable.resize(table_size);
+    ztable.resize(table_size);
+    for (size_t i = 0; i < table_size; ++i)
+    {
+      double xd = (i % 512 + 0.5 - ir.cx) / ir.fx;
+      double yd = (i / 512 + 0.5 - ir.cy) / ir.fy;
+      xtable[i] = 8192 * xd;
+      ztable[i] = 6250.0 / 3 / std::sqrt(xd * xd + yd * yd + 1);
+    }
+
+    lut.resize(libfreenect2::DepthPacketProcessor::LUT_SIZE);
+    short y = 0;
+    for (int x = 0; x < 1024; ++x)
+    {
+      unsigned inc = 1 << (x / 128 - (x >= 128));
+      lut[x] = y;
+      lut[1024 + x] = -y;
+      y += inc;
+    }
+    lut[1024] = 32767;
+  }
+
+  /** Replace the calibration with that of a recording and keep up to
+   * @p max_transfers raw transfers of each stream.
+   */
+  bool load(const std::string &path, size_t max_transfers)
+  {
+    typedef libfreenect2::StreamRecorder R;
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == NULL)
+      return false;
+
+    libfreenect2::RecordingFileHeader header;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1 && std::memcmp(header.magic, "LF2RAW", 6) == 0;
+
+    libfreenect2::RecordHeader record;
+    std::vector<unsigned char> payload;
+    while (ok && std::fread(&record, sizeof(record), 1, file) == 1)
+    {
+      payload.resize((record.length + 7) & ~7u);
+      if (!payload.empty() && std::fread(&payload[0], payload.size(), 1, file) != 1)
+        break;
+      payload.resize(record.length);
+
+      switch (record.type)
+      {
+      case R::RgbData:
+        if (rgb_transfers.size() < max_transfers)
+          rgb_transfers.push_back(payload);
+        break;
+      case R::IrData:
+        if (ir_transfers.size() < max_transfers)
+          ir_transfers.push_back(payload);
+        break;
+      case R::P0Tables:
+        p0_tables = payload;
+        break;
+      case R::XTable:
+        copy(payload, xtable);
+        break;
+      case R::ZTable:
+        copy(payload, ztable);
+        break;
+      case R::LookupTable:
+        copy(payload, lut);
+        break;
+      case R::IrParams:
+        if (payload.size() == sizeof(ir))
+          std::memcpy(&ir, &payload[0], sizeof(ir));
+        break;
+      case R::ColorParams:
+        if (payload.size() == sizeof(color))
+          std::memcpy(&color, &payload[0], sizeof(color));
+        break;
+      }
+    }
+    std::fclose(file);
+    return ok;
+  }
+
+private:
+  template<typename T>
+  static void copy(const std::vector<unsigned char> &payload, std::vector<T> &table)
+  {
+    if (payload.size() == table.size() * sizeof(T))
+      std::memcpy(&table[0], &payload[0], payload.size());
+  }
+};
+
+/** Collect up to @p count assembled packets of one stream from a recording,
+ * depth packets for Frame::Depth and JPEG images for Frame::Color.
+ */
+inline bool replayPackets(const std::string &path, libfreenect2::Frame::Type type, size_t count, std::vector<std::vector<unsigned char> > &packets)
+{
+  libfreenect2::Freenect2 freenect2;
+  libfreenect2::Freenect2Device *dev = freenect2.openReplayDevice(path, new libfreenect2::DumpPacketPipeline(), libfreenect2::Freenect2::ReplayFastest);
+  if (dev == 0)
+    return false;
+
+  const bool color = type == libfreenect2::Frame::Color;
+  libfreenect2::SyncMultiFrameListener listener(type);
+  libfreenect2::FrameMap map;
+  if (color)
+    dev->setColorFrameListener(&listener);
+  else
+    dev->setIrAndDepthFrameListener(&listener);
+  dev->startStreams(color, !color);
+
+  while (packets.size() < count && listener.waitForNewFrame(map, 2000))
+  {
+    /* The dump processors store the data length in bytes_per_pixel. */
+    const libfreenect2::Frame *frame = map[type];
+    packets.push_back(std::vector<unsigned char>(frame->data, frame->data + frame->bytes_per_pixel));
+    listener.release(map);
+  }
+  dev->stop();
+  dev->close();
+  delete dev;
+  return !packets.empty();
+}
+
+/** A sloped wall with a moving sphere, sensor noise and invalid pixels. */
+inline void syntheticDepth(libfreenect2::Frame *frame, size_t index, size_t count)
+{
+  unsigned int seed = 1 + index;
+  float *depth = reinterpret_cast<float *>(frame->data);
+  float cx = 156.0f + 200.0f * index / count, cy = 212.0f, radius = 90.0f;
+  for (size_t y = 0; y < frame->height; ++y)
+  {
+    for (size_t x = 0; x < frame->width; ++x)
+    {
+      seed = seed * 1103515245 + 12345;
+      float noise = (int)((seed >> 16) % 7) - 3;
+      float z = 3000.0f + 2.0f * x + noise;
+      float dx = x - cx, dy = y - cy;
+      if (dx * dx + dy * dy < radius * radius)
+        z = 1500.0f - std::sqrt(radius * radius - dx * dx - dy * dy) * 4.0f + noise;
+      if (x < 12 || (seed >> 8) % 100 < 4)
+        z = 0.0f;
+      depth[y * frame->width + x] = std::floor(z);
+    }
+  }
+}
+
+/** IR amplitude falling off with the square of the depth. */
+inline void syntheticIr(libfreenect2::Frame *frame, const libfreenect2::Frame *depth)
+{
+  float *ir = reinterpret_cast<float *>(frame->data);
+  const float *z = reinterpret_cast<const float *>(depth->data);
+  for (size_t i = 0; i < frame->width * frame->height; ++i)
+    ir[i] = z[i] > 0 ? std::min(4e10f / (z[i] * z[i]), 30000.0f) : 0.0f;
+}
+
+/** Depth packets of the synthetic scene, made with DepthPacketGenerator
+ * from the calibration of @p device.
+ */
+inline bool generatePackets(const Device &device, size_t count, std::vector<std::vector<unsigned char> > &packets)
+{
+  libfreenect2::DepthPacketGenerator generator(&device.p0_tables[0], device.p0_tables.size(), &device.xtable[0], &device.ztable[0], &device.lut[0]);
+  libfreenect2::Frame depth(512, 424, 4), ir(512, 424, 4);
+  for (size_t p = 0; p < count; ++p)
+  {
+    syntheticDepth(&depth, p, count);
+    syntheticIr(&ir, &depth);
+    packets.push_back(std::vector<unsigned char>(libfreenect2::DepthPacketGenerator::PACKET_SIZE));
+    if (!generator.generate(&depth, &ir, &packets.back()[0]))
+      return false;
+  }
+  return true;
+}
+
+/** A BGRX color image with gradients and a checkerboard. */
+inline void syntheticColor(libfreenect2::Frame *frame, size_t index)
+{
+  unsigned char *p = frame->data;
+  for (size_t y = 0; y < frame->height; ++y)
+  {
+    for (size_t x = 0; x < frame->width; ++x, p += 4)
+    {
+      const bool square = ((x + index * 8) / 64 + y / 64) % 2;
+      p[0] = (unsigned char)(x * 255 / frame->width);
+      p[1] = (unsigned char)(y * 255 / frame->height);
+      p[2] = square ? 200 : 40;
+      p[3] = 0;
+    }
+  }
+}
+
+} /* namespace bench */
+#endif /* BENCH_H_ */
@@ -0,0 +1,211 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file bench_cameras.cpp Depth throughput of several simulated cameras in one process.
+ * Generated depth packets are sent as iso packets to one pipeline per camera.
+ */
+
+#include "bench.h"
+
+#include <libfreenect2/logger.h>
+
+namespace
+{
+
+class CountingFrameListener : public libfreenect2::FrameListener
+{
+public:
+  size_t frames;
+
+  CountingFrameListener(): frames(0) {}
+
+  virtual bool onNewFrame(libfreenect2::Frame::Type type, libfreenect2::Frame *frame)
+  {
+    if (type == libfreenect2::Frame::Depth)
+      frames++;
+    return false;
+  }
+};
+
+/* One iteration sends the next packet to every camera. */
+struct SendRound
+{
+  libfreenect2::DepthPacketGenerator *generator;
+  std::vector<std::vector<unsigned char> > *packets;
+  std::vector<libfreenect2::PacketPipeline *> *pipelines;
+  double rate;
+  double start;
+  uint32_t sequence;
+
+  void operator()(int)
+  {
+    if (rate > 0)
+      bench::sleep(start + sequence / rate - bench::now());
+    const std::vector<unsigned char> &packet = (*packets)[sequence % packets->size()];
+    sequence++;
+    for (size_t c = 0; c < pipelines->size(); ++c)
+      generator->send(&packet[0], sequence, sequence * 266, (*pipelines)[c]->getIrPacketParser());
+  }
+};
+
+libfreenect2::PacketPipeline *createPipeline(const std::string &name)
+{
+  if (name == "cpu")
+    return new libfreenect2::CpuPacketPipeline();
+#ifdef LIBFREENECT2_WITH_OPENCL_SUPPORT
+  if (name == "cl")
+    return new libfreenect2::OpenCLPacketPipeline();
+  if (name == "clkde")
+    return new libfreenect2::OpenCLKdePacketPipeline();
+#endif
+#ifdef LIBFREENECT2_WITH_CUDA_SUPPORT
+  if (name == "cuda")
+    return new libfreenect2::CudaPacketPipeline();
+  if (name == "cudakde")
+    return new libfreenect2::CudaKdePacketPipeline();
+#endif
+  return NULL;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  bench::Options options;
+  std::vector<std::string> rest;
+  size_t cameras = 4;
+  double rate = 0;
+  std::string pipeline_name = "cpu";
+  bool ok = options.parse(argc, argv, rest);
+  for (size_t i = 0; ok && i < rest.size(); ++i)
+  {
+    if (rest[i] == "-cameras" && i + 1 < rest.size())
+      cameras = std::strtoul(rest[++i].c_str(), NULL, 0);
+    else if (rest[i] == "-rate" && i + 1 < rest.size())
+      rate = std::atof(rest[++i].c_str());
+    else if (rest[i] == "-pipeline" && i + 1 < rest.size())
+      pipeline_name = rest[++i];
+    else
+      ok = false;
+  }
+  if (!ok || cameras == 0)
+  {
+    std::cerr << "Usage: " << argv[0] << " " << bench::Options::usage()
+              << " [-cameras <n>] [-rate <fps per camera, 0 for unlimited>] [-pipeline <cpu|cl|clkde|cuda|cudakde>]" << std::endl;
+    return -1;
+  }
+
+  libfreenect2::setGlobalLogger(libfreenect2::createConsoleLogger(libfreenect2::Logger::Warning));
+
+  bench::Device device;
+  std::vector<std::vector<unsigned char> > packets;
+  if (!options.recording.empty() &&
+      (!device.load(options.recording, 0) ||
+       !bench::replayPackets(options.recording, libfreenect2::Frame::Depth, options.frames, packets)))
+  {
+    std::cerr << "no depth packets in " << options.recording << std::endl;
+    return -1;
+  }
+  if (packets.empty() && !bench::generatePackets(device, options.frames, packets))
+  {
+    std::cerr << "cannot generate depth packets" << std::endl;
+    return -1;
+  }
+
+  std::vector<libfreenect2::PacketPipeline *> pipelines;
+  std::vector<CountingFrameListener> listeners(cameras);
+  for (size_t c = 0; c < cameras; ++c)
+  {
+    libfreenect2::PacketPipeline *pipeline = createPipeline(pipeline_name);
+    if (pipeline == NULL || !pipeline->getDepthPacketProcessor()->good())
+    {
+      std::cerr << "pipeline " << pipeline_name << " is not available" << std::endl;
+      delete pipeline;
+      for (size_t i = 0; i < pipelines.size(); ++i)
+        delete pipelines[i];
+      return -1;
+    }
+    libfreenect2::DepthPacketProcessor *processor = pipeline->getDepthPacketProcessor();
+    processor->setFrameListener(&listeners[c]);
+    processor->loadP0TablesFromCommandResponse(&device.p0_tables[0], device.p0_tables.size());
+    processor->loadXZTables(&device.xtable[0], &device.ztable[0]);
+    processor->loadLookupTable(&device.lut[0]);
+    pipelines.push_back(pipeline);
+  }
+
+  libfreenect2::DepthPacketGenerator generator(&device.p0_tables[0], device.p0_tables.size(), &device.xtable[0], &device.ztable[0], &device.lut[0]);
+  SendRound send = { &generator, &packets, &pipelines, rate, bench::now(), 0 };
+
+  /* Warm-up rounds are not counted, so count from the end of the warm-up. */
+  bench::Options warmup = options;
+  warmup.iterations = std::max(options.warmup, 1);
+  warmup.warmup = 0;
+  bench::measure(warmup, send);
+  for (size_t c = 0; c < cameras; ++c)
+    while (!pipelines[c]->getIrPacketParser()->ready())
+      bench::sleep(0.001);
+  std::vector<size_t> counted(cameras);
+  for (size_t c = 0; c < cameras; ++c)
+    counted[c] = listeners[c].frames;
+
+  bench::Options timed = options;
+  timed.warmup = 0;
+  send.start = bench::now() - send.sequence / (rate > 0 ? rate : 1);
+  const double start = bench::now();
+  std::vector<double> samples = bench::measure(timed, send);
+  for (size_t c = 0; c < cameras; ++c)
+    while (!pipelines[c]->getIrPacketParser()->ready())
+      bench::sleep(0.001);
+  const double elapsed = bench::now() - start;
+
+  /* Frames are skipped when a camera's processor is still busy. */
+  size_t delivered = 0;
+  std::ostringstream per_camera;
+  for (size_t c = 0; c < cameras; ++c)
+  {
+    size_t frames = listeners[c].frames - counted[c];
+    delivered += frames;
+    per_camera << (c ? " " : "") << frames;
+  }
+  std::ostringstream total_fps, sent;
+  total_fps << delivered / elapsed;
+  sent << options.iterations * cameras;
+
+  bench::Report report("bench_cameras", options);
+  report.info("processor", pipelines[0]->getDepthPacketProcessor()->name());
+  report.info("frames_sent", sent.str());
+  report.info("frames_delivered", per_camera.str());
+  report.info("delivered_fps", total_fps.str());
+  report.add("send_round", samples, cameras, "frames");
+  ok = report.write();
+
+  for (size_t c = 0; c < cameras; ++c)
+  {
+    pipelines[c]->getDepthPacketProcessor()->setFrameListener(NULL);
+    delete pipelines[c];
+  }
+  return ok ? 0 : -1;
+}
@@ -0,0 +1,144 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file bench_depth.cpp Latency of depth packet processors.
+ * Built as bench_depth_cpu, and as bench_depth_opencl with BENCH_DEPTH_OPENCL.
+ */
+
+#include "bench.h"
+
+#include <libfreenect2/logger.h>
+
+namespace
+{
+
+struct ProcessPacket
+{
+  libfreenect2::DepthPacketProcessor *processor;
+  std::vector<std::vector<unsigned char> > *packets;
+
+  void operator()(int i)
+  {
+    std::vector<unsigned char> &data = (*packets)[i % packets->size()];
+    libfreenect2::DepthPacket packet;
+    packet.sequence = i;
+    packet.timestamp = i * 266;
+    packet.buffer = &data[0];
+    packet.buffer_length = data.size();
+    packet.memory = NULL;
+    processor->process(packet);
+  }
+};
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+#ifdef BENCH_DEPTH_OPENCL
+  const char *benchmark = "bench_depth_opencl";
+#else
+  const char *benchmark = "bench_depth_cpu";
+#endif
+
+  bench::Options options;
+  std::vector<std::string> rest;
+#ifdef BENCH_DEPTH_OPENCL
+  int device_id = -1;
+  bool kde = false;
+#endif
+  bool ok = options.parse(argc, argv, rest);
+  for (size_t i = 0; ok && i < rest.size(); ++i)
+  {
+#ifdef BENCH_DEPTH_OPENCL
+    if (rest[i] == "-device" && i + 1 < rest.size())
+      device_id = std::atoi(rest[++i].c_str());
+    else if (rest[i] == "-kde")
+      kde = true;
+    else
+#endif
+      ok = false;
+  }
+  if (!ok)
+  {
+    std::cerr << "Usage: " << argv[0] << " " << bench::Options::usage()
+#ifdef BENCH_DEPTH_OPENCL
+              << " [-device <id>] [-kde]"
+#endif
+              << std::endl;
+    return -1;
+  }
+
+  libfreenect2::setGlobalLogger(libfreenect2::createConsoleLogger(libfreenect2::Logger::Warning));
+
+  bench::Device device;
+  std::vector<std::vector<unsigned char> > packets;
+  if (options.recording.empty())
+  {
+    bench::generatePackets(device, options.frames, packets);
+  }
+  else if (!device.load(options.recording, 0) ||
+           !bench::replayPackets(options.recording, libfreenect2::Frame::Depth, options.frames, packets))
+  {
+    std::cerr << "no depth packets in " << options.recording << std::endl;
+    return -1;
+  }
+
+  libfreenect2::PacketPipeline *pipeline;
+#ifdef BENCH_DEPTH_OPENCL
+  if (kde)
+    pipeline = new libfreenect2::OpenCLKdePacketPipeline(device_id);
+  else
+    pipeline = new libfreenect2::OpenCLPacketPipeline(device_id);
+#else
+  pipeline = new libfreenect2::CpuPacketPipeline();
+#endif
+
+  libfreenect2::DepthPacketProcessor *processor = pipeline->getDepthPacketProcessor();
+  if (!processor->good())
+  {
+    std::cerr << processor->name() << " depth processor is not available" << std::endl;
+    delete pipeline;
+    return -1;
+  }
+
+  bench::DiscardFrameListener listener;
+  processor->setFrameListener(&listener);
+  processor->loadP0TablesFromCommandResponse(&device.p0_tables[0], device.p0_tables.size());
+  processor->loadXZTables(&device.xtable[0], &device.ztable[0]);
+  processor->loadLookupTable(&device.lut[0]);
+
+  ProcessPacket process = { processor, &packets };
+  std::vector<double> samples = bench::measure(options, process);
+
+  bench::Report report(benchmark, options);
+  report.info("processor", processor->name());
+  report.add("process", samples, 1, "frames");
+  ok = report.write();
+
+  processor->setFrameListener(NULL);
+  delete pipeline;
+  return ok ? 0 : -1;
+}
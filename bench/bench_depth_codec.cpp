@@ -0,0 +1,201 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file bench_depth_codec.cpp Throughput and compression ratio of DepthCodec. */
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/frame_listener_impl.h>
+#include <libfreenect2/packet_pipeline.h>
+#include <libfreenect2/depth_codec.h>
+#include <libfreenect2/logger.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static double now()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / frequency.QuadPart;
+#else
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+/* A sloped wall with a moving sphere, sensor noise and invalid pixels. */
+static void synthesize(std::vector<libfreenect2::Frame *> &frames, size_t count)
+{
+  unsigned int seed = 1;
+  for (size_t f = 0; f < count; ++f)
+  {
+    libfreenect2::Frame *frame = new libfreenect2::Frame(512, 424, 4);
+    float *depth = reinterpret_cast<float *>(frame->data);
+    float cx = 156.0f + 200.0f * f / count, cy = 212.0f, radius = 90.0f;
+    for (int y = 0; y < 424; ++y)
+    {
+      for (int x = 0; x < 512; ++x)
+      {
+        seed = seed * 1103515245 + 12345;
+        float noise = (int)((seed >> 16) % 7) - 3;
+        float z = 3000.0f + 2.0f * x + noise;
+        float dx = x - cx, dy = y - cy;
+        if (dx * dx + dy * dy < radius * radius)
+          z = 1500.0f - std::sqrt(radius * radius - dx * dx - dy * dy) * 4.0f + noise;
+        if (x < 12 || (seed >> 8) % 100 < 4)
+          z = 0.0f;
+        depth[y * 512 + x] = std::floor(z);
+      }
+    }
+    frames.push_back(frame);
+  }
+}
+
+static bool record(const std::string &path, std::vector<libfreenect2::Frame *> &frames, size_t count)
+{
+  libfreenect2::Freenect2 freenect2;
+  libfreenect2::Freenect2Device *dev = freenect2.openReplayDevice(path, new libfreenect2::CpuPacketPipeline(), libfreenect2::Freenect2::ReplayFastest);
+  if (dev == 0)
+    return false;
+
+  libfreenect2::SyncMultiFrameListener listener(libfreenect2::Frame::Depth);
+  libfreenect2::FrameMap map;
+  dev->setIrAndDepthFrameListener(&listener);
+  dev->startStreams(false, true);
+  while (frames.size() < count && listener.waitForNewFrame(map, 5000))
+  {
+    libfreenect2::Frame *depth = map[libfreenect2::Frame::Depth];
+    libfreenect2::Frame *frame = new libfreenect2::Frame(depth->width, depth->height, depth->bytes_per_pixel);
+    std::memcpy(frame->data, depth->data, depth->width * depth->height * depth->bytes_per_pixel);
+    frames.push_back(frame);
+    listener.release(map);
+  }
+  dev->stop();
+  dev->close();
+  delete dev;
+  return !frames.empty();
+}
+
+int main(int argc, char *argv[])
+{
+  std::string path;
+  size_t count = 100;
+  int iterations = 10;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg(argv[i]);
+    if (arg == "-frames" && i + 1 < argc)
+      count = std::strtoul(argv[++i], NULL, 0);
+    else if (arg == "-iterations" && i + 1 < argc)
+      iterations = std::atoi(argv[++i]);
+    else if (arg[0] != '-')
+      path = arg;
+    else
+    {
+      std::cerr << "Usage: " << argv[0] << " [<recording>] [-frames <n>] [-iterations <n>]" << std::endl;
+      return -1;
+    }
+  }
+
+  libfreenect2::setGlobalLogger(libfreenect2::createConsoleLogger(libfreenect2::Logger::Warning));
+
+  std::vector<libfreenect2::Frame *> frames;
+  if (path.empty())
+  {
+    synthesize(frames, count);
+  }
+  else if (!record(path, frames, count))
+  {
+    std::cerr << "no depth frames in " << path << std::endl;
+    return -1;
+  }
+
+  libfreenect2::DepthCodec codec;
+  libfreenect2::Frame decoded(frames[0]->width, frames[0]->height, 4);
+  std::vector<unsigned char> buffer;
+  size_t pixels = 0, encoded_bytes = 0;
+  double encode_time = 0, decode_time = 0;
+
+  for (size_t f = 0; f < frames.size(); ++f)
+  {
+    libfreenect2::Frame *frame = frames[f];
+    const float *in = reinterpret_cast<const float *>(frame->data);
+    const float *out = reinterpret_cast<const float *>(decoded.data);
+    const size_t n = frame->width * frame->height;
+
+    double t0 = now();
+    for (int i = 0; i < iterations; ++i)
+    {
+      buffer.clear();
+      codec.encode(frame, buffer);
+    }
+    double t1 = now();
+    for (int i = 0; i < iterations; ++i)
+      codec.decode(&buffer[0], buffer.size(), &decoded);
+    double t2 = now();
+
+    for (size_t i = 0; i < n; ++i)
+    {
+      float expected = in[i] > 0.0f ? std::floor(in[i] + 0.5f) : 0.0f;
+      if (out[i] != expected)
+      {
+        std::cerr << "mismatch in frame " << f << " at pixel " << i << ": " << in[i] << " decoded as " << out[i] << std::endl;
+        return -1;
+      }
+    }
+
+    pixels += n;
+    encoded_bytes += buffer.size();
+    encode_time += t1 - t0;
+    decode_time += t2 - t1;
+  }
+
+  const double runs = (double)frames.size() * iterations;
+  std::cout << "frames:            " << frames.size() << (path.empty() ? " (synthetic)" : "") << std::endl;
+  std::cout << "bytes per frame:   " << encoded_bytes / frames.size() << std::endl;
+  std::cout << "ratio to float:    " << (double)pixels * 4 / encoded_bytes << std::endl;
+  std::cout << "ratio to 16-bit:   " << (double)pixels * 2 / encoded_bytes << std::endl;
+  std::cout << "encode frames/s:   " << runs / encode_time << std::endl;
+  std::cout << "decode frames/s:   " << runs / decode_time << std::endl;
+
+  for (size_t f = 0; f < frames.size(); ++f)
+    delete frames[f];
+  return 0;
+}
@@ -0,0 +1,595 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file bench_depth_regression.cpp Accuracy and performance regression check of depth processors.
+ *
+ * With -update, a corpus of depth packets and calibration tables is stored in
+ * the golden directory, together with the output frames and the median
+ * processing time of each pipeline. Without -update, the stored corpus is
+ * processed again, and the run fails if output pixels differ beyond the
+ * tolerances or if throughput dropped beyond the threshold. The golden
+ * directory holds results of one machine and is not part of the source tree.
+ *
+ * With -reference, the corpus is the synthetic scene, and the outputs are
+ * checked pixel by pixel against a reference archive of frames quantized to
+ * whole units and compressed with DepthCodec, which is small enough to
+ * commit: bench/depth_regression.lf2frames is the CPU output, checked by
+ * ctest. The tolerances are widened by the quantization error of half a unit.
+ * Throughput is only reported in this mode, as a baseline does not carry over
+ * between machines.
+ *
+ * By default the CPU, OpenCL and CUDA pipelines are checked, those that are
+ * built and find a device. OpenGL needs a display, so it only runs when
+ * selected with -pipeline. CPU implementations of the other backends make
+ * this work without a GPU, e.g. POCL for OpenCL and Mesa llvmpipe for OpenGL.
+ */
+
+#include "bench.h"
+
+#include <fstream>
+#include <iomanip>
+
+#include <libfreenect2/logger.h>
+#include <libfreenect2/frame_archive.h>
+#include <libfreenect2/depth_codec.h>
+
+namespace
+{
+
+/* Frame types of the corpus archive, besides Frame::Depth for packets. */
+enum CorpusType
+{
+  CorpusP0Tables = 0x100,
+  CorpusXTable = 0x101,
+  CorpusZTable = 0x102,
+  CorpusLookupTable = 0x103,
+  CorpusChecksum = 0x104
+};
+
+struct Tolerance
+{
+  float depth;         ///< Absolute depth difference in millimeters.
+  float ir;            ///< Relative IR difference.
+  double max_mismatch; ///< Fraction of pixels allowed outside the tolerance.
+  double perf;         ///< Allowed relative throughput loss.
+
+  Tolerance(): depth(1.0f), ir(0.01f), max_mismatch(0.001), perf(0.1) {}
+};
+
+/* Copies the output of the last processed packet. */
+class CopyFrameListener : public libfreenect2::FrameListener
+{
+public:
+  libfreenect2::Frame ir, depth;
+
+  CopyFrameListener(): ir(512, 424, 4), depth(512, 424, 4) {}
+
+  virtual bool onNewFrame(libfreenect2::Frame::Type type, libfreenect2::Frame *frame)
+  {
+    libfreenect2::Frame &copy = type == libfreenect2::Frame::Ir ? ir : depth;
+    std::memcpy(copy.data, frame->data, 512 * 424 * 4);
+    copy.status = frame->status;
+    return false;
+  }
+};
+
+struct ProcessPacket
+{
+  libfreenect2::DepthPacketProcessor *processor;
+  std::vector<std::vector<unsigned char> > *packets;
+
+  void operator()(int i)
+  {
+    std::vector<unsigned char> &data = (*packets)[i % packets->size()];
+    libfreenect2::DepthPacket packet;
+    packet.sequence = i;
+    packet.timestamp = i * 266;
+    packet.buffer = &data[0];
+    packet.buffer_length = data.size();
+    packet.memory = NULL;
+    processor->process(packet);
+  }
+};
+
+libfreenect2::PacketPipeline *createPipeline(const std::string &name)
+{
+  if (name == "cpu")
+    return new libfreenect2::CpuPacketPipeline();
+#ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
+  if (name == "gl")
+    return new libfreenect2::OpenGLPacketPipeline();
+#endif
+#ifdef LIBFREENECT2_WITH_OPENCL_SUPPORT
+  if (name == "cl")
+    return new libfreenect2::OpenCLPacketPipeline();
+  if (name == "clkde")
+    return new libfreenect2::OpenCLKdePacketPipeline();
+#endif
+#ifdef LIBFREENECT2_WITH_CUDA_SUPPORT
+  if (name == "cuda")
+    return new libfreenect2::CudaPacketPipeline();
+  if (name == "cudakde")
+    return new libfreenect2::CudaKdePacketPipeline();
+#endif
+  return NULL;
+}
+
+/* Pipelines checked without -pipeline. OpenGL is left out, it fails without a display. */
+std::vector<std::string> defaultPipelines()
+{
+  std::vector<std::string> names;
+  names.push_back("cpu");
+#ifdef LIBFREENECT2_WITH_OPENCL_SUPPORT
+  names.push_back("cl");
+#endif
+#ifdef LIBFREENECT2_WITH_CUDA_SUPPORT
+  names.push_back("cuda");
+#endif
+  return names;
+}
+
+template<typename T>
+void storeTable(libfreenect2::FrameArchiveWriter &writer, unsigned int type, const std::vector<T> &table)
+{
+  libfreenect2::Frame frame(1, 1, table.size() * sizeof(T));
+  std::memcpy(frame.data, &table[0], frame.bytes_per_pixel);
+  frame.format = libfreenect2::Frame::Raw;
+  writer.write(type, &frame);
+}
+
+template<typename T>
+void loadTable(const libfreenect2::Frame *frame, std::vector<T> &table)
+{
+  table.assign(reinterpret_cast<const T *>(frame->data), reinterpret_cast<const T *>(frame->data + frame->bytes_per_pixel));
+}
+
+bool storeCorpus(const std::string &path, const bench::Device &device, const std::vector<std::vector<unsigned char> > &packets)
+{
+  libfreenect2::FrameArchiveWriter writer;
+  if (!writer.open(path))
+    return false;
+  storeTable(writer, CorpusP0Tables, device.p0_tables);
+  storeTable(writer, CorpusXTable, device.xtable);
+  storeTable(writer, CorpusZTable, device.ztable);
+  storeTable(writer, CorpusLookupTable, device.lut);
+  for (size_t i = 0; i < packets.size(); ++i)
+    storeTable(writer, libfreenect2::Frame::Depth, packets[i]);
+  return writer.close() && writer.getDroppedFrames() == 0;
+}
+
+bool loadCorpus(const std::string &path, bench::Device &device, std::vector<std::vector<unsigned char> > &packets)
+{
+  libfreenect2::FrameArchiveReader reader;
+  if (!reader.open(path))
+    return false;
+  for (size_t i = 0; i < reader.size(); ++i)
+  {
+    libfreenect2::Frame *frame = reader.getFrame(i);
+    switch (reader.getType(i))
+    {
+    case CorpusP0Tables: loadTable(frame, device.p0_tables); break;
+    case CorpusXTable: loadTable(frame, device.xtable); break;
+    case CorpusZTable: loadTable(frame, device.ztable); break;
+    case CorpusLookupTable: loadTable(frame, device.lut); break;
+    case libfreenect2::Frame::Depth:
+      packets.push_back(std::vector<unsigned char>());
+      loadTable(frame, packets.back());
+      break;
+    }
+    delete frame;
+  }
+  return !packets.empty();
+}
+
+/* Fraction of pixels of `actual` that differ from `golden` beyond the
+ * tolerance, relative to the golden value if `relative` is set. A pixel
+ * that is valid in one frame only is a mismatch. If `quantized` is set,
+ * golden values are rounded to whole units as by DepthCodec.
+ */
+double mismatch(const libfreenect2::Frame *golden, const libfreenect2::Frame *actual, float tolerance, bool relative, bool quantized,
+                double &max_error)
+{
+  const float *g = reinterpret_cast<const float *>(golden->data);
+  const float *a = reinterpret_cast<const float *>(actual->data);
+  const size_t n = 512 * 424;
+  size_t mismatched = 0;
+  for (size_t i = 0; i < n; ++i)
+  {
+    double error = std::fabs((double)a[i] - g[i]);
+    float valid = a[i];
+    if (quantized)
+    {
+      error = std::max(error - 0.5, 0.0);
+      valid = std::floor(a[i] + 0.5f);
+    }
+    if (relative)
+      error /= std::max(std::fabs(g[i]), 1.0f);
+    if (!(error <= tolerance) || ((g[i] > 0) != (valid > 0)))
+      mismatched++;
+    if (error > max_error || error != error)
+      max_error = error;
+  }
+  return (double)mismatched / n;
+}
+
+/* 64-bit FNV-1a, as 16 hex digits. */
+class Checksum
+{
+public:
+  Checksum(): hash_((uint64_t)0xcbf29ce4 << 32 | 0x84222325) {}
+
+  void add(const void *data, size_t length)
+  {
+    const uint64_t prime = (uint64_t)0x100 << 32 | 0x1b3;
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < length; ++i)
+      hash_ = (hash_ ^ bytes[i]) * prime;
+  }
+
+  std::string str() const
+  {
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << hash_;
+    return out.str();
+  }
+
+private:
+  uint64_t hash_;
+};
+
+std::string corpusChecksum(const std::vector<std::vector<unsigned char> > &packets)
+{
+  Checksum checksum;
+  for (size_t i = 0; i < packets.size(); ++i)
+    checksum.add(&packets[i][0], packets[i].size());
+  return checksum.str();
+}
+
+/* Output of the synthetic corpus, one encoded IR and depth frame per packet. */
+struct Reference
+{
+  std::string corpus; ///< Checksum of the corpus.
+  std::vector<std::vector<unsigned char> > ir, depth;
+
+  bool read(const std::string &path)
+  {
+    libfreenect2::FrameArchiveReader reader;
+    if (!reader.open(path))
+      return false;
+    for (size_t i = 0; i < reader.size(); ++i)
+    {
+      libfreenect2::Frame *frame = reader.getFrame(i);
+      std::vector<unsigned char> data;
+      loadTable(frame, data);
+      delete frame;
+      switch (reader.getType(i))
+      {
+      case CorpusChecksum: corpus.assign(data.begin(), data.end()); break;
+      case libfreenect2::Frame::Ir: ir.push_back(data); break;
+      case libfreenect2::Frame::Depth: depth.push_back(data); break;
+      default: return false;
+      }
+    }
+    return !corpus.empty() && !ir.empty() && ir.size() == depth.size();
+  }
+
+  bool write(const std::string &path) const
+  {
+    libfreenect2::FrameArchiveWriter writer;
+    if (!writer.open(path))
+      return false;
+    storeTable(writer, CorpusChecksum, std::vector<char>(corpus.begin(), corpus.end()));
+    for (size_t i = 0; i < ir.size(); ++i)
+    {
+      storeTable(writer, libfreenect2::Frame::Ir, ir[i]);
+      storeTable(writer, libfreenect2::Frame::Depth, depth[i]);
+    }
+    return writer.close() && writer.getDroppedFrames() == 0;
+  }
+};
+
+/* Whether `encoded` decodes and `actual` matches it pixel by pixel. Updates
+ * the worst mismatch and the largest error.
+ */
+bool matches(libfreenect2::DepthCodec &codec, const std::vector<unsigned char> &encoded, const libfreenect2::Frame *actual,
+             float tolerance, bool relative, double max_mismatch, double &worst_mismatch, double &max_error)
+{
+  libfreenect2::Frame golden(512, 424, 4);
+  if (codec.decode(&encoded[0], encoded.size(), &golden) != encoded.size())
+    return false;
+  const double fraction = mismatch(&golden, actual, tolerance, relative, true, max_error);
+  worst_mismatch = std::max(worst_mismatch, fraction);
+  return fraction <= max_mismatch;
+}
+
+bool readBaseline(const std::string &path, double &median)
+{
+  FILE *file = std::fopen(path.c_str(), "r");
+  if (file == NULL)
+    return false;
+  bool ok = std::fscanf(file, "median_ms %lf", &median) == 1;
+  std::fclose(file);
+  return ok;
+}
+
+bool writeBaseline(const std::string &path, double median)
+{
+  FILE *file = std::fopen(path.c_str(), "w");
+  if (file == NULL)
+    return false;
+  bool ok = std::fprintf(file, "median_ms %f\n", median) > 0;
+  return std::fclose(file) == 0 && ok;
+}
+
+/* Nearest-rank median, as in the report. */
+double median(std::vector<double> samples)
+{
+  std::sort(samples.begin(), samples.end());
+  return samples[(samples.size() - 1) / 2];
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  bench::Options options;
+  std::vector<std::string> rest;
+  std::vector<std::string> pipelines;
+  std::string golden = "golden";
+  std::string reference_path;
+  bool update = false;
+  Tolerance tolerance;
+  bool ok = options.parse(argc, argv, rest);
+  for (size_t i = 0; ok && i < rest.size(); ++i)
+  {
+    const bool has_value = i + 1 < rest.size();
+    if (rest[i] == "-golden" && has_value)
+      golden = rest[++i];
+    else if (rest[i] == "-reference" && has_value)
+      reference_path = rest[++i];
+    else if (rest[i] == "-pipeline" && has_value)
+      pipelines.push_back(rest[++i]);
+    else if (rest[i] == "-update")
+      update = true;
+    else if (rest[i] == "-depth-tolerance" && has_value)
+      tolerance.depth = std::atof(rest[++i].c_str());
+    else if (rest[i] == "-ir-tolerance" && has_value)
+      tolerance.ir = std::atof(rest[++i].c_str());
+    else if (rest[i] == "-max-mismatch" && has_value)
+      tolerance.max_mismatch = std::atof(rest[++i].c_str());
+    else if (rest[i] == "-perf-threshold" && has_value)
+      tolerance.perf = std::atof(rest[++i].c_str());
+    else
+      ok = false;
+  }
+  const bool use_reference = !reference_path.empty();
+  if (!ok || (use_reference && !options.recording.empty()))
+  {
+    std::cerr << "Usage: " << argv[0] << " " << bench::Options::usage() << std::endl
+              << "    [-golden <dir> | -reference <file>] [-update] [-pipeline <cpu|gl|cl|clkde|cuda|cudakde>]..." << std::endl
+              << "    [-depth-tolerance <mm>] [-ir-tolerance <relative>] [-max-mismatch <fraction>] [-perf-threshold <fraction>]" << std::endl
+              << "The golden directory must exist. -recording selects the corpus for -update, except with -reference." << std::endl;
+    return -1;
+  }
+  /* Only pipelines asked for by name fail the run when they are unavailable. */
+  const bool default_pipelines = pipelines.empty();
+  if (default_pipelines)
+    pipelines = defaultPipelines();
+
+  libfreenect2::setGlobalLogger(libfreenect2::createConsoleLogger(libfreenect2::Logger::Warning));
+
+  const std::string corpus_path = golden + "/corpus.lf2frames";
+  bench::Device device;
+  std::vector<std::vector<unsigned char> > packets;
+  Reference reference;
+  if (use_reference)
+  {
+    if (!update && !reference.read(reference_path))
+    {
+      std::cerr << "cannot read reference " << reference_path << ", create it with -update" << std::endl;
+      return -1;
+    }
+    const size_t frames = update ? options.frames : reference.ir.size();
+    if (!bench::generatePackets(device, frames, packets))
+    {
+      std::cerr << "cannot generate the synthetic corpus" << std::endl;
+      return -1;
+    }
+    if (update)
+    {
+      reference.corpus = corpusChecksum(packets);
+    }
+    else if (corpusChecksum(packets) != reference.corpus)
+    {
+      /* E.g. other floating point code generation. Outputs may still be within the tolerances. */
+      std::cerr << "the synthetic corpus differs from that of " << reference_path << std::endl;
+    }
+  }
+  else if (update)
+  {
+    if (options.recording.empty())
+      ok = bench::generatePackets(device, options.frames, packets);
+    else
+      ok = device.load(options.recording, 0) &&
+           bench::replayPackets(options.recording, libfreenect2::Frame::Depth, options.frames, packets);
+    if (!ok || !storeCorpus(corpus_path, device, packets))
+    {
+      std::cerr << "cannot create corpus " << corpus_path << std::endl;
+      return -1;
+    }
+  }
+  else if (!loadCorpus(corpus_path, device, packets))
+  {
+    std::cerr << "cannot read corpus " << corpus_path << ", create it with -update" << std::endl;
+    return -1;
+  }
+
+  bench::Report report("bench_depth_regression", options);
+  bool passed = true;
+
+  for (size_t p = 0; p < pipelines.size(); ++p)
+  {
+    const std::string &name = pipelines[p];
+    libfreenect2::PacketPipeline *pipeline = createPipeline(name);
+    if (pipeline == NULL || !pipeline->getDepthPacketProcessor()->good())
+    {
+      std::cerr << "pipeline " << name << " is not available" << std::endl;
+      report.info(name, "unavailable");
+      passed = passed && default_pipelines;
+      delete pipeline;
+      continue;
+    }
+
+    libfreenect2::DepthPacketProcessor *processor = pipeline->getDepthPacketProcessor();
+    CopyFrameListener listener;
+    processor->setFrameListener(&listener);
+    processor->loadP0TablesFromCommandResponse(&device.p0_tables[0], device.p0_tables.size());
+    processor->loadXZTables(&device.xtable[0], &device.ztable[0]);
+    processor->loadLookupTable(&device.lut[0]);
+    ProcessPacket process = { processor, &packets };
+
+    const std::string frames_path = golden + "/" + name + ".lf2frames";
+    const std::string baseline_path = golden + "/" + name + ".baseline";
+    std::ostringstream verdict;
+
+    /* Accuracy: each packet once, in order. */
+    if (use_reference && update)
+    {
+      /* The reference holds the output of the first pipeline. */
+      if (p == 0)
+      {
+        libfreenect2::DepthCodec codec;
+        reference.ir.assign(packets.size(), std::vector<unsigned char>());
+        reference.depth.assign(packets.size(), std::vector<unsigned char>());
+        for (size_t i = 0; i < packets.size(); ++i)
+        {
+          process(i);
+          codec.encode(&listener.ir, reference.ir[i]);
+          codec.encode(&listener.depth, reference.depth[i]);
+        }
+        ok = reference.write(reference_path);
+        verdict << (ok ? "updated " + reference_path : "cannot write " + reference_path);
+      }
+      else
+      {
+        verdict << "not in reference";
+      }
+    }
+    else if (use_reference)
+    {
+      libfreenect2::DepthCodec codec;
+      double worst_depth = 0, worst_ir = 0, max_depth_error = 0, max_ir_error = 0;
+      ok = true;
+      for (size_t i = 0; i < packets.size(); ++i)
+      {
+        process(i);
+        ok = matches(codec, reference.ir[i], &listener.ir, tolerance.ir, true, tolerance.max_mismatch, worst_ir, max_ir_error) && ok;
+        ok = matches(codec, reference.depth[i], &listener.depth, tolerance.depth, false, tolerance.max_mismatch, worst_depth, max_depth_error) && ok;
+      }
+      verdict << (ok ? "pass" : "accuracy regression")
+              << ", depth mismatch " << worst_depth << " (max error " << max_depth_error << " mm)"
+              << ", ir mismatch " << worst_ir << " (max error " << max_ir_error << ")";
+    }
+    else if (update)
+    {
+      libfreenect2::FrameArchiveWriter writer;
+      ok = writer.open(frames_path);
+      for (size_t i = 0; ok && i < packets.size(); ++i)
+      {
+        process(i);
+        writer.write(libfreenect2::Frame::Ir, &listener.ir);
+        writer.write(libfreenect2::Frame::Depth, &listener.depth);
+      }
+      ok = writer.close() && ok && writer.getDroppedFrames() == 0;
+      verdict << (ok ? "updated" : "cannot write " + frames_path);
+    }
+    else
+    {
+      libfreenect2::FrameArchiveReader reader;
+      ok = reader.open(frames_path) && reader.size() == 2 * packets.size();
+      double worst_depth = 0, worst_ir = 0, max_depth_error = 0, max_ir_error = 0;
+      for (size_t i = 0; ok && i < packets.size(); ++i)
+      {
+        process(i);
+        libfreenect2::Frame *ir = reader.getFrame(2 * i);
+        libfreenect2::Frame *depth = reader.getFrame(2 * i + 1);
+        worst_ir = std::max(worst_ir, mismatch(ir, &listener.ir, tolerance.ir, true, false, max_ir_error));
+        worst_depth = std::max(worst_depth, mismatch(depth, &listener.depth, tolerance.depth, false, false, max_depth_error));
+        delete ir;
+        delete depth;
+      }
+      if (!ok)
+        verdict << "no golden frames for this corpus";
+      else if (worst_depth > tolerance.max_mismatch || worst_ir > tolerance.max_mismatch)
+        verdict << "accuracy regression";
+      else
+        verdict << "pass";
+      verdict << ", depth mismatch " << worst_depth << " (max error " << max_depth_error << " mm)"
+              << ", ir mismatch " << worst_ir << " (max error " << max_ir_error << ")";
+      ok = ok && worst_depth <= tolerance.max_mismatch && worst_ir <= tolerance.max_mismatch;
+    }
+    passed = passed && ok;
+
+    /* Performance against the baseline median. */
+    std::vector<double> samples = bench::measure(options, process);
+    report.add(name, samples, 1, "frames");
+    const double median_ms = median(samples) * 1e3;
+    double baseline_ms = 0;
+    if (use_reference)
+    {
+      verdict << ", median " << median_ms << " ms";
+    }
+    else if (update)
+    {
+      if (!writeBaseline(baseline_path, median_ms))
+      {
+        verdict << ", cannot write " << baseline_path;
+        passed = false;
+      }
+    }
+    else if (!readBaseline(baseline_path, baseline_ms))
+    {
+      verdict << ", no baseline";
+      passed = false;
+    }
+    else
+    {
+      const double loss = 1.0 - baseline_ms / median_ms;
+      verdict << ", throughput " << (loss > tolerance.perf ? "regression" : "pass")
+              << " (median " << median_ms << " ms, baseline " << baseline_ms << " ms)";
+      passed = passed && loss <= tolerance.perf;
+    }
+    report.info(name, verdict.str());
+
+    processor->setFrameListener(NULL);
+    delete pipeline;
+  }
+
+  report.info("result", passed ? "pass" : "fail");
+  if (!report.write())
+    return -1;
+  return passed ? 0 : 1;
+}
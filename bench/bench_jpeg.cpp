@@ -0,0 +1,186 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file bench_jpeg.cpp Latency of the default color packet processor. */
+
+#include "bench.h"
+
+#include <libfreenect2/logger.h>
+#include <libfreenect2/rgb_packet_processor.h>
+#include <turbojpeg.h>
+
+namespace
+{
+
+bool parseFormat(const std::string &name, libfreenect2::Frame::Format &format)
+{
+  if (name == "bgrx")
+    format = libfreenect2::Frame::BGRX;
+  else if (name == "gray")
+    format = libfreenect2::Frame::Gray;
+  else if (name == "i420")
+    format = libfreenect2::Frame::I420;
+  else if (name == "nv12")
+    format = libfreenect2::Frame::NV12;
+  else
+    return false;
+  return true;
+}
+
+/* The camera sends 4:2:2 baseline JPEG. */
+bool encode(const libfreenect2::Frame *frame, std::vector<unsigned char> &jpeg)
+{
+  tjhandle compressor = tjInitCompress();
+  if (compressor == NULL)
+    return false;
+
+  unsigned char *buffer = NULL;
+  unsigned long size = 0;
+  int r = tjCompress2(compressor, frame->data, frame->width, frame->width * 4, frame->height, TJPF_BGRX,
+                      &buffer, &size, TJSAMP_422, 90, 0);
+  if (r == 0)
+    jpeg.assign(buffer, buffer + size);
+  tjFree(buffer);
+  tjDestroy(compressor);
+  return r == 0;
+}
+
+/* Some decoders need the packet in memory from their own allocator, so each
+ * image is copied there first, like the stream parser does.
+ */
+struct ProcessPacket
+{
+  libfreenect2::RgbPacketProcessor *processor;
+  std::vector<std::vector<unsigned char> > *jpegs;
+  libfreenect2::RgbPacket packet;
+
+  void operator()(int i)
+  {
+    std::vector<unsigned char> &data = (*jpegs)[i % jpegs->size()];
+    std::memcpy(packet.memory->data, &data[0], data.size());
+    packet.sequence = i;
+    packet.timestamp = i * 266;
+    packet.jpeg_buffer = packet.memory->data;
+    packet.jpeg_buffer_length = data.size();
+    processor->process(packet);
+  }
+};
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  bench::Options options;
+  std::vector<std::string> rest;
+  libfreenect2::RgbPacketProcessor::Config config;
+  std::string format = "bgrx";
+  bool ok = options.parse(argc, argv, rest);
+  for (size_t i = 0; ok && i < rest.size(); ++i)
+  {
+    if (rest[i] == "-scale" && i + 1 < rest.size())
+      config.ColorScale = std::atoi(rest[++i].c_str());
+    else if (rest[i] == "-format" && i + 1 < rest.size())
+      ok = parseFormat(format = rest[++i], config.ColorFormat);
+    else if (rest[i] == "-region" && i + 1 < rest.size())
+      ok = std::sscanf(rest[++i].c_str(), "%d,%d,%d,%d", &config.ColorRegionX, &config.ColorRegionY, &config.ColorRegionWidth, &config.ColorRegionHeight) == 4;
+    else
+      ok = false;
+  }
+  if (!ok)
+  {
+    std::cerr << "Usage: " << argv[0] << " " << bench::Options::usage() << " [-scale <1|2|4|8>] [-format <bgrx|gray|i420|nv12>] [-region <x,y,width,height>]" << std::endl;
+    return -1;
+  }
+
+  libfreenect2::setGlobalLogger(libfreenect2::createConsoleLogger(libfreenect2::Logger::Warning));
+
+  std::vector<std::vector<unsigned char> > jpegs;
+  if (options.recording.empty())
+  {
+    libfreenect2::Frame image(1920, 1080, 4);
+    for (size_t f = 0; f < options.frames; ++f)
+    {
+      bench::syntheticColor(&image, f);
+      jpegs.push_back(std::vector<unsigned char>());
+      if (!encode(&image, jpegs.back()))
+      {
+        std::cerr << "cannot encode JPEG: " << tjGetErrorStr() << std::endl;
+        return -1;
+      }
+    }
+  }
+  else if (!bench::replayPackets(options.recording, libfreenect2::Frame::Color, options.frames, jpegs))
+  {
+    std::cerr << "no color images in " << options.recording << std::endl;
+    return -1;
+  }
+
+  size_t bytes = 0, largest = 0;
+  for (size_t i = 0; i < jpegs.size(); ++i)
+  {
+    bytes += jpegs[i].size();
+    largest = std::max(largest, jpegs[i].size());
+  }
+
+  libfreenect2::PacketPipeline *pipeline = new libfreenect2::CpuPacketPipeline();
+  libfreenect2::RgbPacketProcessor *processor = pipeline->getRgbPacketProcessor();
+  bench::DiscardFrameListener listener;
+  processor->setConfiguration(config);
+  processor->setFrameListener(&listener);
+
+  ProcessPacket process;
+  process.processor = processor;
+  process.jpegs = &jpegs;
+  std::memset(&process.packet, 0, sizeof(process.packet));
+  processor->allocateBuffer(process.packet, largest);
+  if (process.packet.memory == NULL || process.packet.memory->data == NULL)
+  {
+    std::cerr << "cannot allocate packet buffer" << std::endl;
+    delete pipeline;
+    return -1;
+  }
+  std::vector<double> samples = bench::measure(options, process);
+
+  std::ostringstream average;
+  average << bytes / jpegs.size();
+  bench::Report report("bench_jpeg", options);
+  report.info("processor", processor->name());
+  report.info("jpeg_bytes", average.str());
+  std::ostringstream scale;
+  scale << config.ColorScale;
+  report.info("scale", scale.str());
+  report.info("format", format);
+  std::ostringstream region;
+  region << config.ColorRegionX << "," << config.ColorRegionY << "," << config.ColorRegionWidth << "," << config.ColorRegionHeight;
+  report.info("region", region.str());
+  report.add("decode", samples, 1, "frames");
+  ok = report.write();
+
+  processor->releaseBuffer(process.packet);
+  processor->setFrameListener(NULL);
+  delete pipeline;
+  return ok ? 0 : -1;
+}
@@ -0,0 +1,237 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file bench_parsers.cpp Throughput of the color and depth stream parsers. */
+
+#include "bench.h"
+
+#include <libfreenect2/logger.h>
+#include <libfreenect2/data_callback.h>
+#include <libfreenect2/depth_packet_stream_parser.h>
+#include <libfreenect2/rgb_packet_processor.h>
+
+namespace
+{
+
+typedef std::vector<std::vector<unsigned char> > Transfers;
+
+const size_t RGB_TRANSFER_SIZE = 0x4000;
+
+/* Collects the iso packets sent by DepthPacketGenerator. */
+class Capture : public libfreenect2::DataCallback
+{
+public:
+  Transfers *transfers;
+
+  virtual void onDataReceived(unsigned char *buffer, size_t n)
+  {
+    transfers->push_back(std::vector<unsigned char>(buffer, buffer + n));
+  }
+};
+
+void put32(std::vector<unsigned char> &out, uint32_t value)
+{
+  out.insert(out.end(), reinterpret_cast<unsigned char *>(&value), reinterpret_cast<unsigned char *>(&value) + 4);
+}
+
+/* Frame a JPEG-like payload as the camera does: sequence and magic, the
+ * image, alignment, filler and the footer, split into bulk transfers.
+ */
+void frameColorPacket(size_t jpeg_size, uint32_t sequence, Transfers &transfers)
+{
+  std::vector<unsigned char> packet;
+  put32(packet, sequence);
+  put32(packet, 0x42424242);
+
+  unsigned int seed = sequence + 1;
+  packet.push_back(0xff);
+  packet.push_back(0xd8);
+  for (size_t i = 4; i < jpeg_size; ++i)
+  {
+    seed = seed * 1103515245 + 12345;
+    packet.push_back((seed >> 16) & 0x7f);
+  }
+  packet.push_back(0xff);
+  packet.push_back(0xd9);
+  while (packet.size() % 4 != 0)
+    packet.push_back(0xa5);
+
+  const uint32_t filler_length = 64;
+  packet.insert(packet.end(), filler_length, 'Z');
+
+  const float exposure = 10.0f, gain = 1.0f, gamma = 1.0f;
+  put32(packet, 0x39393939);
+  put32(packet, sequence);
+  put32(packet, filler_length);
+  put32(packet, 0);
+  put32(packet, 0);
+  put32(packet, sequence * 266);
+  packet.insert(packet.end(), reinterpret_cast<const unsigned char *>(&exposure), reinterpret_cast<const unsigned char *>(&exposure) + 4);
+  packet.insert(packet.end(), reinterpret_cast<const unsigned char *>(&gain), reinterpret_cast<const unsigned char *>(&gain) + 4);
+  put32(packet, 0x42424242);
+  put32(packet, packet.size() + 5 * 4);
+  packet.insert(packet.end(), reinterpret_cast<const unsigned char *>(&gamma), reinterpret_cast<const unsigned char *>(&gamma) + 4);
+  put32(packet, 0);
+  put32(packet, 0);
+  put32(packet, 0);
+
+  for (size_t offset = 0; offset < packet.size(); offset += RGB_TRANSFER_SIZE)
+  {
+    const size_t length = std::min(RGB_TRANSFER_SIZE, packet.size() - offset);
+    transfers.push_back(std::vector<unsigned char>(&packet[offset], &packet[offset] + length));
+  }
+}
+
+/* One iteration feeds the transfers of one frame. */
+struct Feed
+{
+  libfreenect2::DataCallback *parser;
+  std::vector<Transfers> *frames;
+
+  void operator()(int i)
+  {
+    Transfers &transfers = (*frames)[i % frames->size()];
+    for (size_t t = 0; t < transfers.size(); ++t)
+      parser->onDataReceived(&transfers[t][0], transfers[t].size());
+  }
+};
+
+/* Group raw transfers of a recording into frames, ending a frame at a
+ * transfer that ends with a color footer or a last depth subpacket.
+ */
+void groupTransfers(const Transfers &transfers, bool color, std::vector<Transfers> &frames)
+{
+  Transfers current;
+  for (size_t t = 0; t < transfers.size(); ++t)
+  {
+    const std::vector<unsigned char> &data = transfers[t];
+    current.push_back(data);
+
+    bool end = false;
+    if (color)
+    {
+      /* magic_footer is followed by five more words of the footer. */
+      uint32_t magic = 0;
+      if (data.size() >= 6 * 4)
+        std::memcpy(&magic, &data[data.size() - 6 * 4], 4);
+      end = magic == 0x42424242;
+    }
+    else if (data.size() >= sizeof(libfreenect2::DepthSubPacketFooter))
+    {
+      libfreenect2::DepthSubPacketFooter footer;
+      std::memcpy(&footer, &data[data.size() - sizeof(footer)], sizeof(footer));
+      end = footer.subsequence == 9 && footer.length == 512 * 424 * 11 / 8;
+    }
+    if (end)
+    {
+      frames.push_back(Transfers());
+      frames.back().swap(current);
+    }
+  }
+}
+
+double bytesPerFrame(const std::vector<Transfers> &frames)
+{
+  double bytes = 0;
+  for (size_t f = 0; f < frames.size(); ++f)
+    for (size_t t = 0; t < frames[f].size(); ++t)
+      bytes += frames[f][t].size();
+  return bytes / frames.size();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  bench::Options options;
+  std::vector<std::string> rest;
+  if (!options.parse(argc, argv, rest) || !rest.empty())
+  {
+    std::cerr << "Usage: " << argv[0] << " " << bench::Options::usage() << std::endl;
+    return -1;
+  }
+
+  libfreenect2::setGlobalLogger(libfreenect2::createConsoleLogger(libfreenect2::Logger::Warning));
+
+  std::vector<Transfers> depth_frames, color_frames;
+  if (options.recording.empty())
+  {
+    bench::Device device;
+    std::vector<std::vector<unsigned char> > packets;
+    bench::generatePackets(device, options.frames, packets);
+    libfreenect2::DepthPacketGenerator generator(&device.p0_tables[0], device.p0_tables.size(), &device.xtable[0], &device.ztable[0], &device.lut[0]);
+    Capture capture;
+    for (size_t f = 0; f < packets.size(); ++f)
+    {
+      depth_frames.push_back(Transfers());
+      capture.transfers = &depth_frames.back();
+      generator.send(&packets[f][0], f + 1, (f + 1) * 266, &capture);
+      color_frames.push_back(Transfers());
+      frameColorPacket(300000, f + 1, color_frames.back());
+    }
+  }
+  else
+  {
+    /* Frame boundaries are found after reading, so read more transfers. */
+    bench::Device device;
+    if (!device.load(options.recording, options.frames * 100))
+    {
+      std::cerr << "cannot read " << options.recording << std::endl;
+      return -1;
+    }
+    groupTransfers(device.rgb_transfers, true, color_frames);
+    groupTransfers(device.ir_transfers, false, depth_frames);
+  }
+
+  /* The dump pipeline keeps decoding out of the measurement. Packets that
+   * arrive while its processor thread is busy are skipped by the parsers.
+   */
+  libfreenect2::DumpPacketPipeline pipeline;
+  bench::DiscardFrameListener listener;
+  pipeline.getRgbPacketProcessor()->setFrameListener(&listener);
+  pipeline.getDepthPacketProcessor()->setFrameListener(&listener);
+
+  bench::Report report("bench_parsers", options);
+  if (!depth_frames.empty())
+  {
+    Feed feed = { pipeline.getIrPacketParser(), &depth_frames };
+    std::vector<double> samples = bench::measure(options, feed);
+    report.add("depth", samples, 1, "frames");
+    report.add("depth_bytes", samples, bytesPerFrame(depth_frames) / 1e6, "MB");
+  }
+  if (!color_frames.empty())
+  {
+    Feed feed = { pipeline.getRgbPacketParser(), &color_frames };
+    std::vector<double> samples = bench::measure(options, feed);
+    report.add("color", samples, 1, "frames");
+    report.add("color_bytes", samples, bytesPerFrame(color_frames) / 1e6, "MB");
+  }
+  const bool ok = report.write();
+
+  pipeline.getRgbPacketProcessor()->setFrameListener(NULL);
+  pipeline.getDepthPacketProcessor()->setFrameListener(NULL);
+  return ok ? 0 : -1;
+}
@@ -0,0 +1,208 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file bench_reconstruction.cpp Latency of the per-frame surface reconstruction steps:
+ * undistortion, point cloud and grid normals. The normals are those of
+ * Protonect when GLM is available, otherwise a simpler stand-in.
+ */
+
+#include "bench.h"
+
+#include <libfreenect2/logger.h>
+#include <libfreenect2/registration.h>
+
+#ifdef BENCH_WITH_GLM
+#include "normals.h"
+#endif
+
+namespace
+{
+
+#ifdef BENCH_WITH_GLM
+typedef glm::vec3 Point;
+#else
+struct Point
+{
+  float x, y, z;
+};
+#endif
+
+struct Cloud
+{
+  const libfreenect2::Registration *registration;
+  std::vector<libfreenect2::Frame *> depth;
+  libfreenect2::Frame undistorted;
+  std::vector<Point> points;
+  std::vector<Point> normals;
+
+  Cloud(const libfreenect2::Registration *registration):
+    registration(registration), undistorted(512, 424, 4), points(512 * 424), normals(512 * 424) {}
+
+  ~Cloud()
+  {
+    for (size_t i = 0; i < depth.size(); ++i)
+      delete depth[i];
+  }
+
+  void undistort(int i)
+  {
+    registration->undistortDepth(depth[i % depth.size()], &undistorted);
+  }
+
+  /* Invalid pixels become NaN points. */
+  void computePoints()
+  {
+    for (int r = 0; r < 424; ++r)
+      for (int c = 0; c < 512; ++c)
+      {
+        Point &p = points[r * 512 + c];
+        registration->getPointXYZ(&undistorted, r, c, p.x, p.y, p.z);
+      }
+  }
+
+#ifdef BENCH_WITH_GLM
+  /* The grid normals of Protonect. */
+  void computeNormals()
+  {
+    normals.clear();
+    calcNormal(points, 512, 424, normals);
+  }
+#else
+  /* Without GLM, a stand-in for calcNormal() of Protonect: the cross product
+   * of central differences on the grid. It does less work than calcNormal(),
+   * so its timings are not those of Protonect. Border and invalid pixels get
+   * a zero normal.
+   */
+  void computeNormals()
+  {
+    const int w = 512, h = 424;
+    for (int r = 0; r < h; ++r)
+      for (int c = 0; c < w; ++c)
+      {
+        Point &n = normals[r * w + c];
+        n.x = n.y = n.z = 0;
+        if (r == 0 || c == 0 || r == h - 1 || c == w - 1)
+          continue;
+
+        const Point &left = points[r * w + c - 1], &right = points[r * w + c + 1];
+        const Point &up = points[(r - 1) * w + c], &down = points[(r + 1) * w + c];
+        const float ax = right.x - left.x, ay = right.y - left.y, az = right.z - left.z;
+        const float bx = down.x - up.x, by = down.y - up.y, bz = down.z - up.z;
+        const float nx = ay * bz - az * by, ny = az * bx - ax * bz, nz = ax * by - ay * bx;
+        const float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+        if (length > 0)
+        {
+          n.x = nx / length;
+          n.y = ny / length;
+          n.z = nz / length;
+        }
+      }
+  }
+#endif
+};
+
+struct Undistort
+{
+  Cloud *cloud;
+  void operator()(int i) { cloud->undistort(i); }
+};
+
+struct PointCloud
+{
+  Cloud *cloud;
+  void operator()(int) { cloud->computePoints(); }
+};
+
+struct Normals
+{
+  Cloud *cloud;
+  void operator()(int) { cloud->computeNormals(); }
+};
+
+struct Frame
+{
+  Cloud *cloud;
+  void operator()(int i)
+  {
+    cloud->undistort(i);
+    cloud->computePoints();
+    cloud->computeNormals();
+  }
+};
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  bench::Options options;
+  std::vector<std::string> rest;
+  if (!options.parse(argc, argv, rest) || !rest.empty())
+  {
+    std::cerr << "Usage: " << argv[0] << " " << bench::Options::usage() << std::endl;
+    return -1;
+  }
+
+  libfreenect2::setGlobalLogger(libfreenect2::createConsoleLogger(libfreenect2::Logger::Warning));
+
+  bench::Device device;
+  if (!options.recording.empty() && !device.load(options.recording, 0))
+  {
+    std::cerr << "cannot read " << options.recording << std::endl;
+    return -1;
+  }
+
+  libfreenect2::Registration registration(device.ir, device.color);
+  Cloud cloud(&registration);
+  for (size_t f = 0; f < options.frames; ++f)
+  {
+    cloud.depth.push_back(new libfreenect2::Frame(512, 424, 4));
+    bench::syntheticDepth(cloud.depth.back(), f, options.frames);
+  }
+  cloud.undistort(0);
+  cloud.computePoints();
+
+  bench::Report report("bench_reconstruction", options);
+#ifdef BENCH_WITH_GLM
+  report.info("normals", "protonect");
+#else
+  report.info("normals", "central_differences");
+#endif
+  const double mpoints = 512 * 424 / 1e6;
+
+  Undistort undistort = { &cloud };
+  report.add("undistort_depth", bench::measure(options, undistort), 1, "frames");
+
+  PointCloud point_cloud = { &cloud };
+  report.add("point_cloud", bench::measure(options, point_cloud), mpoints, "Mpoints");
+
+  Normals normals = { &cloud };
+  report.add("normals", bench::measure(options, normals), mpoints, "Mpoints");
+
+  Frame frame = { &cloud };
+  report.add("frame", bench::measure(options, frame), 1, "frames");
+
+  return report.write() ? 0 : -1;
+}
@@ -0,0 +1,200 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file bench_registration.cpp Latency of Registration. */
+
+#include "bench.h"
+
+#include <cstring>
+
+#include <libfreenect2/logger.h>
+#include <libfreenect2/registration.h>
+
+namespace
+{
+
+struct Frames
+{
+  std::vector<libfreenect2::Frame *> depth;
+  std::vector<libfreenect2::Frame *> color;
+  libfreenect2::Frame undistorted;
+  libfreenect2::Frame registered;
+  libfreenect2::Frame bigdepth;
+  std::vector<libfreenect2::PointXYZRGB> points;
+
+  Frames(): undistorted(512, 424, 4), registered(512, 424, 4), bigdepth(1920, 1082, 4), points(512 * 424) {}
+
+  ~Frames()
+  {
+    for (size_t i = 0; i < depth.size(); ++i)
+      delete depth[i];
+    for (size_t i = 0; i < color.size(); ++i)
+      delete color[i];
+  }
+};
+
+struct Apply
+{
+  const libfreenect2::Registration *registration;
+  Frames *frames;
+  bool filter;
+  bool bigdepth;
+
+  void operator()(int i)
+  {
+    registration->apply(frames->color[i % frames->color.size()], frames->depth[i % frames->depth.size()],
+                        &frames->undistorted, &frames->registered, filter, bigdepth ? &frames->bigdepth : 0);
+  }
+};
+
+/** A colored point cloud from apply() and getPointXYZRGB() on every pixel. */
+struct ApplyPoints
+{
+  const libfreenect2::Registration *registration;
+  Frames *frames;
+
+  void operator()(int i)
+  {
+    registration->apply(frames->color[i % frames->color.size()], frames->depth[i % frames->depth.size()],
+                        &frames->undistorted, &frames->registered);
+    libfreenect2::PointXYZRGB *p = &frames->points[0];
+    for (int r = 0; r < 424; ++r)
+      for (int c = 0; c < 512; ++c, ++p)
+      {
+        float rgb;
+        registration->getPointXYZRGB(&frames->undistorted, &frames->registered, r, c, p->x, p->y, p->z, rgb);
+        std::memcpy(&p->rgb, &rgb, sizeof(p->rgb));
+      }
+  }
+};
+
+struct ComputePointCloud
+{
+  const libfreenect2::Registration *registration;
+  Frames *frames;
+  bool remove_invalid;
+
+  void operator()(int i)
+  {
+    size_t count;
+    registration->computePointCloud(frames->color[i % frames->color.size()], frames->depth[i % frames->depth.size()],
+                                    &frames->points[0], count, true, remove_invalid);
+  }
+};
+
+/** Depth at color pixels along a diagonal of the color image. */
+struct ColorToDepth
+{
+  const libfreenect2::Registration *registration;
+
+  void operator()(int)
+  {
+    int depth_index;
+    float z;
+    for (int i = 0; i < 1000; ++i)
+      registration->colorToDepth(i * 1920 / 1000, i * 1080 / 1000, depth_index, z);
+  }
+};
+
+struct UndistortDepth
+{
+  const libfreenect2::Registration *registration;
+  Frames *frames;
+
+  void operator()(int i)
+  {
+    registration->undistortDepth(frames->depth[i % frames->depth.size()], &frames->undistorted);
+  }
+};
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  bench::Options options;
+  std::vector<std::string> rest;
+  if (!options.parse(argc, argv, rest) || !rest.empty())
+  {
+    std::cerr << "Usage: " << argv[0] << " " << bench::Options::usage() << std::endl;
+    return -1;
+  }
+
+  libfreenect2::setGlobalLogger(libfreenect2::createConsoleLogger(libfreenect2::Logger::Warning));
+
+  /* Image content barely matters to registration; only the calibration
+   * is taken from a recording.
+   */
+  bench::Device device;
+  if (!options.recording.empty() && !device.load(options.recording, 0))
+  {
+    std::cerr << "cannot read " << options.recording << std::endl;
+    return -1;
+  }
+
+  Frames frames;
+  for (size_t f = 0; f < options.frames; ++f)
+  {
+    frames.depth.push_back(new libfreenect2::Frame(512, 424, 4));
+    frames.color.push_back(new libfreenect2::Frame(1920, 1080, 4));
+    bench::syntheticDepth(frames.depth.back(), f, options.frames);
+    bench::syntheticColor(frames.color.back(), f);
+  }
+
+  libfreenect2::Registration registration(device.ir, device.color);
+  bench::Report report("bench_registration", options);
+
+  Apply apply = { &registration, &frames, true, false };
+  report.add("apply", bench::measure(options, apply), 1, "frames");
+
+  apply.filter = false;
+  report.add("apply_no_filter", bench::measure(options, apply), 1, "frames");
+
+  apply.filter = true;
+  apply.bigdepth = true;
+  report.add("apply_bigdepth", bench::measure(options, apply), 1, "frames");
+
+  ApplyPoints apply_points = { &registration, &frames };
+  report.add("apply_point_xyzrgb", bench::measure(options, apply_points), 1, "frames");
+
+  ComputePointCloud point_cloud = { &registration, &frames, false };
+  report.add("point_cloud", bench::measure(options, point_cloud), 1, "frames");
+
+  point_cloud.remove_invalid = true;
+  report.add("point_cloud_compact", bench::measure(options, point_cloud), 1, "frames");
+
+  registration.enableColorToDepth();
+  apply.bigdepth = false;
+  report.add("apply_color_index", bench::measure(options, apply), 1, "frames");
+
+  ColorToDepth color_to_depth = { &registration };
+  report.add("color_to_depth", bench::measure(options, color_to_depth), 1000, "queries");
+  registration.enableColorToDepth(false);
+
+  UndistortDepth undistort = { &registration, &frames };
+  report.add("undistort_depth", bench::measure(options, undistort), 1, "frames");
+
+  return report.write() ? 0 : -1;
+}
@@ -51,6 +51,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "normals.h"
+
 /// [headers]
 #ifdef EXAMPLES_WITH_OPENGL_SUPPORT
 #include "viewer.h"
@@ -113,8 +115,6 @@ public:
 
 
 
-void calcNormal(std::vector<glm::vec3> &points, int w, int h, std::vector<glm::vec3> &normals);
-
 /// [main]
 /**
  * Main application entry point.
@@ -125,6 +125,7 @@ void calcNormal(std::vector<glm::vec3> &points, int w, int h, std::vector<glm::v
  * - cl  Perform depth processing with OpenCL.
  * - <number> Serial number of the device to open.
  * - -noviewer Disable viewer window.
+ * - -replay <file> Play back a recording made with LIBFREENECT2_RECORD.
  */
 int main(int argc, char *argv[])
 /// [main]
@@ -134,7 +135,7 @@ int main(int argc, char *argv[])
   std::cerr << "Environment variables: LOGFILE=<protonect.log>" << std::endl;
   std::cerr << "Usage: " << program_path << " [-gpu=<id>] [gl | cl | clkde | cuda | cudakde | cpu] [<device serial>]" << std::endl;
   std::cerr << "        [-noviewer] [-norgb | -nodepth] [-help] [-version]" << std::endl;
-  std::cerr << "        [-frames <number of frames to process>]" << std::endl;
+  std::cerr << "        [-frames <number of frames to process>] [-replay <recording>]" << std::endl;
   std::cerr << "To pause and unpause: pkill -USR1 Protonect" << std::endl;
   size_t executable_name_idx = program_path.rfind("Protonect");
 
@@ -173,6 +174,7 @@ int main(int argc, char *argv[])
 
 
   std::string serial = "";
+  std::string replay_path = "";
 
   bool viewer_enabled = true;
   bool enable_rgb = true;
@@ -275,6 +277,10 @@ int main(int argc, char *argv[])
         return -1;
       }
     }
+    else if(arg == "-replay" && argI + 1 < argc)
+    {
+      replay_path = argv[++argI];
+    }
     else
     {
       std::cout << "Unknown argument: " << arg << std::endl;
@@ -287,30 +293,46 @@ int main(int argc, char *argv[])
     return -1;
   }
 
-/// [discovery]
-  if(freenect2.enumerateDevices() == 0)
+  if(!replay_path.empty())
   {
-    std::cout << "no device connected!" << std::endl;
-    return -1;
+    if(pipeline)
+      dev = freenect2.openReplayDevice(replay_path, pipeline);
+    else
+      dev = freenect2.openReplayDevice(replay_path);
   }
-
-  if (serial == "")
+  else
   {
-    serial = freenect2.getDefaultDeviceSerialNumber();
-  }
 /// [discovery]
-  pipeline = new libfreenect2::OpenCLPacketPipeline(deviceId);
+    if(freenect2.enumerateDevices() == 0)
+    {
+      std::cout << "no device connected!" << std::endl;
+      return -1;
+    }
 
+    if (serial == "")
+    {
+      serial = freenect2.getDefaultDeviceSerialNumber();
+    }
+/// [discovery]
+    pipeline = new libfreenect2::OpenCLPacketPipeline(deviceId);
 
-  if(pipeline)
-  {
+
+    if(pipeline)
+    {
 /// [open]
-    dev = freenect2.openDevice(serial, pipeline);
+      dev = freenect2.openDevice(serial, pipeline);
 /// [open]
+    }
+    else
+    {
+      dev = freenect2.openDevice(serial);
+    }
   }
-  else
+
+  if(dev == 0)
   {
-    dev = freenect2.openDevice(serial);
+    std::cout << "failure opening device!" << std::endl;
+    return -1;
   }
 
   libfreenect2::Freenect2Device::Config config1;
@@ -322,11 +344,6 @@ int main(int argc, char *argv[])
 
 
 
-  if(dev == 0)
-  {
-    std::cout << "failure opening device!" << std::endl;
-    return -1;
-  }
 
   devtopause = dev;
 
@@ -1507,130 +1524,3 @@ int main(int argc, char *argv[])
 
   return 0;
 }
-
-void calcNormal(std::vector<glm::vec3> &points, int w, int h, std::vector<glm::vec3> &nrmals)
-{
-	///////////////////////////
-	//NORMAL CALCULATION
-	//////////////////////////////
-
-		
-
-	for (int n = 0; n < points.size(); n++)
-	{
-		glm::vec3 up;
-		glm::vec3 left;
-		glm::vec3 right;
-		glm::vec3 down;
-		glm::vec3 diagonal;
-		glm::vec3 normal;
-		int nrmPoints = 0;
-
-		if (n < w)
-		{
-			//Primera fila
-			down = points[n + w]-points[n];
-			nrmPoints++;
-			if (n == 0)
-			{
-				//Primer punto, primera fila         x o o o o o
-				diagonal = points[n + w + 1] - points[n];
-				nrmPoints++;
-				right = points[n + 1] - points[n];
-				nrmPoints++;
-				normal = glm::cross(diagonal, right) + glm::cross(down, diagonal);
-			}
-			else if (n == w - 1)
-			{
-				//Ultimo punto, primera fila        o o o o o x
-				diagonal = points[n + w - 1] - points[n];
-				nrmPoints++;
-				left = points[n - 1] - points[n];
-				nrmPoints++;
-				normal = glm::cross(left, diagonal) + glm::cross(diagonal, down);
-			}
-			else
-			{
-				//Resto de la primera fila    o x x x x o
-				right = points[n + 1] - points[n];
-				nrmPoints++;
-				left = points[n - 1] - points[n];
-				nrmPoints++;
-				normal = glm::cross(left, down) + glm::cross(down, right);
-			}
-		}
-		else if (n > points.size() - w - 1)
-		{
-			//Ultima fila
-			up = points[n - w] - points[n];
-			nrmPoints++;
-			if (n%w == 0)
-			{
-				//primer punto, ultima fila
-				diagonal = points[n - w + 1] - points[n];
-				nrmPoints++;
-				right = points[n + 1] - points[n];
-				nrmPoints++;
-				normal = glm::cross(right, diagonal) + glm::cross(diagonal, up);
-			}
-			else
-				if ((n+1) %w == 0)
-				{
-					//ultimo punto, ultima fila
-					diagonal = points[n - w - 1] - points[n];
-					nrmPoints++;
-					left = points[n - 1] - points[n];
-					nrmPoints++;
-					normal = glm::cross(up, diagonal) + glm::cross(diagonal, left);
-				}
-				else
-				{
-					//Resto de la ultima fila
-					right = points[n + 1] - points[n];
-					nrmPoints++;
-					left = points[n - 1] - points[n];
-					nrmPoints++;
-					normal = glm::cross(right, up) + glm::cross(up, left);
-				}	
-		}
-		else
-		{
-			up = points[n - w] - points[n];
-			nrmPoints++;
-			down = points[n + w] - points[n];
-			nrmPoints++;
-			if (n % w == 0)
-			{
-				//Primera columna. Excepto primera y ultima fila
-				right = points[n + 1] - points[n];
-				nrmPoints++;
-				normal = glm::cross(down, right) + glm::cross(right, up);
-			}
-			else if (n % (w - 1) == 0)
-			{
-				//ultima columna. Excepto primera y ultima fila
-				left = points[n - 1] - points[n];
-				nrmPoints++;
-				normal = glm::cross(up, left) + glm::cross(left, down);
-
-			}
-			else
-			{
-				//Resto de puntos
-				right = points[n + 1] - points[n];
-				nrmPoints++;
-				left = points[n - 1] - points[n];
-				nrmPoints++;
-				normal = glm::cross(up, left) + glm::cross(left, down)+ glm::cross(down, right) + glm::cross(right, up);
-			}
-		}
-			
-		normal = glm::normalize(normal);
-		nrmals.push_back(normal);
-
-	}
-
-	///////////////////////////
-	//NORMAL CALCULATION FINISH
-	//////////////////////////////
-}
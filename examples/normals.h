@@ -0,0 +1,166 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file normals.h Grid normals of the point clouds of Protonect. */
+
+#ifndef NORMALS_H
+#define NORMALS_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/** Append to @p nrmals the normal of each point of the @p w by @p h grid
+ * @p points, from the cross products with its grid neighbours.
+ */
+inline void calcNormal(std::vector<glm::vec3> &points, int w, int h, std::vector<glm::vec3> &nrmals)
+{
+	///////////////////////////
+	//NORMAL CALCULATION
+	//////////////////////////////
+
+		
+
+	for (int n = 0; n < points.size(); n++)
+	{
+		glm::vec3 up;
+		glm::vec3 left;
+		glm::vec3 right;
+		glm::vec3 down;
+		glm::vec3 diagonal;
+		glm::vec3 normal;
+		int nrmPoints = 0;
+
+		if (n < w)
+		{
+			//Primera fila
+			down = points[n + w]-points[n];
+			nrmPoints++;
+			if (n == 0)
+			{
+				//Primer punto, primera fila         x o o o o o
+				diagonal = points[n + w + 1] - points[n];
+				nrmPoints++;
+				right = points[n + 1] - points[n];
+				nrmPoints++;
+				normal = glm::cross(diagonal, right) + glm::cross(down, diagonal);
+			}
+			else if (n == w - 1)
+			{
+				//Ultimo punto, primera fila        o o o o o x
+				diagonal = points[n + w - 1] - points[n];
+				nrmPoints++;
+				left = points[n - 1] - points[n];
+				nrmPoints++;
+				normal = glm::cross(left, diagonal) + glm::cross(diagonal, down);
+			}
+			else
+			{
+				//Resto de la primera fila    o x x x x o
+				right = points[n + 1] - points[n];
+				nrmPoints++;
+				left = points[n - 1] - points[n];
+				nrmPoints++;
+				normal = glm::cross(left, down) + glm::cross(down, right);
+			}
+		}
+		else if (n > points.size() - w - 1)
+		{
+			//Ultima fila
+			up = points[n - w] - points[n];
+			nrmPoints++;
+			if (n%w == 0)
+			{
+				//primer punto, ultima fila
+				diagonal = points[n - w + 1] - points[n];
+				nrmPoints++;
+				right = points[n + 1] - points[n];
+				nrmPoints++;
+				normal = glm::cross(right, diagonal) + glm::cross(diagonal, up);
+			}
+			else
+				if ((n+1) %w == 0)
+				{
+					//ultimo punto, ultima fila
+					diagonal = points[n - w - 1] - points[n];
+					nrmPoints++;
+					left = points[n - 1] - points[n];
+					nrmPoints++;
+					normal = glm::cross(up, diagonal) + glm::cross(diagonal, left);
+				}
+				else
+				{
+					//Resto de la ultima fila
+					right = points[n + 1] - points[n];
+					nrmPoints++;
+					left = points[n - 1] - points[n];
+					nrmPoints++;
+					normal = glm::cross(right, up) + glm::cross(up, left);
+				}	
+		}
+		else
+		{
+			up = points[n - w] - points[n];
+			nrmPoints++;
+			down = points[n + w] - points[n];
+			nrmPoints++;
+			if (n % w == 0)
+			{
+				//Primera columna. Excepto primera y ultima fila
+				right = points[n + 1] - points[n];
+				nrmPoints++;
+				normal = glm::cross(down, right) + glm::cross(right, up);
+			}
+			else if (n % (w - 1) == 0)
+			{
+				//ultima columna. Excepto primera y ultima fila
+				left = points[n - 1] - points[n];
+				nrmPoints++;
+				normal = glm::cross(up, left) + glm::cross(left, down);
+
+			}
+			else
+			{
+				//Resto de puntos
+				right = points[n + 1] - points[n];
+				nrmPoints++;
+				left = points[n - 1] - points[n];
+				nrmPoints++;
+				normal = glm::cross(up, left) + glm::cross(left, down)+ glm::cross(down, right) + glm::cross(right, up);
+			}
+		}
+			
+		normal = glm::normalize(normal);
+		nrmals.push_back(normal);
+
+	}
+
+	///////////////////////////
+	//NORMAL CALCULATION FINISH
+	//////////////////////////////
+}
+
+#endif // NORMALS_H
@@ -31,6 +31,9 @@
 
 #include <cstddef>
 
+#include <libfreenect2/frame_listener.hpp>
+#include <libfreenect2/statistics.h>
+
 namespace libfreenect2
 {
 
@@ -65,8 +68,10 @@ public:
   /* Use new as the inner allocator. */
   PoolAllocator();
 
-  /* This inner allocator will be freed by PoolAllocator. */
-  PoolAllocator(Allocator *inner);
+  /* This inner allocator will be freed by PoolAllocator.
+   * The pool holds up to count buffers, allocated on first use.
+   */
+  PoolAllocator(Allocator *inner, size_t count = 2);
 
   virtual ~PoolAllocator();
 
@@ -95,5 +100,57 @@ private:
   PoolAllocatorImpl *impl_;
 };
 
+/* Allocator backed by whole pages mapped from the operating system.
+ *
+ * flags is a combination of PacketPipeline::MemoryFlags. Options that cannot
+ * be honored (no reserved hugepages, RLIMIT_MEMLOCK too low, unsupported
+ * platform) are dropped with a warning and plain pages are used instead.
+ */
+class PageAllocator: public Allocator
+{
+public:
+  PageAllocator(unsigned int flags);
+
+  virtual Buffer *allocate(size_t size);
+  virtual void free(Buffer *b);
+private:
+  unsigned int flags_;
+};
+
+/* Allocator that accounts the buffers of an inner allocator under a memory
+ * tag, see trackAllocation(). The inner allocator is freed by
+ * TrackingAllocator.
+ */
+class TrackingAllocator: public Allocator
+{
+public:
+  TrackingAllocator(Allocator *inner, MemoryTag tag);
+  virtual ~TrackingAllocator();
+
+  virtual Buffer *allocate(size_t size);
+  virtual void free(Buffer *b);
+private:
+  Allocator *inner_;
+  MemoryTag tag_;
+};
+
+/* Resolve PacketPipeline::MemoryDefault from LIBFREENECT2_MEMORY.
+ * Other values are returned unchanged.
+ */
+unsigned int resolveMemoryFlags(unsigned int flags);
+
+/* Create an allocator for the memory flags: a plain new[] allocator if flags
+ * is PacketPipeline::MemoryHeap, else a PageAllocator.
+ */
+Allocator *createAllocator(unsigned int flags);
+
+/* Create a frame whose data is allocated according to the memory flags.
+ * The frame does not depend on any allocator object and can outlive the
+ * pipeline like a regular frame. Its data is accounted as MemoryFrames.
+ * Page-backed frames return their pages to a small cache when deleted, and
+ * later frames of the same size and flags reuse them.
+ */
+Frame *createFrame(size_t width, size_t height, size_t bytes_per_pixel, unsigned int flags);
+
 } /* namespace libfreenect2 */
 #endif /* ALLOCATOR_H_ */
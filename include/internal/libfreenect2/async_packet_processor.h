@@ -31,6 +31,9 @@
 
 #include <libfreenect2/threading.h>
 #include <libfreenect2/packet_processor.h>
+#include <libfreenect2/thread_policy.h>
+#include <libfreenect2/statistics.h>
+#include <libfreenect2/trace_events.h>
 
 namespace libfreenect2
 {
@@ -52,6 +55,9 @@ public:
   AsyncPacketProcessor(PacketProcessorPtr processor) :
     processor_(processor),
     current_packet_available_(false),
+    policy_pending_(false),
+    policy_report_(NULL),
+    histogram_(NULL),
     shutdown_(false),
     thread_(&AsyncPacketProcessor<PacketT>::static_execute, this)
   {
@@ -83,6 +89,11 @@ public:
     return processor_->good();
   }
 
+  virtual bool asynchronous()
+  {
+    return true;
+  }
+
   virtual void process(const PacketT &packet)
   {
     {
@@ -103,10 +114,32 @@ public:
     processor_->releaseBuffer(p);
   }
 
+  /** The policy is applied by the thread itself on its next wakeup. */
+  virtual void setThreadPolicy(const ThreadPolicy &policy, ThreadPolicyReport *report)
+  {
+    {
+      libfreenect2::lock_guard l(packet_mutex_);
+      policy_ = policy;
+      policy_report_ = report;
+      policy_pending_ = true;
+    }
+    packet_condition_.notify_one();
+  }
+
+  virtual void setLatencyHistogram(LatencyHistogram *histogram)
+  {
+    libfreenect2::lock_guard l(packet_mutex_);
+    histogram_ = histogram;
+  }
+
 private:
   PacketProcessorPtr processor_;  ///< The processing routine, executed in the asynchronous thread.
   bool current_packet_available_; ///< Whether #current_packet_ still needs processing.
   PacketT current_packet_;        ///< Packet being processed.
+  bool policy_pending_;           ///< Whether #policy_ still needs to be applied.
+  ThreadPolicy policy_;           ///< Thread policy to apply.
+  ThreadPolicyReport *policy_report_; ///< Receiver of the applied #policy_, or NULL.
+  LatencyHistogram *histogram_;   ///< Receiver of processing times, or NULL.
 
   bool shutdown_;
   libfreenect2::mutex packet_mutex_; ///< Mutex indicating a new packet can be stored in #current_packet_.
@@ -132,11 +165,23 @@ private:
     {
       WAIT_CONDITION(packet_condition_, packet_mutex_, l);
 
+      if(policy_pending_)
+      {
+        applyThreadPolicy(processor_->name(), policy_, policy_report_);
+        policy_pending_ = false;
+      }
+
       if(current_packet_available_)
       {
         // invoke process impl
         if (processor_->good())
+        {
+          TraceScope trace(processor_->name(), current_packet_.sequence);
+          uint64_t start = LatencyHistogram::now();
           processor_->process(current_packet_);
+          if (histogram_ != NULL)
+            histogram_->recordSince(start);
+        }
         /*
          * The stream parser passes the buffer asynchronously to processors so
          * it can not wait after process() finishes and free the buffer.  In
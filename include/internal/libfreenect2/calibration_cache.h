@@ -0,0 +1,84 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file calibration_cache.h On-disk cache of device calibration. */
+
+#ifndef CALIBRATION_CACHE_H_
+#define CALIBRATION_CACHE_H_
+
+#include <stddef.h>
+#include <string>
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/mapped_file.h>
+
+namespace libfreenect2
+{
+
+/* Calibration responses of a device and the depth tables derived from them,
+ * stored per serial number so that starting a known device neither reads
+ * nor computes them again.
+ *
+ * A cache is a StreamRecorder recording without packets. It is memory
+ * mapped, and the tables are used in place.
+ */
+class CalibrationCache
+{
+public:
+  CalibrationCache();
+
+  /* Path of the cache of a device in a directory. */
+  static std::string path(const std::string &dir, const std::string &serial);
+
+  /* Map a cache. Fails quietly if there is none, and with a warning if it
+   * is incomplete or of another serial number or firmware.
+   */
+  bool open(const std::string &path, const std::string &serial, const std::string &firmware);
+  void close();
+
+  /* Write a cache, replacing any old one only when it is complete. */
+  static bool write(const std::string &path, const std::string &serial, const std::string &firmware,
+                    const Freenect2Device::IrCameraParams &ir_params, const Freenect2Device::ColorCameraParams &color_params,
+                    const unsigned char *p0_tables, size_t p0_tables_length,
+                    const float *xtable, const float *ztable, const short *lut);
+
+  /* Valid after open(); the pointers are into the mapping. */
+  Freenect2Device::IrCameraParams ir_params;
+  Freenect2Device::ColorCameraParams color_params;
+  unsigned char *p0_tables;
+  size_t p0_tables_length;
+  const float *xtable;  ///< float[DepthPacketProcessor::TABLE_SIZE]
+  const float *ztable;  ///< float[DepthPacketProcessor::TABLE_SIZE]
+  const short *lut;     ///< short[DepthPacketProcessor::LUT_SIZE]
+private:
+  MappedFile file_;
+
+  CalibrationCache(const CalibrationCache &);
+  CalibrationCache &operator=(const CalibrationCache &);
+};
+
+} /* namespace libfreenect2 */
+#endif /* CALIBRATION_CACHE_H_ */
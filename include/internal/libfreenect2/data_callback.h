@@ -35,6 +35,21 @@
 namespace libfreenect2
 {
 
+class LatencyHistogram;
+
+/** Receiver of data loss found while parsing a stream. */
+class DataLossCallback
+{
+public:
+  virtual ~DataLossCallback() {}
+
+  /**
+   * Callback that stream data was lost in transfer.
+   * @param n Number of lost packets.
+   */
+  virtual void onDataLost(size_t n) = 0;
+};
+
 class DataCallback
 {
 public:
@@ -44,6 +59,31 @@ public:
    * @param n Size of the new data.
    */
   virtual void onDataReceived(unsigned char *buffer, size_t n) = 0;
+
+  /**
+   * Set the receiver of data loss reports. Ignored by default.
+   * @param callback Loss receiver, or NULL.
+   */
+  virtual void setDataLossCallback(DataLossCallback *callback) {}
+
+  /**
+   * Whether a packet completed by the next data would be processed rather
+   * than dropped because the consumer is busy.
+   */
+  virtual bool ready() { return true; }
+
+  /**
+   * Record the time from the first data of each packet until it is passed
+   * on for processing. Ignored by default.
+   * @param histogram Histogram to record into, or NULL.
+   */
+  virtual void setLatencyHistogram(LatencyHistogram *histogram) {}
+
+  /**
+   * Pass on a packet that is complete but held back until the next data
+   * shows that it ended. Call at the end of a stream. Does nothing by default.
+   */
+  virtual void flush() {}
 };
 
 } // namespace libfreenect2
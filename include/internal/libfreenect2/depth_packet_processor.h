@@ -153,6 +153,7 @@ class CpuDepthPacketProcessor : public DepthPacketProcessor
 public:
   CpuDepthPacketProcessor();
   virtual ~CpuDepthPacketProcessor();
+  virtual void setMemoryFlags(unsigned int flags);
   virtual void setConfiguration(const libfreenect2::DepthPacketProcessor::Config &config);
 
   virtual void loadP0TablesFromCommandResponse(unsigned char* buffer, size_t buffer_length);
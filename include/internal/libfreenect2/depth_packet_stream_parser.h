@@ -66,8 +66,23 @@ public:
   void setPacketProcessor(libfreenect2::BaseDepthPacketProcessor *processor);
 
   virtual void onDataReceived(unsigned char* buffer, size_t length);
+
+  virtual void setDataLossCallback(DataLossCallback *callback);
+  virtual bool ready();
+  virtual void setLatencyHistogram(LatencyHistogram *histogram);
+
+  /** Pass on the last packet if it is complete. A packet is otherwise only
+   * passed on when the first subpacket of the next one arrives.
+   */
+  virtual void flush();
 private:
+  /** Pass on the packet of #current_sequence_, unless the processor is busy. */
+  void processPacket(uint32_t timestamp);
+
   libfreenect2::BaseDepthPacketProcessor *processor_;
+  DataLossCallback *loss_callback_;
+  LatencyHistogram *histogram_;
+  uint64_t packet_start_; ///< Arrival time of the first subpacket of #current_sequence_.
 
   size_t buffer_size_;
   DepthPacket packet_;
@@ -76,6 +91,7 @@ private:
   uint32_t processed_packets_;
   uint32_t current_sequence_;
   uint32_t current_subsequence_;
+  uint32_t current_timestamp_; ///< Timestamp of the last subpacket of #current_sequence_.
 };
 
 } /* namespace libfreenect2 */
@@ -0,0 +1,65 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file mapped_file.h Read access to files through a memory mapping. */
+
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <stddef.h>
+#include <string>
+
+namespace libfreenect2
+{
+
+/* Maps a whole file copy-on-write: the memory can be written, but changes
+ * stay private to the process and never reach the file.
+ */
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+
+  bool open(const std::string &path);
+  void close();
+
+  unsigned char *data() const { return data_; }
+  size_t size() const { return size_; }
+private:
+  unsigned char *data_;
+  size_t size_;
+#ifdef _WIN32
+  void *file_handle_;
+  void *mapping_handle_;
+#endif
+
+  MappedFile(const MappedFile &);
+  MappedFile &operator=(const MappedFile &);
+};
+
+} /* namespace libfreenect2 */
+#endif /* MAPPED_FILE_H_ */
@@ -30,10 +30,13 @@
 #define PACKET_PROCESSOR_H_
 
 #include "libfreenect2/allocator.h"
+#include <libfreenect2/packet_pipeline.h>
 
 namespace libfreenect2
 {
 
+class ThreadPolicyReport;
+
 /**
  * Processor node in the pipeline.
  * @tparam PacketT Type of the packet being processed.
@@ -42,7 +45,8 @@ template<typename PacketT>
 class PacketProcessor
 {
 public:
-  virtual ~PacketProcessor() {}
+  PacketProcessor(): memory_flags_(0), default_allocator_(NULL) {}
+  virtual ~PacketProcessor() { delete default_allocator_; }
 
   /**
    * Test whether the processor is idle.
@@ -54,6 +58,12 @@ public:
 
   virtual const char *name() { return "a packet processor"; }
 
+  /**
+   * Whether process() hands packets to threads of the processor and returns
+   * immediately, so it needs no AsyncPacketProcessor.
+   */
+  virtual bool asynchronous() { return false; }
+
   /**
    * A new packet has arrived, process it.
    * @param packet Packet to process.
@@ -75,11 +85,38 @@ public:
     p.memory = NULL;
   }
 
+  /**
+   * Select the memory backing packet buffers and frames.
+   * Must be called before the first buffer is allocated.
+   * @param flags Combination of PacketPipeline::MemoryFlags.
+   */
+  virtual void setMemoryFlags(unsigned int flags) { memory_flags_ = flags; }
+
+  /**
+   * Apply a thread policy to the processing thread, if there is one.
+   * @param policy Policy to apply.
+   * @param report Receives what was applied, or NULL.
+   */
+  virtual void setThreadPolicy(const ThreadPolicy &policy, ThreadPolicyReport *report) {}
+
+  /**
+   * Record the time process() takes for each packet, if processing is asynchronous.
+   * @param histogram Histogram to record into, or NULL.
+   */
+  virtual void setLatencyHistogram(LatencyHistogram *histogram) {}
+
 protected:
-  virtual Allocator *getAllocator() { return &default_allocator_; }
+  virtual Allocator *getAllocator()
+  {
+    if (default_allocator_ == NULL)
+      default_allocator_ = new PoolAllocator(new TrackingAllocator(createAllocator(memory_flags_), MemoryPacketBuffers));
+    return default_allocator_;
+  }
+
+  unsigned int memory_flags_;
 
 private:
-  PoolAllocator default_allocator_;
+  PoolAllocator *default_allocator_;
 };
 
 /**
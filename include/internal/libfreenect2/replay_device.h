@@ -0,0 +1,110 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file replay_device.h Device that plays back a raw stream recording. */
+
+#ifndef REPLAY_DEVICE_H_
+#define REPLAY_DEVICE_H_
+
+#include <string>
+#include <vector>
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/threading.h>
+#include <libfreenect2/mapped_file.h>
+#include <libfreenect2/statistics.h>
+
+namespace libfreenect2
+{
+
+/* Feeds the raw packets of a StreamRecorder recording into the parsers of a
+ * packet pipeline. The recording is memory mapped and parsed in place.
+ */
+class ReplayDevice : public Freenect2Device
+{
+public:
+  ReplayDevice(const PacketPipeline *pipeline, Freenect2::ReplayMode mode, float rate);
+  virtual ~ReplayDevice();
+
+  bool open(const std::string &path);
+
+  virtual std::string getSerialNumber();
+  virtual std::string getFirmwareVersion();
+
+  virtual ColorCameraParams getColorCameraParams();
+  virtual IrCameraParams getIrCameraParams();
+  virtual void setColorCameraParams(const ColorCameraParams &params);
+  virtual void setIrCameraParams(const IrCameraParams &params);
+  virtual void setConfiguration(const Config &config);
+
+  virtual void setColorFrameListener(FrameListener *rgb_frame_listener);
+  virtual void setIrAndDepthFrameListener(FrameListener *ir_frame_listener);
+  virtual bool start();
+  virtual bool startStreams(bool rgb, bool depth);
+  virtual bool stop();
+  virtual bool close();
+  virtual Statistics getStatistics();
+private:
+  struct Record
+  {
+    uint32_t type;
+    uint32_t length;
+    uint64_t time_ns;
+    unsigned char *data;
+  };
+
+  const PacketPipeline *pipeline_;
+  Freenect2::ReplayMode mode_;
+  float rate_;
+
+  MappedFile file_;
+
+  std::vector<Record> records_;
+  size_t position_;
+  Record p0_tables_, xtable_, ztable_, lut_;
+
+  std::string serial_, firmware_;
+  IrCameraParams ir_camera_params_;
+  ColorCameraParams rgb_camera_params_;
+
+  bool streaming_;
+  bool enable_rgb_, enable_depth_;
+  volatile bool running_;
+  libfreenect2::thread *thread_;
+
+  DeviceStatistics statistics_;
+
+  static void static_execute(void *cookie);
+  void execute();
+  bool waitUntil(uint64_t time_ns);
+  bool waitForParser(DataCallback *parser);
+
+  ReplayDevice(const ReplayDevice &);
+  ReplayDevice &operator=(const ReplayDevice &);
+};
+
+} /* namespace libfreenect2 */
+#endif /* REPLAY_DEVICE_H_ */
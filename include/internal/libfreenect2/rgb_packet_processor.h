@@ -31,8 +31,10 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <vector>
 
 #include <libfreenect2/config.h>
+#include <libfreenect2/libfreenect2.hpp>
 #include <libfreenect2/frame_listener.hpp>
 #include <libfreenect2/packet_processor.h>
 
@@ -60,14 +62,47 @@ typedef PacketProcessor<RgbPacket> BaseRgbPacketProcessor;
 class RgbPacketProcessor : public BaseRgbPacketProcessor
 {
 public:
+  typedef Freenect2Device::Config Config;
+
   RgbPacketProcessor();
   virtual ~RgbPacketProcessor();
 
+  virtual void setConfiguration(const libfreenect2::RgbPacketProcessor::Config &config);
   virtual void setFrameListener(libfreenect2::FrameListener *listener);
 protected:
+  libfreenect2::RgbPacketProcessor::Config config_;
   libfreenect2::FrameListener *listener_;
 };
 
+class ParallelRgbPacketProcessorImpl;
+
+/** Processor decoding consecutive packets on several decoders in parallel.
+ * Each decoder has its own thread, and frames are delivered in packet order.
+ * The packet buffers are shared by all decoders, so the stream parser can
+ * hand out a new one while the others are being decoded.
+ */
+class ParallelRgbPacketProcessor : public RgbPacketProcessor
+{
+public:
+  /** @param decoders Decoders to run in parallel, freed by ParallelRgbPacketProcessor. */
+  ParallelRgbPacketProcessor(const std::vector<RgbPacketProcessor *> &decoders);
+  virtual ~ParallelRgbPacketProcessor();
+  virtual bool ready();
+  virtual bool good();
+  virtual bool asynchronous() { return true; }
+  virtual const char *name();
+  virtual void process(const libfreenect2::RgbPacket &packet);
+  virtual void setConfiguration(const libfreenect2::RgbPacketProcessor::Config &config);
+  virtual void setFrameListener(libfreenect2::FrameListener *listener);
+  virtual void setMemoryFlags(unsigned int flags);
+  virtual void setThreadPolicy(const ThreadPolicy &policy, ThreadPolicyReport *report);
+  virtual void setLatencyHistogram(LatencyHistogram *histogram);
+protected:
+  virtual Allocator *getAllocator();
+private:
+  ParallelRgbPacketProcessorImpl *impl_;
+};
+
 /** Class for dumping the JPEG information, eg to file. */
 class DumpRgbPacketProcessor : public RgbPacketProcessor
 {
@@ -86,6 +121,8 @@ class TurboJpegRgbPacketProcessor : public RgbPacketProcessor
 public:
   TurboJpegRgbPacketProcessor();
   virtual ~TurboJpegRgbPacketProcessor();
+  virtual void setConfiguration(const libfreenect2::RgbPacketProcessor::Config &config);
+  virtual void setMemoryFlags(unsigned int flags);
   virtual void process(const libfreenect2::RgbPacket &packet);
   virtual const char *name() { return "TurboJPEG"; }
 private:
@@ -30,6 +30,7 @@
 #define RGB_PACKET_STREAM_PARSER_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <libfreenect2/config.h>
 #include <libfreenect2/rgb_packet_processor.h>
@@ -39,6 +40,25 @@
 namespace libfreenect2
 {
 
+/** Footer of a color packet, at the end of its last transfer. */
+// starting from JPEG EOI: 0xff 0xd9
+// char pad_0xa5[]; //0-3 bytes alignment of 0xa5
+// char filler[filler_length] = "ZZZZ...";
+LIBFREENECT2_PACK(struct RgbPacketFooter {
+  uint32_t magic_header; // is '9999' equal 0x39393939
+  uint32_t sequence;
+  uint32_t filler_length;
+  uint32_t unknown1; // seems 0 always
+  uint32_t unknown2; // seems 0 always
+  uint32_t timestamp;
+  float exposure; // ? ranges from 0.5 to about 60.0 with powerfull light at camera or totally covered
+  float gain; // ? ranges from 1.0 when camera is clear to 1.5 when camera is covered.
+  uint32_t magic_footer; // is 'BBBB' equal 0x42424242
+  uint32_t packet_size;
+  float gamma; // ranges from 1.0f to about 6.4 when camera is fully covered
+  uint32_t unknown4[3]; // seems to be 0 all the time.
+});
+
 /** Parser for getting an RGB packet from the stream. */
 class RgbPacketStreamParser : public DataCallback
 {
@@ -49,7 +69,15 @@ public:
   void setPacketProcessor(BaseRgbPacketProcessor *processor);
 
   virtual void onDataReceived(unsigned char* buffer, size_t length);
+
+  virtual void setDataLossCallback(DataLossCallback *callback);
+  virtual bool ready();
+  virtual void setLatencyHistogram(LatencyHistogram *histogram);
 private:
+  DataLossCallback *loss_callback_;
+  LatencyHistogram *histogram_;
+  uint64_t packet_start_; ///< Arrival time of the first transfer of the packet.
+
   size_t buffer_size_;
   RgbPacket packet_;
   BaseRgbPacketProcessor *processor_; ///< Parser implementation.
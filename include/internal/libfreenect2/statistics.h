@@ -0,0 +1,164 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file statistics.h Latency histograms and memory accounting. */
+
+#ifndef STATISTICS_H_
+#define STATISTICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/threading.h>
+
+namespace libfreenect2
+{
+
+/**
+ * Log-linear histogram of latencies in microseconds, in the style of
+ * HdrHistogram. Memory is fixed, values are kept with 1% relative precision
+ * up to about 70 minutes, and longer latencies are counted as the maximum.
+ * Recording and reading are thread-safe.
+ */
+class LatencyHistogram
+{
+public:
+  LatencyHistogram();
+
+  /** Record a latency.
+   * @param nanoseconds Duration from now() timestamps.
+   */
+  void record(uint64_t nanoseconds);
+
+  /** Record the latency from @p start_ns until now(). */
+  void recordSince(uint64_t start_ns) { record(now() - start_ns); }
+
+  void reset();
+
+  Freenect2Device::LatencyStatistics getStatistics() const;
+
+  /** Monotonic clock in nanoseconds. */
+  static uint64_t now();
+private:
+  static const int SubBucketBits = 8;
+  static const int SubBucketCount = 1 << SubBucketBits;
+  static const int SubBucketHalf = SubBucketCount / 2;
+  static const int BucketCount = SubBucketCount + (32 - SubBucketBits) * SubBucketHalf;
+
+  static int index(uint64_t microseconds);
+  static uint64_t highestEquivalentValue(int index);
+
+  mutable libfreenect2::mutex mutex_;
+  uint32_t counts_[BucketCount];
+  uint64_t total_;
+  uint64_t max_;
+
+  LatencyHistogram(const LatencyHistogram &);
+  LatencyHistogram &operator=(const LatencyHistogram &);
+};
+
+/** Subsystems of memory accounting. */
+enum MemoryTag
+{
+  MemoryUsbTransfers,
+  MemoryPacketBuffers,
+  MemoryDepthProcessing,
+  MemoryFrames,
+  MemoryRegistration,
+  MemoryTagCount
+};
+
+/** Process-wide memory counters of a subsystem. */
+struct MemoryCounters
+{
+  uint64_t current;         ///< Allocated now (byte).
+  uint64_t peak;            ///< Highest #current (byte).
+  uint64_t allocations;     ///< Number of allocations ever made.
+  uint64_t allocated_bytes; ///< Bytes ever allocated.
+};
+
+/** Account an allocation of @p bytes. Thread-safe. */
+void trackAllocation(MemoryTag tag, size_t bytes);
+
+/** Account freeing an allocation of @p bytes. Thread-safe. */
+void trackFree(MemoryTag tag, size_t bytes);
+
+MemoryCounters getMemoryCounters(MemoryTag tag);
+
+/** Frame listener that measures the time spent in another listener. */
+class LatencyFrameListener : public FrameListener
+{
+public:
+  LatencyFrameListener(LatencyHistogram *histogram);
+
+  void setListener(FrameListener *listener) { listener_ = listener; }
+
+  virtual bool onNewFrame(Frame::Type type, Frame *frame);
+private:
+  LatencyHistogram *histogram_;
+  FrameListener *volatile listener_;
+};
+
+/**
+ * Latency histograms of the stages of a device pipeline.
+ * Devices attach them to their pipeline and hand out listeners() in place
+ * of the user's frame listeners.
+ */
+class DeviceStatistics
+{
+public:
+  DeviceStatistics();
+
+  /** Install the histograms in the parsers and processors of @p pipeline. */
+  void attach(const PacketPipeline *pipeline);
+
+  /** Remove the histograms from @p pipeline. */
+  void detach(const PacketPipeline *pipeline);
+
+  /** Listener timing @p listener for the color stream, or NULL. */
+  FrameListener *colorListener(FrameListener *listener);
+
+  /** Listener timing @p listener for the IR and depth stream, or NULL. */
+  FrameListener *depthListener(FrameListener *listener);
+
+  void reset();
+
+  Freenect2Device::Statistics getStatistics() const;
+private:
+  Freenect2Device::MemoryStatistics memoryStatistics(MemoryTag tag) const;
+
+  LatencyHistogram color_assembly_, depth_assembly_;
+  LatencyHistogram color_decode_, depth_decode_;
+  LatencyHistogram listener_;
+  LatencyFrameListener color_listener_, depth_listener_;
+
+  uint64_t start_ns_;                             ///< Time of the last reset().
+  MemoryCounters start_memory_[MemoryTagCount];   ///< Counters at the last reset().
+};
+
+} /* namespace libfreenect2 */
+#endif /* STATISTICS_H_ */
@@ -0,0 +1,125 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file stream_recorder.h Recording of raw device streams. */
+
+#ifndef STREAM_RECORDER_H_
+#define STREAM_RECORDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include <libfreenect2/config.h>
+#include <libfreenect2/data_callback.h>
+
+namespace libfreenect2
+{
+
+/* A recording starts with a RecordingFileHeader, followed by records which
+ * each consist of a RecordHeader and the payload, padded to 8 bytes.
+ */
+struct RecordingFileHeader
+{
+  char magic[8];    ///< "LF2RAW\0\0"
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct RecordHeader
+{
+  uint32_t type;    ///< One of StreamRecorder::RecordType.
+  uint32_t length;  ///< Payload length without padding.
+  uint64_t time_ns; ///< Arrival time on a monotonic clock, in nanoseconds.
+};
+
+class StreamRecorderImpl;
+
+/* Append-only writer of raw device data.
+ *
+ * write() copies records into large in-memory blocks; a writer thread writes
+ * full blocks to disk sequentially. write() never waits for the disk. If all
+ * blocks are in flight, the record is dropped and counted.
+ */
+class StreamRecorder
+{
+public:
+  enum RecordType
+  {
+    RgbData = 1,       ///< Payload of a bulk transfer from the color endpoint.
+    IrData = 2,        ///< Payload of an iso packet from the depth endpoint.
+    P0Tables = 3,      ///< Raw P0 tables command response.
+    XTable = 4,        ///< float[DepthPacketProcessor::TABLE_SIZE]
+    ZTable = 5,        ///< float[DepthPacketProcessor::TABLE_SIZE]
+    LookupTable = 6,   ///< short[DepthPacketProcessor::LUT_SIZE]
+    IrParams = 7,      ///< Freenect2Device::IrCameraParams
+    ColorParams = 8,   ///< Freenect2Device::ColorCameraParams
+    SerialNumber = 9,  ///< Serial number string
+    FirmwareVersion = 10 ///< Firmware version string
+  };
+
+  static const uint32_t Version = 1;
+
+  StreamRecorder();
+  ~StreamRecorder();
+
+  bool open(const std::string &path);
+  void close();
+  bool isOpen() const;
+
+  /* Can be called from any thread. */
+  void write(RecordType type, const void *data, size_t length);
+
+  size_t getDroppedRecords() const;
+
+  /* Monotonic clock used for record timestamps. */
+  static uint64_t now();
+private:
+  StreamRecorderImpl *impl_;
+
+  StreamRecorder(const StreamRecorder &);
+  StreamRecorder &operator=(const StreamRecorder &);
+};
+
+/* Records data on its way to a parser. */
+class RecordingDataCallback: public DataCallback
+{
+public:
+  RecordingDataCallback(DataCallback *parser, StreamRecorder *recorder, StreamRecorder::RecordType type);
+  virtual ~RecordingDataCallback() {}
+
+  virtual void onDataReceived(unsigned char *buffer, size_t n);
+  virtual void setDataLossCallback(DataLossCallback *callback);
+  virtual bool ready();
+  virtual void flush();
+private:
+  DataCallback *parser_;
+  StreamRecorder *recorder_;
+  StreamRecorder::RecordType type_;
+};
+
+} /* namespace libfreenect2 */
+#endif /* STREAM_RECORDER_H_ */
@@ -0,0 +1,80 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file thread_policy.h Thread placement and scheduling. */
+
+#ifndef THREAD_POLICY_H_
+#define THREAD_POLICY_H_
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/threading.h>
+#include <string>
+
+namespace libfreenect2
+{
+
+/** What the last thread of a type got of its policy. Thread safe. */
+class ThreadPolicyReport
+{
+public:
+  /** Store the outcome of applyThreadPolicy(). */
+  void record(const ThreadPolicy &applied, const std::string &failures);
+
+  /** Parts of the policy that were applied, see Freenect2::getThreadPolicy(). */
+  ThreadPolicy applied() const;
+
+  /** Parts that could not be applied and why, empty if none. */
+  std::string failures() const;
+
+private:
+  mutable libfreenect2::mutex mutex_;
+  ThreadPolicy applied_;
+  std::string failures_;
+};
+
+/** Report of a thread type, shared by all contexts and valid for the
+ * lifetime of the process, so threads may outlive their Freenect2.
+ */
+ThreadPolicyReport &threadPolicyReport(Freenect2::ThreadType type);
+
+/**
+ * Apply a policy to the calling thread and log what was applied.
+ * Does nothing for a default constructed policy except recording it.
+ * @param name Thread name for the log.
+ * @param policy Policy to apply.
+ * @param report Receives the applied policy and the failures, or NULL.
+ */
+void applyThreadPolicy(const char *name, const ThreadPolicy &policy, ThreadPolicyReport *report);
+
+/**
+ * Read a policy from an environment variable, e.g. "cpus=2-3 node=0 fifo=50 nice=-5".
+ * @param variable Name of the environment variable.
+ * @return The policy, default constructed if the variable is not set.
+ */
+ThreadPolicy threadPolicyFromEnvironment(const char *variable);
+
+} /* namespace libfreenect2 */
+#endif /* THREAD_POLICY_H_ */
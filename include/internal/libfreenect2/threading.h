@@ -29,6 +29,7 @@
 #ifndef THREADING_H_
 #define THREADING_H_
 
+#include <stddef.h>
 #include <libfreenect2/config.h>
 
 #ifdef LIBFREENECT2_THREADING_STDLIB
@@ -100,6 +101,10 @@ using namespace tthread::this_thread;
 #include <pthread.h>
 #endif
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace libfreenect2
 {
 namespace this_thread
@@ -113,6 +118,67 @@ namespace this_thread
 #endif
   }
 }
+
+/** Atomically replace a pointer and return the previous value (acquire and release). */
+template<typename T>
+static inline T *atomic_exchange_pointer(T *volatile *ptr, T *value)
+{
+#if defined(_MSC_VER)
+  return static_cast<T *>(_InterlockedExchangePointer(reinterpret_cast<void *volatile *>(ptr), value));
+#else
+  return __atomic_exchange_n(ptr, value, __ATOMIC_ACQ_REL);
+#endif
+}
+
+/** Atomically read a pointer (acquire). */
+template<typename T>
+static inline T *atomic_load_pointer(T *volatile const *ptr)
+{
+#if defined(_MSC_VER)
+  T *value = *ptr;
+  _ReadWriteBarrier();
+  return value;
+#else
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/** Full memory barrier: orders earlier stores before later loads, which
+ * acquire and release alone do not.
+ */
+static inline void atomic_fence()
+{
+#if defined(_MSC_VER)
+  // Interlocked operations are full barriers.
+  long dummy = 0;
+  _InterlockedOr(&dummy, 0);
+#else
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+/** Atomically read a counter (acquire). */
+static inline size_t atomic_load_size(const volatile size_t *ptr)
+{
+#if defined(_MSC_VER)
+  size_t value = *ptr;
+  _ReadWriteBarrier();
+  return value;
+#else
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/** Atomically write a counter (release). */
+static inline void atomic_store_size(volatile size_t *ptr, size_t value)
+{
+#if defined(_MSC_VER)
+  _ReadWriteBarrier();
+  *ptr = value;
+#else
+  __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
 }
 
 #endif /* THREADING_H_ */
@@ -0,0 +1,69 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file trace_events.h Recording of trace events. */
+
+#ifndef TRACE_EVENTS_H_
+#define TRACE_EVENTS_H_
+
+#include <stdint.h>
+
+#include <libfreenect2/trace.h>
+
+namespace libfreenect2
+{
+
+/** Sequence number of events that do not belong to a frame. */
+static const uint32_t TraceNoSequence = 0xffffffffu;
+
+/* Event names are kept by pointer and must be string literals. The calls
+ * return immediately unless tracing is enabled.
+ */
+
+/** Begin a span on the calling thread. */
+void traceBegin(const char *name, uint32_t sequence = TraceNoSequence);
+
+/** End the innermost span begun on the calling thread. */
+void traceEnd();
+
+/** Record a point in time on the calling thread. */
+void traceInstant(const char *name, uint32_t sequence = TraceNoSequence);
+
+/** Span for the lifetime of the object. */
+class TraceScope
+{
+public:
+  TraceScope(const char *name, uint32_t sequence = TraceNoSequence);
+  ~TraceScope();
+private:
+  bool active_;
+
+  TraceScope(const TraceScope &);
+  TraceScope &operator=(const TraceScope &);
+};
+
+} /* namespace libfreenect2 */
+#endif /* TRACE_EVENTS_H_ */
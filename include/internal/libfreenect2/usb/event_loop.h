@@ -28,6 +28,7 @@
 #define EVENT_LOOP_H_
 
 #include <libfreenect2/threading.h>
+#include <libfreenect2/packet_pipeline.h>
 
 namespace libfreenect2
 {
@@ -43,8 +44,14 @@ public:
   void start(void *usb_context);
 
   void stop();
+
+  /** The policy is applied by the event thread itself on its next iteration. */
+  void setThreadPolicy(const ThreadPolicy &policy);
 private:
   bool shutdown_;
+  libfreenect2::mutex policy_mutex_;
+  bool policy_pending_;
+  ThreadPolicy policy_;
   libfreenect2::thread *thread_;
   void *usb_context_;
 
@@ -32,6 +32,7 @@
 
 #include <libfreenect2/data_callback.h>
 #include <libfreenect2/threading.h>
+#include <libfreenect2/allocator.h>
 
 namespace libfreenect2
 {
@@ -39,7 +40,12 @@ namespace libfreenect2
 namespace usb
 {
 
-class TransferPool
+/* Transfers are allocated up to a maximum count, of which a target count is
+ * kept in flight. Data loss reported by processTransfer() or by the parser
+ * through onDataLost() grows the target toward the maximum; a stable stream
+ * shrinks it back toward the initial count. Streams are not restarted.
+ */
+class TransferPool: public DataLossCallback
 {
 public:
   TransferPool(libusb_device_handle *device_handle, unsigned char device_endpoint);
@@ -58,6 +64,13 @@ public:
   void cancel();
 
   void setCallback(DataCallback *callback);
+
+  /* Allocator for the transfer buffers, must outlive the allocated transfers.
+   * Uses new[] if not set.
+   */
+  void setAllocator(Allocator *allocator);
+
+  virtual void onDataLost(size_t n);
 protected:
   libfreenect2::mutex stopped_mutex;
   struct Transfer
@@ -79,7 +92,7 @@ protected:
     }
   };
 
-  void allocateTransfers(size_t num_transfers, size_t transfer_size);
+  void allocateTransfers(size_t num_transfers, size_t max_transfers, size_t transfer_size);
 
   virtual libusb_transfer *allocateTransfer() = 0;
   virtual void fillTransfer(libusb_transfer *transfer) = 0;
@@ -94,11 +107,22 @@ private:
   unsigned char device_endpoint_;
 
   TransferQueue transfers_;
-  unsigned char *buffer_;
-  size_t buffer_size_;
+  Allocator *allocator_;
+  Buffer *buffer_;
 
   bool enable_submit_;
 
+  libfreenect2::mutex control_mutex_;
+  size_t min_transfers_;
+  size_t target_transfers_;
+  size_t active_transfers_;
+  size_t completed_transfers_;
+  size_t lost_packets_;
+  size_t stable_rounds_;
+  size_t shrink_rounds_;
+
+  void adjustTransfers();
+
   static void onTransferCompleteStatic(libusb_transfer *transfer);
 
   void onTransferComplete(Transfer *transfer);
@@ -110,7 +134,7 @@ public:
   BulkTransferPool(libusb_device_handle *device_handle, unsigned char device_endpoint);
   virtual ~BulkTransferPool();
 
-  void allocate(size_t num_transfers, size_t transfer_size);
+  void allocate(size_t num_transfers, size_t transfer_size, size_t max_transfers = 0);
 
 protected:
   virtual libusb_transfer *allocateTransfer();
@@ -124,7 +148,7 @@ public:
   IsoTransferPool(libusb_device_handle *device_handle, unsigned char device_endpoint);
   virtual ~IsoTransferPool();
 
-  void allocate(size_t num_transfers, size_t num_packets, size_t packet_size);
+  void allocate(size_t num_transfers, size_t num_packets, size_t packet_size, size_t max_transfers = 0);
 
 protected:
   virtual libusb_transfer *allocateTransfer();
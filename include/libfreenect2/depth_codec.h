@@ -0,0 +1,91 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file depth_codec.h Lossless compression of depth frames. */
+
+#ifndef DEPTH_CODEC_H_
+#define DEPTH_CODEC_H_
+
+#include <stddef.h>
+#include <vector>
+#include <libfreenect2/config.h>
+#include <libfreenect2/frame_listener.hpp>
+
+namespace libfreenect2
+{
+
+class DepthCodecImpl;
+
+/** Compress depth frames for recording.
+ * Depth is quantized to whole millimeters, which is lossless for the values
+ * produced by the depth processors up to their precision. Zero runs and
+ * deltas between valid pixels are coded with variable-length nibbles (RVL).
+ * Encoding and decoding run at several hundred frames per second on one core.
+ *
+ * Each encoded frame carries its own header, so encoded frames can be
+ * appended to one buffer and decoded in sequence. One instance keeps scratch
+ * memory between calls and must not be used from several threads at once.
+ */
+class LIBFREENECT2_API DepthCodec
+{
+public:
+  DepthCodec();
+  ~DepthCodec();
+
+  /** Upper bound of the encoded size of a frame.
+   * @param width Frame width
+   * @param height Frame height
+   */
+  static size_t maxEncodedSize(size_t width, size_t height);
+
+  /** Encode a depth frame.
+   * @param frame Depth frame (float millimeters). Values are rounded to the
+   * nearest millimeter, negative values and NaN become 0, values above 65535
+   * become 65535.
+   * @param[out] buffer The encoded frame is appended to this buffer.
+   * @return Number of bytes appended.
+   */
+  size_t encode(const Frame *frame, std::vector<unsigned char> &buffer);
+
+  /** Decode a depth frame.
+   * @param data Encoded data, starting at a frame produced by encode().
+   * @param size Bytes available at `data`.
+   * @param[out] frame Depth frame of the encoded size (float millimeters).
+   * @return Number of bytes consumed, or 0 if the data is invalid or the frame
+   * has the wrong size.
+   */
+  size_t decode(const unsigned char *data, size_t size, Frame *frame);
+
+private:
+  DepthCodecImpl *impl_;
+
+  /* Disable copy and assignment constructors */
+  DepthCodec(const DepthCodec&);
+  DepthCodec& operator=(const DepthCodec&);
+};
+
+} /* namespace libfreenect2 */
+#endif /* DEPTH_CODEC_H_ */
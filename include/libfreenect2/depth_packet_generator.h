@@ -0,0 +1,114 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file depth_packet_generator.h Synthesis of raw depth packets. */
+
+#ifndef DEPTH_PACKET_GENERATOR_H_
+#define DEPTH_PACKET_GENERATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libfreenect2/config.h>
+#include <libfreenect2/frame_listener.hpp>
+
+namespace libfreenect2
+{
+
+class DataCallback;
+class DepthPacketGeneratorImpl;
+
+/** Generate raw depth packets from a depth and amplitude scene. @ingroup pipeline
+ * This is the inverse of the CPU depth processor: for each pixel, the phases
+ * of the three modulation frequencies are computed from the depth, and the
+ * nine raw measurements are synthesized with the P0 tables and encoded with
+ * the inverse of the 11-bit lookup table. Decoding a generated packet with
+ * the same tables reproduces the scene up to quantization and filtering.
+ *
+ * Use it to load the depth processors and stream parsers without a device,
+ * with as many generators as simulated cameras. Scene values outside the
+ * normal range produce edge cases: saturated and invalid pixels.
+ *
+ * The tables are those of a device, e.g. from DumpPacketPipeline, or a
+ * recording. One instance must not be used from several threads at once.
+ */
+class LIBFREENECT2_API DepthPacketGenerator
+{
+public:
+  /** Bytes in a depth packet: ten 11-bit sub-images of 512x424. */
+  static const size_t PACKET_SIZE = 10 * 512 * 424 * 11 / 8;
+
+  /** Largest iso packet of the depth endpoint. */
+  static const size_t ISO_PACKET_SIZE = 0x8400;
+
+  /**
+   * @param p0_tables P0 tables command response.
+   * @param p0_tables_length Length of the response.
+   * @param xtable X table (512*424 float).
+   * @param ztable Z table (512*424 float).
+   * @param lut 11-bit to 16-bit lookup table (2048 short).
+   */
+  DepthPacketGenerator(const unsigned char *p0_tables, size_t p0_tables_length, const float *xtable, const float *ztable, const short *lut);
+  ~DepthPacketGenerator();
+
+  /** Add noise to the raw measurements.
+   * @param stddev Standard deviation in raw measurement units, 0 to disable.
+   * @param seed Seed of the pseudo-random generator.
+   */
+  void setNoise(float stddev, unsigned int seed = 1);
+
+  /** Generate a packet.
+   * @param depth Depth image (512x424 float millimeters), as output by the
+   * depth processors. Zero, negative and NaN pixels become invalid.
+   * @param ir IR amplitude image (512x424 float), as output by the depth
+   * processors, or NULL for a uniform amplitude of 2000. Values of 65535 and
+   * above become saturated pixels.
+   * @param[out] packet Buffer of PACKET_SIZE bytes.
+   * @return false if the images have the wrong size or the tables are invalid.
+   */
+  bool generate(const Frame *depth, const Frame *ir, unsigned char *packet);
+
+  /** Send a packet to a depth stream parser as the device does: each
+   * sub-image followed by its footer, in iso packets of at most
+   * @p iso_packet_size bytes.
+   * @param packet Packet from generate().
+   * @param sequence Packet sequence number. Parsers emit a packet when the
+   * next sequence number arrives.
+   * @param timestamp Packet timestamp.
+   * @param parser Receiver, e.g. PacketPipeline::getIrPacketParser().
+   * @param iso_packet_size Largest payload passed at once.
+   */
+  void send(const unsigned char *packet, uint32_t sequence, uint32_t timestamp, DataCallback *parser, size_t iso_packet_size = ISO_PACKET_SIZE);
+
+private:
+  DepthPacketGeneratorImpl *impl_;
+
+  /* Disable copy and assignment constructors */
+  DepthPacketGenerator(const DepthPacketGenerator&);
+  DepthPacketGenerator& operator=(const DepthPacketGenerator&);
+};
+
+} /* namespace libfreenect2 */
+#endif /* DEPTH_PACKET_GENERATOR_H_ */
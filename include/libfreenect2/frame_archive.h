@@ -0,0 +1,135 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file frame_archive.h Indexed storage of processed frames. */
+
+#ifndef FRAME_ARCHIVE_H_
+#define FRAME_ARCHIVE_H_
+
+#include <stddef.h>
+#include <string>
+#include <libfreenect2/config.h>
+#include <libfreenect2/frame_listener.hpp>
+
+namespace libfreenect2
+{
+
+class FrameArchiveWriterImpl;
+class FrameArchiveReaderImpl;
+
+/** Write frames to an archive file.
+ * Frames are copied and written by a background thread, so write() can be
+ * called from frame listeners. The index is written by close(). An archive
+ * that was not closed can still be read, but opening it is slower.
+ *
+ * Frames are stored with their metadata. Color frames in Frame::Raw format
+ * store the JPEG bitstream as is.
+ */
+class LIBFREENECT2_API FrameArchiveWriter
+{
+public:
+  /**
+   * @param max_queued_bytes Frames are dropped while this many bytes wait to be written.
+   */
+  FrameArchiveWriter(size_t max_queued_bytes = 256 * 1024 * 1024);
+  ~FrameArchiveWriter();
+
+  /** Create an archive file. @return true on success. */
+  bool open(const std::string &path);
+
+  /** Queue a copy of a frame for writing. Thread-safe.
+   * @param type A Frame::Type, or any other value chosen by the application
+   * for derived frames such as registered color.
+   * @param frame Frame to store.
+   * @return false if the frame was dropped.
+   */
+  bool write(unsigned int type, const Frame *frame);
+
+  /** Write remaining frames and the index, and close the file.
+   * @return false if an I/O error occurred at any point.
+   */
+  bool close();
+
+  /** @return Number of frames dropped because the disk could not keep up. */
+  size_t getDroppedFrames() const;
+private:
+  FrameArchiveWriterImpl *impl_;
+
+  /* Disable copy and assignment constructors */
+  FrameArchiveWriter(const FrameArchiveWriter&);
+  FrameArchiveWriter& operator=(const FrameArchiveWriter&);
+};
+
+/** Read frames from an archive file.
+ * The file is memory mapped. Returned frames point directly into the mapping
+ * and must be deleted before the reader is closed. Their data may be modified
+ * without changing the file.
+ */
+class LIBFREENECT2_API FrameArchiveReader
+{
+public:
+  FrameArchiveReader();
+  ~FrameArchiveReader();
+
+  /** Open an archive file. @return true on success. */
+  bool open(const std::string &path);
+  void close();
+
+  /** @return Number of frames in the archive. */
+  size_t size() const;
+
+  /** @return Type of frame `i` as passed to FrameArchiveWriter::write(). */
+  unsigned int getType(size_t i) const;
+
+  /** @return Timestamp of frame `i`. */
+  uint32_t getTimestamp(size_t i) const;
+
+  /** @return Sequence number of frame `i`. */
+  uint32_t getSequence(size_t i) const;
+
+  /** Get frame `i` without copying its data.
+   * @return New frame object to be deleted by the caller, or NULL if `i` is invalid.
+   */
+  Frame *getFrame(size_t i) const;
+
+  /** Find the first frame of a type at or after a timestamp.
+   * Timestamps of each type must be increasing.
+   * @return Index of the frame, or size() if there is none.
+   */
+  size_t find(unsigned int type, uint32_t timestamp) const;
+
+  /** @return Index of the next frame of the same type after frame `i`, or size() if there is none. */
+  size_t next(size_t i) const;
+private:
+  FrameArchiveReaderImpl *impl_;
+
+  /* Disable copy and assignment constructors */
+  FrameArchiveReader(const FrameArchiveReader&);
+  FrameArchiveReader& operator=(const FrameArchiveReader&);
+};
+
+} /* namespace libfreenect2 */
+#endif /* FRAME_ARCHIVE_H_ */
@@ -47,7 +47,7 @@ class LIBFREENECT2_API Frame
   /** Available types of frames. */
   enum Type
   {
-    Color = 1, ///< 1920x1080. BGRX or RGBX.
+    Color = 1, ///< 1920x1080, or smaller with Freenect2Device::Config::ColorScale. BGRX or RGBX.
     Ir = 2,    ///< 512x424 float. Range is [0.0, 65535.0].
     Depth = 4  ///< 512x424 float, unit: millimeter. Non-positive, NaN, and infinity are invalid or missing data.
   };
@@ -61,6 +61,8 @@ class LIBFREENECT2_API Frame
     BGRX = 4, ///< 4 bytes of B, G, R, and unused per pixel
     RGBX = 5, ///< 4 bytes of R, G, B, and unused per pixel
     Gray = 6, ///< 1 byte of gray per pixel
+    I420 = 7, ///< Planar YUV 4:2:0. A Y plane of 1 byte per pixel, then U and V planes of half width and height (rounded up). 'bytes_per_pixel' is 1, see dataSize().
+    NV12 = 8, ///< YUV 4:2:0. A Y plane of 1 byte per pixel, then a plane of interleaved U and V of half width and height (rounded up). 'bytes_per_pixel' is 1, see dataSize().
   };
 
   size_t width;           ///< Length of a line (in pixels).
@@ -84,6 +86,22 @@ class LIBFREENECT2_API Frame
   Frame(size_t width, size_t height, size_t bytes_per_pixel, unsigned char *data_ = NULL);
   virtual ~Frame();
 
+  /** Finish decoding a frame whose decoding was deferred, see
+   * Freenect2Device::Config::DeferColorDecode. Afterwards the frame has its
+   * final size, format and #data. Frames from the frame listeners of the
+   * library are already decoded, and other frames do nothing.
+   * @return false if decoding failed.
+   */
+  virtual bool decode();
+
+  /** Number of bytes in #data. This is width * height * bytes_per_pixel,
+   * plus the chroma planes for the 4:2:0 formats I420 and NV12.
+   */
+  size_t dataSize() const;
+
+  /** Number of bytes in the data of a frame of the size and format, see dataSize(). */
+  static size_t dataSize(size_t width, size_t height, size_t bytes_per_pixel, Format format);
+
   protected:
   unsigned char* rawdata; ///< Unaligned start of #data.
 };
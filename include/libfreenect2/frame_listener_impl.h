@@ -81,6 +81,138 @@ private:
   SyncMultiFrameListener& operator=(const SyncMultiFrameListener&);
 };
 
+class TimestampSyncFrameListenerImpl;
+
+/** Collect color and depth frames with matching timestamps.
+ *
+ * Frames are buffered per type. Each depth frame (with its IR frame if
+ * subscribed) is paired with the color frame nearest in timestamp, and the
+ * pair becomes available if they are within the tolerance. Frames that do not
+ * find a partner, and sets not picked up before the next one is ready, are
+ * released. Producers are never blocked and frames are never rejected.
+ */
+class LIBFREENECT2_API TimestampSyncFrameListener : public FrameListener
+{
+public:
+  /**
+   * @param frame_types Use bitwise or to combine multiple types, e.g. `Frame::Color | Frame::Depth`.
+   * @param tolerance Maximum timestamp difference between color and depth, in Frame::timestamp units.
+   * The default is half a frame period at 30Hz.
+   * @param queue_size Number of buffered frames per type.
+   */
+  TimestampSyncFrameListener(unsigned int frame_types, uint32_t tolerance = 133, size_t queue_size = 4);
+  virtual ~TimestampSyncFrameListener();
+
+  /** Test if there are new frames. Non-blocking. */
+  bool hasNewFrame() const;
+
+  /** Wait milliseconds for new frames.
+   * @param[out] frame Caller is responsible to release the frames.
+   * @param milliseconds Timeout. This parameter is ignored if not built with C++11 threading support.
+   * @return true if a frame is received; false if not.
+   */
+  bool waitForNewFrame(FrameMap &frame, int milliseconds);
+
+  /** Wait indefinitely for new frames.
+   * @param[out] frame Caller is responsible to release the frames.
+   */
+  void waitForNewFrame(FrameMap &frame);
+
+  /** Shortcut to delete all frames */
+  void release(FrameMap &frame);
+
+  /** Color minus depth timestamp of the last received frames, in Frame::timestamp units. */
+  int getSkew() const;
+
+  /** Number of frames released without being received by the caller. */
+  size_t getDroppedFrames() const;
+
+  virtual bool onNewFrame(Frame::Type type, Frame *frame);
+private:
+  TimestampSyncFrameListenerImpl *impl_;
+
+  /* Disable copy and assignment constructors */
+  TimestampSyncFrameListener(const TimestampSyncFrameListener&);
+  TimestampSyncFrameListener& operator=(const TimestampSyncFrameListener&);
+};
+
+/** Frames of one set, in fixed slots indexed by type. */
+struct LIBFREENECT2_API FrameSet
+{
+  Frame *frames[3]; ///< Color, IR, and depth frame, NULL if not subscribed.
+
+  FrameSet();
+
+  /** Slot index of a frame type. */
+  static size_t index(Frame::Type type) { return type == Frame::Color ? 0 : (type == Frame::Ir ? 1 : 2); }
+
+  Frame *operator[](Frame::Type type) const { return frames[index(type)]; }
+};
+
+class TripleBufferFrameListenerImpl;
+
+/** Collect the latest frame of each type without locks.
+ *
+ * Every frame type has a single shared slot holding the newest frame not yet
+ * acquired by the consumer; a newer frame replaces and releases it. With the
+ * frame a processing thread is filling and the set the consumer holds, this
+ * gives triple buffering per type, but the frames are allocated by the
+ * pipeline instead of rotating through three fixed buffers.
+ *
+ * The producers (the processing threads) and the single consumer only
+ * exchange pointers, so neither side blocks the other. The consumer polls
+ * with tryAcquire(), waits on getEventFd() (Linux), or blocks in
+ * waitForNewFrame(); only the last one makes a producer take a lock, once
+ * per completed set while the consumer waits.
+ */
+class LIBFREENECT2_API TripleBufferFrameListener : public FrameListener
+{
+public:
+  /**
+   * @param frame_types Use bitwise or to combine multiple types, e.g. `Frame::Ir | Frame::Depth`.
+   * @param use_event_fd Create an eventfd signalled when a complete set is available (Linux only).
+   */
+  TripleBufferFrameListener(unsigned int frame_types, bool use_event_fd = false);
+  virtual ~TripleBufferFrameListener();
+
+  /** Take a new frame of every subscribed type if all are available. Non-blocking.
+   * Must be called from a single consumer thread.
+   * @param[out] frames Caller is responsible to release the frames.
+   * @return true if a frame set is received; false if not.
+   */
+  bool tryAcquire(FrameSet &frames);
+
+  /** Wait milliseconds for a new frame set. Same thread rules as tryAcquire().
+   * @param[out] frames Caller is responsible to release the frames.
+   * @param milliseconds Timeout. This parameter is ignored if not built with C++11 threading support.
+   * @return true if a frame set is received; false if not.
+   */
+  bool waitForNewFrame(FrameSet &frames, int milliseconds);
+
+  /** Wait indefinitely for a new frame set. Same thread rules as tryAcquire().
+   * @param[out] frames Caller is responsible to release the frames.
+   */
+  void waitForNewFrame(FrameSet &frames);
+
+  /** Shortcut to delete all frames */
+  void release(FrameSet &frames);
+
+  /** File descriptor which becomes readable when tryAcquire() would succeed,
+   * for use with poll(), epoll or select(). It is reset by tryAcquire().
+   * On other platforms, use waitForNewFrame().
+   * @return The descriptor, or -1 if not enabled or not supported.
+   */
+  int getEventFd() const;
+
+  virtual bool onNewFrame(Frame::Type type, Frame *frame);
+private:
+  TripleBufferFrameListenerImpl *impl_;
+
+  /* Disable copy and assignment constructors */
+  TripleBufferFrameListener(const TripleBufferFrameListener&);
+  TripleBufferFrameListener& operator=(const TripleBufferFrameListener&);
+};
+
 ///@}
 } /* namespace libfreenect2 */
 #endif /* FRAME_LISTENER_IMPL_H_ */
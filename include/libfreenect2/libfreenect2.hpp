@@ -120,10 +120,89 @@ public:
     bool EnableBilateralFilter; ///< Remove some "flying pixels".
     bool EnableEdgeAwareFilter; ///< Remove pixels on edges because ToF cameras produce noisy edges.
 
-    /** Default is 0.5, 4.5, true, true */
+    /** Decode color images at 1/ColorScale of 1920x1080: 1, 2, 4 or 8.
+     * The JPEG decoder skips the discarded detail, so a smaller image is
+     * cheaper to decode. Only the TurboJPEG decoder supports this; other
+     * decoders keep decoding 1920x1080.
+     */
+    unsigned int ColorScale;
+
+    /** Pixel format of color images: BGRX, RGBX, Gray, I420 or NV12.
+     * Gray, I420 and NV12 skip the conversion from YUV and are 4x, 2.7x
+     * smaller than BGRX. Only the TurboJPEG decoder supports formats other
+     * than BGRX; check Frame::format.
+     */
+    Frame::Format ColorFormat;
+
+    /** Deliver color frames still JPEG-compressed, as Frame::Raw, and decode
+     * them when the consumer calls Frame::decode(). Frames that are dropped
+     * or replaced before being consumed are never decoded. The frame
+     * listeners of the library decode on acquisition. Only the TurboJPEG
+     * decoder supports this.
+     */
+    bool DeferColorDecode;
+
+    /** Decode only this region of the color image, in pixels of 1920x1080.
+     * Registration::getColorRegion() computes the region that
+     * Registration::apply() samples. The region is widened to JPEG blocks.
+     * Frames keep their size and the pixels outside are black, so color
+     * coordinates are unchanged. A width or height of 0 decodes the whole
+     * image. Only the TurboJPEG decoder supports this, except for I420 and
+     * NV12.
+     */
+    int ColorRegionX;
+    int ColorRegionY;      ///< See #ColorRegionX.
+    int ColorRegionWidth;  ///< See #ColorRegionX.
+    int ColorRegionHeight; ///< See #ColorRegionX.
+
+    /** Default is 0.5, 4.5, true, true, 1, BGRX, false, and the whole color image */
     LIBFREENECT2_API Config();
   };
 
+  /** Latency distribution of a processing stage.
+   * Percentiles are accurate to 1% of the value, or 1 microsecond.
+   */
+  struct LatencyStatistics
+  {
+    unsigned long long count; ///< Number of measurements.
+    double p50;               ///< Median latency (millisecond).
+    double p99;               ///< 99th percentile latency (millisecond).
+    double p999;              ///< 99.9th percentile latency (millisecond).
+    double max;               ///< Maximum latency (millisecond).
+
+    LIBFREENECT2_API LatencyStatistics();
+  };
+
+  /** Memory allocated by the library for a subsystem.
+   * Memory is accounted per process, so all devices report the same
+   * #current and #peak.
+   */
+  struct MemoryStatistics
+  {
+    unsigned long long current;     ///< Allocated now (byte).
+    unsigned long long peak;        ///< Highest #current since the process started (byte).
+    unsigned long long allocations; ///< Number of allocations since the last start().
+    double rate;                    ///< Allocated bytes per second since the last start().
+
+    LIBFREENECT2_API MemoryStatistics();
+  };
+
+  /** Latency of the processing stages since the last start(), and memory use. */
+  struct Statistics
+  {
+    LatencyStatistics color_assembly; ///< From the first USB transfer of a color packet until it is passed to decoding.
+    LatencyStatistics depth_assembly; ///< From the first USB transfer of a depth packet until it is passed to decoding.
+    LatencyStatistics color_decode;   ///< Color packet processing, including the listener callback.
+    LatencyStatistics depth_decode;   ///< Depth packet processing, including the listener callbacks.
+    LatencyStatistics listener;       ///< Time spent in FrameListener::onNewFrame() of color, IR and depth frames.
+
+    MemoryStatistics usb_transfers;    ///< USB transfer buffers.
+    MemoryStatistics packet_buffers;   ///< Packet buffers of the stream parsers.
+    MemoryStatistics depth_processing; ///< Tables and working memory of the CPU depth processor.
+    MemoryStatistics frames;           ///< Frames allocated by processors.
+    MemoryStatistics registration;     ///< Tables and working memory of Registration objects.
+  };
+
   virtual ~Freenect2Device();
 
   virtual std::string getSerialNumber() = 0;
@@ -188,6 +267,12 @@ public:
    * @return true if ok, false if error.
    */
   virtual bool close() = 0;
+
+  /** Get latency statistics of the processing stages.
+   * Can be called from any thread while the device is running. The
+   * default implementation returns empty statistics.
+   */
+  virtual Statistics getStatistics();
 };
 
 class Freenect2Impl;
@@ -214,6 +299,37 @@ public:
   Freenect2(void *usb_context = 0);
   virtual ~Freenect2();
 
+  /** Threads created by the library. */
+  enum ThreadType
+  {
+    UsbThread,   ///< libusb event thread of this context.
+    ColorThread, ///< Color processing thread of each device.
+    DepthThread  ///< Depth processing thread of each device.
+  };
+
+  /** Set the placement and scheduling of library threads.
+   * The defaults are read from environment variables `LIBFREENECT2_USB_THREAD`,
+   * `LIBFREENECT2_COLOR_THREAD` and `LIBFREENECT2_DEPTH_THREAD`, e.g.
+   * "cpus=2-3 node=0 fifo=50 nice=-5". The applied policy is logged and
+   * returned by getThreadPolicy().
+   * @param type Which threads to configure.
+   * @param policy Policy to apply. The USB thread picks it up immediately,
+   * processing threads apply it when a device is opened.
+   */
+  void setThreadPolicy(ThreadType type, const ThreadPolicy &policy);
+
+  /** @return Policy the last thread of this type actually got when it
+   * started, in any context: parts that could not be applied, e.g. SCHED_FIFO
+   * without CAP_SYS_NICE, are left at their defaults and #cpus lists the CPUs
+   * pinned. Default constructed until such a thread has started.
+   */
+  ThreadPolicy getThreadPolicy(ThreadType type) const;
+
+  /** @return Why parts of the policy of getThreadPolicy() could not be
+   * applied, empty if all were.
+   */
+  std::string getThreadPolicyFailures(ThreadType type) const;
+
   /** Must be called before doing anything else.
    * @return Number of devices, 0 if none
    */
@@ -266,6 +382,33 @@ public:
    * @return New device object, or NULL on failure
    */
   Freenect2Device *openDefaultDevice(const PacketPipeline *factory);
+
+  /** Pacing of a replayed recording. */
+  enum ReplayMode
+  {
+    ReplayRealtime,  ///< Deliver packets at their recorded arrival times.
+    ReplayFixedRate, ///< Deliver frames of each stream at a fixed rate.
+    ReplayFastest,   ///< Deliver frames as fast as the pipeline accepts them, without drops.
+    ReplayDefault    ///< Read `LIBFREENECT2_REPLAY_MODE`, real time if not set.
+  };
+
+  /** Open a recording made with `LIBFREENECT2_RECORD` with default pipeline.
+   * @param path Recording file
+   * @return New device object, or NULL on failure
+   */
+  Freenect2Device *openReplayDevice(const std::string &path);
+
+  /** Open a recording made with `LIBFREENECT2_RECORD`.
+   * The device plays back the recorded raw packets through the pipeline and
+   * reports the recorded serial number and camera parameters. No Kinect is
+   * needed and enumerateDevices() need not be called.
+   * @param path Recording file
+   * @param factory New PacketPipeline instance. This is always automatically freed.
+   * @param mode Pacing of the playback.
+   * @param rate Frames per second in ReplayFixedRate mode.
+   * @return New device object, or NULL on failure
+   */
+  Freenect2Device *openReplayDevice(const std::string &path, const PacketPipeline *factory, ReplayMode mode = ReplayDefault, float rate = 30.0f);
 private:
   Freenect2Impl *impl_;
 
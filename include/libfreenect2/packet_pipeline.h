@@ -32,14 +32,17 @@
 #include <libfreenect2/config.h>
 
 #include <stdlib.h>
+#include <string>
 
 namespace libfreenect2
 {
 
 class DataCallback;
+class Allocator;
 class RgbPacketProcessor;
 class DepthPacketProcessor;
 class PacketPipelineComponents;
+class LatencyHistogram;
 
 /** @defgroup pipeline Packet Pipelines
  * Implement various methods to decode color and depth images with different performance and platform support
@@ -48,6 +51,20 @@ class PacketPipelineComponents;
  */
 ///@{
 
+/** Placement and scheduling of a thread created by libfreenect2.
+ * See Freenect2::setThreadPolicy(). Settings that cannot be applied are
+ * skipped with a warning, and reported by Freenect2::getThreadPolicyFailures().
+ */
+struct LIBFREENECT2_API ThreadPolicy
+{
+  std::string cpus;      ///< CPUs to pin the thread to, e.g. "2-3,6". Empty for no pinning.
+  int numa_node;         ///< Pin to the CPUs of this NUMA node (Linux), intersected with #cpus if both are set. -1 for none.
+  int realtime_priority; ///< SCHED_FIFO priority 1-99, 0 to keep the normal scheduler.
+  int nice;              ///< Nice level with the normal scheduler, 0 to keep unchanged.
+
+  ThreadPolicy(): numa_node(-1), realtime_priority(0), nice(0) {}
+};
+
 /** Base class for other pipeline classes.
  * Methods in this class are reserved for internal use.
  */
@@ -56,6 +73,20 @@ class LIBFREENECT2_API PacketPipeline
 public:
   typedef DataCallback PacketParser;
 
+  /** Memory backing USB transfers, packet buffers and frames.
+   * Combine with bitwise or. Options that are not available on the system
+   * fall back to regular pages with a warning.
+   */
+  enum MemoryFlags
+  {
+    MemoryHeap = 0,                 ///< Regular heap memory.
+    MemoryHugePages = 1,            ///< Explicit hugepages (Linux MAP_HUGETLB), needs pages reserved in vm.nr_hugepages.
+    MemoryTransparentHugePages = 2, ///< Page-aligned memory advised for transparent hugepages.
+    MemoryPrefault = 4,             ///< Fault in all pages at allocation instead of on first use.
+    MemoryLocked = 8,               ///< Lock pages in RAM with mlock(), limited by RLIMIT_MEMLOCK.
+    MemoryDefault = 0x100           ///< Read from environment variable `LIBFREENECT2_MEMORY`, else MemoryHeap.
+  };
+
   PacketPipeline();
   virtual ~PacketPipeline();
 
@@ -64,6 +95,15 @@ public:
 
   virtual RgbPacketProcessor *getRgbPacketProcessor() const;
   virtual DepthPacketProcessor *getDepthPacketProcessor() const;
+
+  /** Allocator for USB transfer buffers, selected by the memory flags. */
+  virtual Allocator *getAllocator() const;
+
+  /** Apply thread policies to the color and depth processing threads. */
+  virtual void setThreadPolicy(const ThreadPolicy &color, const ThreadPolicy &depth) const;
+
+  /** Record the processing time of color and depth packets, NULL to stop. */
+  virtual void setLatencyHistograms(LatencyHistogram *color, LatencyHistogram *depth) const;
 protected:
   PacketPipelineComponents *comp_;
 };
@@ -86,7 +126,7 @@ protected:
 class LIBFREENECT2_API CpuPacketPipeline : public PacketPipeline
 {
 public:
-  CpuPacketPipeline();
+  CpuPacketPipeline(unsigned int memory = MemoryDefault);
   virtual ~CpuPacketPipeline();
 };
 
@@ -98,7 +138,7 @@ protected:
   void *parent_opengl_context_;
   bool debug_;
 public:
-  OpenGLPacketPipeline(void *parent_opengl_context = 0, bool debug = false);
+  OpenGLPacketPipeline(void *parent_opengl_context = 0, bool debug = false, unsigned int memory = MemoryDefault);
   virtual ~OpenGLPacketPipeline();
 };
 #endif // LIBFREENECT2_WITH_OPENGL_SUPPORT
@@ -110,7 +150,7 @@ class LIBFREENECT2_API OpenCLPacketPipeline : public PacketPipeline
 protected:
   const int deviceId;
 public:
-  OpenCLPacketPipeline(const int deviceId = -1);
+  OpenCLPacketPipeline(const int deviceId = -1, unsigned int memory = MemoryDefault);
   virtual ~OpenCLPacketPipeline();
 };
 
@@ -125,7 +165,7 @@ class LIBFREENECT2_API OpenCLKdePacketPipeline : public PacketPipeline
 protected:
   const int deviceId;
 public:
-  OpenCLKdePacketPipeline(const int deviceId = -1);
+  OpenCLKdePacketPipeline(const int deviceId = -1, unsigned int memory = MemoryDefault);
   virtual ~OpenCLKdePacketPipeline();
 };
 #endif // LIBFREENECT2_WITH_OPENCL_SUPPORT
@@ -136,7 +176,7 @@ class LIBFREENECT2_API CudaPacketPipeline : public PacketPipeline
 protected:
   const int deviceId;
 public:
-  CudaPacketPipeline(const int deviceId = -1);
+  CudaPacketPipeline(const int deviceId = -1, unsigned int memory = MemoryDefault);
   virtual ~CudaPacketPipeline();
 };
 
@@ -151,7 +191,7 @@ class LIBFREENECT2_API CudaKdePacketPipeline : public PacketPipeline
 protected:
   const int deviceId;
 public:
-  CudaKdePacketPipeline(const int deviceId = -1);
+  CudaKdePacketPipeline(const int deviceId = -1, unsigned int memory = MemoryDefault);
   virtual ~CudaKdePacketPipeline();
 };
 #endif // LIBFREENECT2_WITH_CUDA_SUPPORT
@@ -42,6 +42,15 @@ class RegistrationImpl;
 /** @defgroup registration Registration and Geometry
  * Register depth to color, create point clouds. */
 
+/** A 3-D point with color, see Registration::computePointCloud(). @ingroup registration */
+struct LIBFREENECT2_API PointXYZRGB
+{
+  float x;      ///< X coordinate (meter), NaN without depth.
+  float y;      ///< Y coordinate (meter), NaN without depth.
+  float z;      ///< Z coordinate (meter), NaN without depth.
+  uint32_t rgb; ///< Color (BGRX as in the registered image), 0 if not visible to the color camera.
+};
+
 /** Combine frames of depth and color camera. @ingroup registration
  * Right now this class uses a reverse engineered formula that uses factory
  * preset extrinsic parameters.  We do not have a clear understanding of these
@@ -71,16 +80,33 @@ public:
   void apply(int dx, int dy, float dz, float& cx, float &cy) const;
 
   /** Map color images onto depth images
-   * @param rgb Color image (1920x1080 BGRX)
+   * @param rgb Color image (1920x1080 BGRX, or 1/2, 1/4, 1/8 of it, see Freenect2Device::Config::ColorScale).
+   *            For Gray, I420 and NV12 images, the Y plane is sampled.
    * @param depth Depth image (512x424 float)
    * @param[out] undistorted Undistorted depth image
-   * @param[out] registered Color image for the depth image (512x424)
+   * @param[out] registered Color image for the depth image (512x424, with the bytes per pixel of 'rgb')
    * @param enable_filter Filter out pixels not visible to both cameras.
-   * @param[out] bigdepth If not `NULL`, return mapping of depth onto colors (1920x1082 float). **1082** not 1080, with a blank top and bottom row.
+   * @param[out] bigdepth If not `NULL`, return mapping of depth onto colors (1920x1082 float). **1082** not 1080, with a blank top and bottom row. For a scaled color image, it has the width of the color image and two more rows.
    * @param[out] color_depth_map Index of mapped color pixel for each depth pixel (512x424).
+   *
+   * Rows are split across the threads set by `LIBFREENECT2_REGISTRATION_THREADS`.
+   * Calls from several threads are serialized.
    */
   void apply(const Frame* rgb, const Frame* depth, Frame* undistorted, Frame* registered, const bool enable_filter = true, Frame* bigdepth = 0, int* color_depth_map = 0) const;
 
+  /** Region of the color image that apply() samples for depths in a range.
+   * Decoding only this region is enough for registration, see
+   * Freenect2Device::Config::ColorRegionX.
+   * @param min_depth Minimum depth (meter), e.g. Freenect2Device::Config::MinDepth.
+   * @param max_depth Maximum depth (meter), e.g. Freenect2Device::Config::MaxDepth.
+   * @param[out] x Left column of the region in the 1920x1080 image.
+   * @param[out] y Top row of the region.
+   * @param[out] width Width of the region.
+   * @param[out] height Height of the region.
+   * @return false if no depth pixel maps into the color image.
+   */
+  bool getColorRegion(float min_depth, float max_depth, int &x, int &y, int &width, int &height) const;
+
   /** Undistort depth
    * @param depth Depth image (512x424 float)
    * @param[out] undistorted Undistorted depth image
@@ -114,6 +140,57 @@ public:
    */
   void getPointXYZ (const Frame* undistorted, int r, int c, float& x, float& y, float& z) const;
 
+  /** Construct a point cloud with color in a single pass.
+   * This gives the same points as apply() followed by getPointXYZRGB() on
+   * every pixel, without the undistorted and registered frames.
+   * @param rgb Color image, as in apply(). The Y value of Gray, I420 and NV12
+   *            images is repeated in the B, G and R bytes.
+   * @param depth Depth image (512x424 float)
+   * @param[out] points Room for 512x424 points, in the order of depth pixels.
+   * @param[out] count Number of points written.
+   * @param enable_filter Filter out colors not visible to both cameras.
+   * @param remove_invalid Leave out points without depth, packing the rest.
+   * @return false if a frame has the wrong size.
+   */
+  bool computePointCloud(const Frame* rgb, const Frame* depth, PointXYZRGB* points, size_t& count, const bool enable_filter = true, const bool remove_invalid = false) const;
+
+  /** Index the depth pixels by where they fall in the color image in every
+   * apply() and computePointCloud(), for colorToDepth() and colorRegionToDepth().
+   * This is off by default, as it costs some time per frame.
+   * @param enable Whether to build the index.
+   */
+  void enableColorToDepth(bool enable = true);
+
+  /** Depth at a color pixel in the last frame, without a bigdepth image.
+   * This is the nearest depth pixel whose window covers the color pixel,
+   * which is what apply() writes to bigdepth.
+   * Needs enableColorToDepth().
+   * @param cx Column in the color image given to the last frame.
+   * @param cy Row in the color image given to the last frame.
+   * @param[out] depth_index Index (row * 512 + column) of the depth pixel in the undistorted image.
+   * @param[out] z Depth of the depth pixel (millimeter).
+   * @return false if no depth pixel covers the color pixel.
+   */
+  bool colorToDepth(int cx, int cy, int &depth_index, float &z) const;
+
+  /** Depth pixels mapped into a rectangle of the color image in the last frame.
+   * Needs enableColorToDepth().
+   * @param x Left column of the rectangle in the color image given to the last frame.
+   * @param y Top row of the rectangle.
+   * @param width Width of the rectangle.
+   * @param height Height of the rectangle.
+   * @param[out] depth_indices Indices (row * 512 + column) of the depth pixels in the undistorted image, in no particular order.
+   * @param max_count Room in @p depth_indices.
+   * @return Number of depth pixels in the rectangle, of which at most @p max_count are written.
+   */
+  size_t colorRegionToDepth(int x, int y, int width, int height, int *depth_indices, size_t max_count) const;
+
+  /** Latency statistics of the frame version of apply().
+   * Registration is not tied to a device, so it is reported here rather
+   * than in Freenect2Device::getStatistics().
+   */
+  Freenect2Device::LatencyStatistics getStatistics() const;
+
 private:
   RegistrationImpl *impl_;
 
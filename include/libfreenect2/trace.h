@@ -0,0 +1,74 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file trace.h Tracing of the frame pipeline. */
+
+#ifndef LIBFREENECT2_TRACE_H_
+#define LIBFREENECT2_TRACE_H_
+
+#include <stddef.h>
+#include <string>
+
+#include <libfreenect2/config.h>
+
+namespace libfreenect2
+{
+
+/** @defgroup tracing Tracing
+ * Record where each frame spends its time across the USB, processing and
+ * user threads, and view it in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Events cover USB transfers, depth subpacket assembly, packet hand-off and
+ * drops, processing stages, listener delivery and frame release by
+ * SyncMultiFrameListener. They carry the frame sequence number.
+ *
+ * Tracing can also be enabled with the environment variable
+ * `LIBFREENECT2_TRACE`, see the main page.
+ */
+///@{
+
+/** Start recording trace events.
+ * Each thread records into its own ring buffer without locking. When a ring
+ * is full, its oldest events are overwritten. The ring of a thread is freed
+ * when the thread exits, or at the next startTracing() if it still holds
+ * events for writeTrace().
+ * @param events_per_thread Ring buffer size of threads that have not recorded yet.
+ */
+LIBFREENECT2_API void startTracing(size_t events_per_thread = 65536);
+
+/** Stop recording trace events. Recorded events are kept for writeTrace(). */
+LIBFREENECT2_API void stopTracing();
+
+/** Write the events recorded since the last startTracing() as Chrome trace
+ * event JSON. Can be called while tracing.
+ * @param path Output file.
+ * @return true if ok, false if error.
+ */
+LIBFREENECT2_API bool writeTrace(const std::string &path);
+
+///@}
+} /* namespace libfreenect2 */
+#endif /* LIBFREENECT2_TRACE_H_ */
@@ -24,10 +24,24 @@
  * either License.
  */
 
-/** @file packet_processor.h Packet processor definitions. */
+/** @file allocator.cpp Allocator implementations. */
 
 #include "libfreenect2/allocator.h"
 #include "libfreenect2/threading.h"
+#include "libfreenect2/logging.h"
+#include <libfreenect2/packet_pipeline.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) || defined(__APPLE__)
+#define LIBFREENECT2_WITH_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
 
 namespace libfreenect2
 {
@@ -57,66 +71,64 @@ class PoolAllocatorImpl: public Allocator
 {
 private:
   Allocator *allocator;
-  Buffer *buffers[2];
-  bool used[2];
+  std::vector<Buffer *> buffers;
+  std::vector<bool> used;
   mutex used_lock;
   condition_variable available_cond;
+
+  int findUnused() const
+  {
+    for (size_t i = 0; i < used.size(); ++i)
+      if (!used[i])
+        return i;
+    return -1;
+  }
 public:
-  PoolAllocatorImpl(Allocator *a): allocator(a), buffers(), used() {}
+  PoolAllocatorImpl(Allocator *a, size_t count): allocator(a), buffers(count, (Buffer *)NULL), used(count, false) {}
 
   Buffer *allocate(size_t size)
   {
     unique_lock guard(used_lock);
-    while (used[0] && used[1])
+    int i;
+    while ((i = findUnused()) < 0)
       WAIT_CONDITION(available_cond, used_lock, guard);
 
-    if (!used[0]) {
-      if (buffers[0] == NULL)
-        buffers[0] = allocator->allocate(size);
-      buffers[0]->length = 0;
-      buffers[0]->allocator = this;
-      used[0] = true;
-      return buffers[0];
-    } else if (!used[1]) {
-      if (buffers[1] == NULL)
-        buffers[1] = allocator->allocate(size);
-      buffers[1]->length = 0;
-      buffers[1]->allocator = this;
-      used[1] = true;
-      return buffers[1];
-    } else {
-      // should never happen
-      return NULL;
-    }
+    if (buffers[i] == NULL)
+      buffers[i] = allocator->allocate(size);
+    buffers[i]->length = 0;
+    buffers[i]->allocator = this;
+    used[i] = true;
+    return buffers[i];
   }
 
   void free(Buffer *b)
   {
     lock_guard guard(used_lock);
-    if (b == buffers[0]) {
-      used[0] = false;
-      available_cond.notify_one();
-    } else if (b == buffers[1]) {
-      used[1] = false;
-      available_cond.notify_one();
+    for (size_t i = 0; i < buffers.size(); ++i)
+    {
+      if (b == buffers[i]) {
+        used[i] = false;
+        available_cond.notify_one();
+        break;
+      }
     }
   }
 
   ~PoolAllocatorImpl()
   {
-    allocator->free(buffers[0]);
-    allocator->free(buffers[1]);
+    for (size_t i = 0; i < buffers.size(); ++i)
+      allocator->free(buffers[i]);
     delete allocator;
   }
 };
 
 PoolAllocator::PoolAllocator():
-  impl_(new PoolAllocatorImpl(new NewAllocator))
+  impl_(new PoolAllocatorImpl(new NewAllocator, 2))
 {
 }
 
-PoolAllocator::PoolAllocator(Allocator *a):
-  impl_(new PoolAllocatorImpl(a))
+PoolAllocator::PoolAllocator(Allocator *a, size_t count):
+  impl_(new PoolAllocatorImpl(a, count))
 {
 }
 
@@ -134,4 +146,361 @@ void PoolAllocator::free(Buffer *b)
 {
   impl_->free(b);
 }
+
+/** A region of pages obtained from mapPages(). */
+struct PageRegion
+{
+  unsigned char *data;
+  size_t length; ///< Mapped length, rounded up to the page size.
+  unsigned int flags; ///< Memory flags actually applied.
+};
+
+#ifdef LIBFREENECT2_WITH_MMAP
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static size_t roundUp(size_t size, size_t page)
+{
+  return (size + page - 1) / page * page;
+}
+
+static void warnOnce(bool &warned, const char *what)
+{
+  if (warned)
+    return;
+  warned = true;
+  LOG_WARNING << what << ": " << strerror(errno) << "; falling back";
+}
+#endif
+
+static bool mapPages(size_t size, unsigned int flags, PageRegion &region)
+{
+  region.data = NULL;
+  region.length = 0;
+  region.flags = PacketPipeline::MemoryHeap;
+
+#ifdef LIBFREENECT2_WITH_MMAP
+  static bool warned_hugetlb = false, warned_thp = false, warned_mlock = false;
+
+  int populate = 0;
+#ifdef MAP_POPULATE
+  if (flags & PacketPipeline::MemoryPrefault)
+    populate = MAP_POPULATE;
+#endif
+
+  void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (flags & PacketPipeline::MemoryHugePages)
+  {
+    size_t length = roundUp(size, HUGE_PAGE_SIZE);
+    p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populate, -1, 0);
+    if (p != MAP_FAILED)
+    {
+      region.length = length;
+      region.flags |= PacketPipeline::MemoryHugePages;
+    }
+    else
+      warnOnce(warned_hugetlb, "hugepage mapping failed (check vm.nr_hugepages)");
+  }
+#endif
+
+  if (p == MAP_FAILED)
+  {
+    // Align to hugepages when THP is requested so the whole region qualifies.
+    size_t page = (flags & (PacketPipeline::MemoryHugePages | PacketPipeline::MemoryTransparentHugePages)) ? HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+    size_t length = roundUp(size, page);
+    p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+    {
+      LOG_ERROR << "failed to map " << length << " bytes: " << strerror(errno);
+      return false;
+    }
+    region.length = length;
+
+#ifdef MADV_HUGEPAGE
+    if (flags & (PacketPipeline::MemoryHugePages | PacketPipeline::MemoryTransparentHugePages))
+    {
+      if (madvise(p, length, MADV_HUGEPAGE) == 0)
+        region.flags |= PacketPipeline::MemoryTransparentHugePages;
+      else
+        warnOnce(warned_thp, "transparent hugepage advice failed");
+    }
+#endif
+
+    // Populate after madvise so the faults can be served with hugepages.
+    if (flags & PacketPipeline::MemoryPrefault)
+    {
+      volatile unsigned char *c = (unsigned char *)p;
+      long stride = sysconf(_SC_PAGESIZE);
+      for (size_t i = 0; i < length; i += stride)
+        c[i] = 0;
+    }
+  }
+
+  if (flags & PacketPipeline::MemoryPrefault)
+    region.flags |= PacketPipeline::MemoryPrefault;
+
+  if (flags & PacketPipeline::MemoryLocked)
+  {
+    if (mlock(p, region.length) == 0)
+      region.flags |= PacketPipeline::MemoryLocked;
+    else
+      warnOnce(warned_mlock, "mlock failed (check ulimit -l)");
+  }
+
+  region.data = (unsigned char *)p;
+  return true;
+#else
+  static bool warned = false;
+  if (flags != PacketPipeline::MemoryHeap && !warned)
+  {
+    warned = true;
+    LOG_WARNING << "page-backed memory is not supported on this platform; using heap memory";
+  }
+  region.data = new unsigned char[size];
+  region.length = size;
+  return true;
+#endif
+}
+
+static void unmapPages(const PageRegion &region)
+{
+  if (region.data == NULL)
+    return;
+#ifdef LIBFREENECT2_WITH_MMAP
+  if (region.flags & PacketPipeline::MemoryLocked)
+    munlock(region.data, region.length);
+  munmap(region.data, region.length);
+#else
+  delete[] region.data;
+#endif
+}
+
+class PageBuffer: public Buffer
+{
+public:
+  PageRegion region;
+};
+
+PageAllocator::PageAllocator(unsigned int flags):
+  flags_(flags)
+{
+}
+
+Buffer *PageAllocator::allocate(size_t size)
+{
+  PageBuffer *b = new PageBuffer;
+  b->length = 0;
+  b->allocator = this;
+  if (mapPages(size, flags_, b->region))
+  {
+    b->data = b->region.data;
+    b->capacity = size;
+  }
+  else
+  {
+    b->data = NULL;
+    b->capacity = 0;
+  }
+  return b;
+}
+
+void PageAllocator::free(Buffer *b)
+{
+  if (b == NULL)
+    return;
+  PageBuffer *pb = static_cast<PageBuffer *>(b);
+  unmapPages(pb->region);
+  delete pb;
+}
+
+TrackingAllocator::TrackingAllocator(Allocator *inner, MemoryTag tag):
+  inner_(inner),
+  tag_(tag)
+{
+}
+
+TrackingAllocator::~TrackingAllocator()
+{
+  delete inner_;
+}
+
+Buffer *TrackingAllocator::allocate(size_t size)
+{
+  Buffer *b = inner_->allocate(size);
+  if (b->data != NULL)
+    trackAllocation(tag_, b->capacity);
+  b->allocator = this;
+  return b;
+}
+
+void TrackingAllocator::free(Buffer *b)
+{
+  if (b == NULL)
+    return;
+  if (b->data != NULL)
+    trackFree(tag_, b->capacity);
+  inner_->free(b);
+}
+
+unsigned int resolveMemoryFlags(unsigned int flags)
+{
+  if (!(flags & PacketPipeline::MemoryDefault))
+    return flags;
+
+  flags = PacketPipeline::MemoryHeap;
+  const char *env = getenv("LIBFREENECT2_MEMORY");
+  if (env == NULL)
+    return flags;
+
+  std::string value(env);
+  size_t pos = 0;
+  while (pos <= value.size())
+  {
+    size_t end = value.find(',', pos);
+    if (end == std::string::npos)
+      end = value.size();
+    std::string token = value.substr(pos, end - pos);
+    pos = end + 1;
+
+    if (token.empty() || token == "heap")
+      continue;
+    else if (token == "hugepages")
+      flags |= PacketPipeline::MemoryHugePages;
+    else if (token == "thp")
+      flags |= PacketPipeline::MemoryTransparentHugePages;
+    else if (token == "prefault")
+      flags |= PacketPipeline::MemoryPrefault;
+    else if (token == "lock")
+      flags |= PacketPipeline::MemoryLocked;
+    else
+      LOG_WARNING << "unknown LIBFREENECT2_MEMORY option: " << token;
+  }
+  return flags;
+}
+
+Allocator *createAllocator(unsigned int flags)
+{
+  flags = resolveMemoryFlags(flags);
+  if (flags == PacketPipeline::MemoryHeap)
+    return new NewAllocator;
+  return new PageAllocator(flags);
+}
+
+/** Frame holding its own heap memory, see createFrame(). */
+class HeapFrame: public Frame
+{
+  size_t size;
+public:
+  HeapFrame(size_t width, size_t height, size_t bytes_per_pixel):
+    Frame(width, height, bytes_per_pixel),
+    size(width * height * bytes_per_pixel)
+  {
+    trackAllocation(MemoryFrames, size);
+  }
+
+  virtual ~HeapFrame()
+  {
+    trackFree(MemoryFrames, size);
+  }
+};
+
+/** Mapping of a released PageFrame, kept for the next frame of the same size. */
+struct CachedPageRegion
+{
+  size_t size;        ///< Size requested from mapPages().
+  unsigned int flags; ///< Flags requested from mapPages().
+  PageRegion region;
+};
+
+/* A few frames per stream are in flight at a time, so this covers the
+ * color, IR and depth streams of a device or two.
+ */
+static const size_t MAX_CACHED_PAGE_REGIONS = 8;
+
+static mutex &pageRegionMutex()
+{
+  static mutex *m = new mutex;
+  return *m;
+}
+
+static std::vector<CachedPageRegion> &cachedPageRegions()
+{
+  static std::vector<CachedPageRegion> *regions = new std::vector<CachedPageRegion>;
+  return *regions;
+}
+
+/* Map pages for a frame, reusing the mapping of a released frame of the
+ * same size and flags. A new mapping is accounted as MemoryFrames until it
+ * is unmapped, which includes the time it is cached.
+ */
+static bool mapFramePages(size_t size, unsigned int flags, PageRegion &region)
+{
+  {
+    lock_guard guard(pageRegionMutex());
+    std::vector<CachedPageRegion> &cached = cachedPageRegions();
+    for (size_t i = cached.size(); i-- > 0;)
+    {
+      if (cached[i].size == size && cached[i].flags == flags)
+      {
+        region = cached[i].region;
+        cached.erase(cached.begin() + i);
+        return true;
+      }
+    }
+  }
+  if (!mapPages(size, flags, region))
+    return false;
+  trackAllocation(MemoryFrames, region.length);
+  return true;
+}
+
+static void unmapFramePages(size_t size, unsigned int flags, const PageRegion &region)
+{
+  {
+    lock_guard guard(pageRegionMutex());
+    std::vector<CachedPageRegion> &cached = cachedPageRegions();
+    if (cached.size() < MAX_CACHED_PAGE_REGIONS)
+    {
+      CachedPageRegion entry;
+      entry.size = size;
+      entry.flags = flags;
+      entry.region = region;
+      cached.push_back(entry);
+      return;
+    }
+  }
+  trackFree(MemoryFrames, region.length);
+  unmapPages(region);
+}
+
+/** Frame holding its own pages, see createFrame(). */
+class PageFrame: public Frame
+{
+  size_t size;
+  unsigned int flags;
+  PageRegion region;
+public:
+  PageFrame(size_t width, size_t height, size_t bytes_per_pixel, unsigned int flags, const PageRegion &region):
+    Frame(width, height, bytes_per_pixel, region.data),
+    size(width * height * bytes_per_pixel),
+    flags(flags),
+    region(region)
+  {
+  }
+
+  virtual ~PageFrame()
+  {
+    unmapFramePages(size, flags, region);
+    data = NULL;
+  }
+};
+
+Frame *createFrame(size_t width, size_t height, size_t bytes_per_pixel, unsigned int flags)
+{
+  flags = resolveMemoryFlags(flags);
+  PageRegion region;
+  if (flags == PacketPipeline::MemoryHeap || !mapFramePages(width * height * bytes_per_pixel, flags, region))
+    return new HeapFrame(width, height, bytes_per_pixel);
+  return new PageFrame(width, height, bytes_per_pixel, flags, region);
+}
 } // namespace libfreenect2
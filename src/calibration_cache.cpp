@@ -0,0 +1,223 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file calibration_cache.cpp On-disk cache of device calibration. */
+
+#include <libfreenect2/calibration_cache.h>
+#include <libfreenect2/stream_recorder.h>
+#include <libfreenect2/depth_packet_processor.h>
+#include <libfreenect2/logging.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace libfreenect2
+{
+
+CalibrationCache::CalibrationCache():
+  p0_tables(NULL),
+  p0_tables_length(0),
+  xtable(NULL),
+  ztable(NULL),
+  lut(NULL)
+{
+  memset(&ir_params, 0, sizeof(ir_params));
+  memset(&color_params, 0, sizeof(color_params));
+}
+
+std::string CalibrationCache::path(const std::string &dir, const std::string &serial)
+{
+  return dir + "/" + serial + ".lf2cal";
+}
+
+bool CalibrationCache::open(const std::string &path, const std::string &serial, const std::string &firmware)
+{
+  close();
+
+  // A missing cache is the normal first start, not worth an error from MappedFile.
+  FILE *probe = fopen(path.c_str(), "rb");
+  if (probe == NULL)
+    return false;
+  fclose(probe);
+
+  if (!file_.open(path))
+    return false;
+  unsigned char *map = file_.data();
+  const size_t map_size = file_.size();
+
+  RecordingFileHeader header;
+  memset(&header, 0, sizeof(header));
+  if (map_size >= sizeof(header))
+    memcpy(&header, map, sizeof(header));
+  if (memcmp(header.magic, "LF2RAW\0\0", sizeof(header.magic)) != 0 || header.version != StreamRecorder::Version)
+  {
+    LOG_WARNING << "ignoring calibration cache " << path << ": not a recording of version " << StreamRecorder::Version;
+    close();
+    return false;
+  }
+
+  std::string cached_serial, cached_firmware;
+  bool has_ir_params = false, has_color_params = false;
+  size_t offset = sizeof(header);
+  while (offset + sizeof(RecordHeader) <= map_size)
+  {
+    RecordHeader rh;
+    memcpy(&rh, map + offset, sizeof(rh));
+    size_t padded = (rh.length + (size_t)7) & ~(size_t)7;
+    if (padded > map_size - offset - sizeof(rh))
+      break;
+    unsigned char *data = map + offset + sizeof(rh);
+    offset += sizeof(rh) + padded;
+
+    switch (rh.type)
+    {
+    case StreamRecorder::P0Tables:
+      p0_tables = data;
+      p0_tables_length = rh.length;
+      break;
+    case StreamRecorder::XTable:
+      if (rh.length == DepthPacketProcessor::TABLE_SIZE * sizeof(float))
+        xtable = reinterpret_cast<const float *>(data);
+      break;
+    case StreamRecorder::ZTable:
+      if (rh.length == DepthPacketProcessor::TABLE_SIZE * sizeof(float))
+        ztable = reinterpret_cast<const float *>(data);
+      break;
+    case StreamRecorder::LookupTable:
+      if (rh.length == DepthPacketProcessor::LUT_SIZE * sizeof(short))
+        lut = reinterpret_cast<const short *>(data);
+      break;
+    case StreamRecorder::IrParams:
+      has_ir_params = rh.length == sizeof(ir_params);
+      if (has_ir_params)
+        memcpy(&ir_params, data, rh.length);
+      break;
+    case StreamRecorder::ColorParams:
+      has_color_params = rh.length == sizeof(color_params);
+      if (has_color_params)
+        memcpy(&color_params, data, rh.length);
+      break;
+    case StreamRecorder::SerialNumber:
+      cached_serial.assign(reinterpret_cast<const char *>(data), rh.length);
+      break;
+    case StreamRecorder::FirmwareVersion:
+      cached_firmware.assign(reinterpret_cast<const char *>(data), rh.length);
+      break;
+    default:
+      break;
+    }
+  }
+
+  const char *problem = NULL;
+  if (cached_serial != serial)
+    problem = "other serial number";
+  else if (cached_firmware != firmware)
+    problem = "other firmware";
+  else if (p0_tables == NULL || xtable == NULL || ztable == NULL || lut == NULL || !has_ir_params || !has_color_params)
+    problem = "incomplete";
+
+  if (problem != NULL)
+  {
+    LOG_WARNING << "ignoring calibration cache " << path << ": " << problem;
+    close();
+    return false;
+  }
+  return true;
+}
+
+void CalibrationCache::close()
+{
+  file_.close();
+  p0_tables = NULL;
+  p0_tables_length = 0;
+  xtable = NULL;
+  ztable = NULL;
+  lut = NULL;
+}
+
+static bool writeRecord(FILE *file, StreamRecorder::RecordType type, const void *data, size_t length)
+{
+  static const unsigned char padding[8] = {0};
+  const size_t padded = (length + 7) & ~(size_t)7;
+
+  RecordHeader header;
+  header.type = type;
+  header.length = length;
+  header.time_ns = 0;
+
+  return fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(data, 1, length, file) == length &&
+         fwrite(padding, 1, padded - length, file) == padded - length;
+}
+
+bool CalibrationCache::write(const std::string &path, const std::string &serial, const std::string &firmware,
+                             const Freenect2Device::IrCameraParams &ir_params, const Freenect2Device::ColorCameraParams &color_params,
+                             const unsigned char *p0_tables, size_t p0_tables_length,
+                             const float *xtable, const float *ztable, const short *lut)
+{
+  // Written next to the cache and renamed, so a reader never sees a partial one.
+  const std::string tmp_path = path + ".tmp";
+  FILE *file = fopen(tmp_path.c_str(), "wb");
+  if (file == NULL)
+  {
+    LOG_WARNING << "failed to write calibration cache " << tmp_path << ": " << strerror(errno);
+    return false;
+  }
+
+  RecordingFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "LF2RAW", 6);
+  header.version = StreamRecorder::Version;
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            writeRecord(file, StreamRecorder::SerialNumber, serial.data(), serial.size()) &&
+            writeRecord(file, StreamRecorder::FirmwareVersion, firmware.data(), firmware.size()) &&
+            writeRecord(file, StreamRecorder::IrParams, &ir_params, sizeof(ir_params)) &&
+            writeRecord(file, StreamRecorder::ColorParams, &color_params, sizeof(color_params)) &&
+            writeRecord(file, StreamRecorder::P0Tables, p0_tables, p0_tables_length) &&
+            writeRecord(file, StreamRecorder::XTable, xtable, DepthPacketProcessor::TABLE_SIZE * sizeof(float)) &&
+            writeRecord(file, StreamRecorder::ZTable, ztable, DepthPacketProcessor::TABLE_SIZE * sizeof(float)) &&
+            writeRecord(file, StreamRecorder::LookupTable, lut, DepthPacketProcessor::LUT_SIZE * sizeof(short));
+  ok = fclose(file) == 0 && ok;
+
+#ifdef _WIN32
+  // rename() does not replace files on Windows.
+  if (ok)
+    remove(path.c_str());
+#endif
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0)
+  {
+    LOG_WARNING << "failed to write calibration cache " << path << ": " << strerror(errno);
+    remove(tmp_path.c_str());
+    return false;
+  }
+
+  LOG_INFO << "wrote calibration cache " << path;
+  return true;
+}
+
+} /* namespace libfreenect2 */
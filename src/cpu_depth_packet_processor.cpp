@@ -30,6 +30,8 @@
 #include <libfreenect2/resource.h>
 #include <libfreenect2/protocol/response.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/statistics.h>
+#include <libfreenect2/trace_events.h>
 
 #include <fstream>
 
@@ -86,6 +88,7 @@ private:
     if(owns_buffer)
     {
       buffer_ = new unsigned char[y_step * height];
+      libfreenect2::trackAllocation(libfreenect2::MemoryDepthProcessing, y_step * height);
     }
     else
     {
@@ -98,6 +101,7 @@ private:
   {
     if(owns_buffer && buffer_ != 0)
     {
+      libfreenect2::trackFree(libfreenect2::MemoryDepthProcessing, buffer_end_ - buffer_);
       delete[] buffer_;
       owns_buffer = false;
       buffer_ = 0;
@@ -286,8 +290,12 @@ public:
 
   bool flip_ptables;
 
+  unsigned int memory_flags;
+
   CpuDepthPacketProcessorImpl()
   {
+    trackAllocation(MemoryDepthProcessing, sizeof(*this));
+    memory_flags = 0;
     newIrFrame();
     newDepthFrame();
 
@@ -300,7 +308,7 @@ public:
   /** Allocate a new IR frame. */
   void newIrFrame()
   {
-    ir_frame = new Frame(512, 424, 4);
+    ir_frame = createFrame(512, 424, 4, memory_flags);
     ir_frame->format = Frame::Float;
     //ir_frame = new Frame(512, 424, 12);
   }
@@ -309,12 +317,13 @@ public:
   {
     delete ir_frame;
     delete depth_frame;
+    trackFree(MemoryDepthProcessing, sizeof(*this));
   }
 
   /** Allocate a new depth frame. */
   void newDepthFrame()
   {
-    depth_frame = new Frame(512, 424, 4);
+    depth_frame = createFrame(512, 424, 4, memory_flags);
     depth_frame->format = Frame::Float;
   }
 
@@ -813,6 +822,16 @@ CpuDepthPacketProcessor::~CpuDepthPacketProcessor()
   delete impl_;
 }
 
+void CpuDepthPacketProcessor::setMemoryFlags(unsigned int flags)
+{
+  DepthPacketProcessor::setMemoryFlags(flags);
+  impl_->memory_flags = flags;
+  delete impl_->ir_frame;
+  delete impl_->depth_frame;
+  impl_->newIrFrame();
+  impl_->newDepthFrame();
+}
+
 void CpuDepthPacketProcessor::setConfiguration(const libfreenect2::DepthPacketProcessor::Config &config)
 {
   DepthPacketProcessor::setConfiguration(config);
@@ -895,15 +914,18 @@ void CpuDepthPacketProcessor::process(const DepthPacket &packet)
 
   float *m_ptr = (m.ptr(0, 0)->val);
 
+  traceBegin("decode_phase", packet.sequence);
   for(int y = 0; y < 424; ++y)
     for(int x = 0; x < 512; ++x, m_ptr += 9)
     {
       impl_->processPixelStage1(x, y, packet.buffer, m_ptr + 0, m_ptr + 3, m_ptr + 6);
     }
+  traceEnd();
 
   // bilateral filtering
   if(impl_->enable_bilateral_filter)
   {
+    TraceScope trace("bilateral_filter", packet.sequence);
     float *m_filtered_ptr = (m_filtered.ptr(0, 0)->val);
     unsigned char *m_max_edge_test_ptr = m_max_edge_test.ptr(0, 0);
 
@@ -924,6 +946,7 @@ void CpuDepthPacketProcessor::process(const DepthPacket &packet)
 
   Mat<float> out_ir(424, 512, impl_->ir_frame->data), out_depth(424, 512, impl_->depth_frame->data);
 
+  traceBegin("unwrap_depth", packet.sequence);
   if(impl_->enable_edge_filter)
   {
     Mat<Vec<float, 3> > depth_ir_sum(424, 512);
@@ -943,7 +966,9 @@ void CpuDepthPacketProcessor::process(const DepthPacket &packet)
       }
 
     m_max_edge_test_ptr = m_max_edge_test.ptr(0, 0);
+    traceEnd();
 
+    TraceScope trace("edge_filter", packet.sequence);
     for(int y = 0; y < 424; ++y)
       for(int x = 0; x < 512; ++x, ++m_max_edge_test_ptr)
       {
@@ -957,6 +982,7 @@ void CpuDepthPacketProcessor::process(const DepthPacket &packet)
       {
         impl_->processPixelStage2(x, y, m_ptr + 0, m_ptr + 3, m_ptr + 6, out_ir.ptr(423 - y, x), out_depth.ptr(423 - y, x), 0);
       }
+    traceEnd();
   }
 
   impl_->stopTiming(LOG_INFO);
@@ -0,0 +1,314 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file depth_codec.cpp Lossless compression of depth frames. */
+
+#include <libfreenect2/depth_codec.h>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace libfreenect2
+{
+
+static const uint32_t DEPTH_CODEC_MAGIC = 0x314c5652; // "RVL1"
+
+struct DepthCodecHeader
+{
+  uint32_t magic;
+  uint32_t width;
+  uint32_t height;
+  uint32_t size; ///< Payload bytes following the header.
+};
+
+/* Packs 4-bit nibbles into 32-bit words, first nibble in the high bits. */
+class NibbleWriter
+{
+public:
+  NibbleWriter(unsigned char *out): out_(out), begin_(out), word_(0), nibbles_(0) {}
+
+  inline void put(uint32_t nibble)
+  {
+    word_ = (word_ << 4) | nibble;
+    if (++nibbles_ == 8)
+    {
+      memcpy(out_, &word_, sizeof(word_));
+      out_ += sizeof(word_);
+      word_ = 0;
+      nibbles_ = 0;
+    }
+  }
+
+  /* 3 bits per nibble, the high bit marks continuation. */
+  inline void putVLE(uint32_t value)
+  {
+    do
+    {
+      uint32_t nibble = value & 7;
+      value >>= 3;
+      if (value)
+        nibble |= 8;
+      put(nibble);
+    } while (value);
+  }
+
+  size_t finish()
+  {
+    if (nibbles_ > 0)
+    {
+      word_ <<= 4 * (8 - nibbles_);
+      memcpy(out_, &word_, sizeof(word_));
+      out_ += sizeof(word_);
+      nibbles_ = 0;
+    }
+    return out_ - begin_;
+  }
+
+private:
+  unsigned char *out_;
+  unsigned char *begin_;
+  uint32_t word_;
+  int nibbles_;
+};
+
+class NibbleReader
+{
+public:
+  NibbleReader(const unsigned char *in, size_t size): in_(in), end_(in + size), word_(0), nibbles_(0), error_(false) {}
+
+  inline uint32_t get()
+  {
+    if (nibbles_ == 0)
+    {
+      if (end_ - in_ < (ptrdiff_t)sizeof(word_))
+      {
+        error_ = true;
+        return 0;
+      }
+      memcpy(&word_, in_, sizeof(word_));
+      in_ += sizeof(word_);
+      nibbles_ = 8;
+    }
+    uint32_t nibble = word_ >> 28;
+    word_ <<= 4;
+    nibbles_--;
+    return nibble;
+  }
+
+  inline uint32_t getVLE()
+  {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 32; shift += 3)
+    {
+      uint32_t nibble = get();
+      value |= (nibble & 7) << shift;
+      if (!(nibble & 8))
+        return value;
+    }
+    error_ = true;
+    return 0;
+  }
+
+  bool error() const { return error_; }
+
+private:
+  const unsigned char *in_;
+  const unsigned char *end_;
+  uint32_t word_;
+  int nibbles_;
+  bool error_;
+};
+
+class DepthCodecImpl
+{
+public:
+  std::vector<uint16_t> pixels;
+
+  void quantize(const float *in, size_t n)
+  {
+    pixels.resize(n);
+    uint16_t *out = &pixels[0];
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 max = _mm_set1_ps(65535.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i bias32 = _mm_set1_epi32(32768);
+    const __m128i bias16 = _mm_set1_epi16(-32768);
+    for (; i + 8 <= n; i += 8)
+    {
+      // max() returns the second operand for NaN.
+      __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), zero), max);
+      __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), zero), max);
+      // Round half up by truncation as the scalar loop; _mm_cvtps_epi32 would round half to even.
+      // No unsigned saturating pack in SSE2, shift to signed and back.
+      __m128i ia = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(a, half)), bias32);
+      __m128i ib = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(b, half)), bias32);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_xor_si128(_mm_packs_epi32(ia, ib), bias16));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+      float v = in[i];
+      out[i] = v > 0.0f ? (v < 65535.0f ? (uint16_t)(v + 0.5f) : 65535) : 0;
+    }
+  }
+
+  void dequantize(float *out, size_t n)
+  {
+    const uint16_t *in = &pixels[0];
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8)
+    {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+      _mm_storeu_ps(out + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)));
+      _mm_storeu_ps(out + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)));
+    }
+#endif
+    for (; i < n; ++i)
+      out[i] = in[i];
+  }
+
+  /* Length of the run of zero (or nonzero) pixels starting at i. */
+  static size_t runLength(const uint16_t *p, size_t i, size_t n, bool zeros)
+  {
+    size_t start = i;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const int all = zeros ? 0xffff : 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero)) != all)
+        break;
+    }
+#endif
+    while (i < n && (p[i] == 0) == zeros)
+      ++i;
+    return i - start;
+  }
+};
+
+DepthCodec::DepthCodec() :
+  impl_(new DepthCodecImpl)
+{
+}
+
+DepthCodec::~DepthCodec()
+{
+  delete impl_;
+}
+
+size_t DepthCodec::maxEncodedSize(size_t width, size_t height)
+{
+  // A run header takes at most as many nibbles as its run has pixels, and
+  // a 16-bit delta takes at most 6 nibbles.
+  size_t nibbles = 8 * width * height + 16;
+  return sizeof(DepthCodecHeader) + (nibbles + 7) / 8 * 4;
+}
+
+size_t DepthCodec::encode(const Frame *frame, std::vector<unsigned char> &buffer)
+{
+  const size_t n = frame->width * frame->height;
+  impl_->quantize(reinterpret_cast<const float *>(frame->data), n);
+  const uint16_t *p = &impl_->pixels[0];
+
+  const size_t offset = buffer.size();
+  buffer.resize(offset + maxEncodedSize(frame->width, frame->height));
+
+  NibbleWriter writer(&buffer[offset] + sizeof(DepthCodecHeader));
+  int prev = 0;
+  for (size_t i = 0; i < n;)
+  {
+    size_t zeros = DepthCodecImpl::runLength(p, i, n, true);
+    i += zeros;
+    size_t nonzeros = DepthCodecImpl::runLength(p, i, n, false);
+    writer.putVLE(zeros);
+    writer.putVLE(nonzeros);
+    for (size_t end = i + nonzeros; i < end; ++i)
+    {
+      int delta = p[i] - prev;
+      prev = p[i];
+      writer.putVLE(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+    }
+  }
+
+  DepthCodecHeader header;
+  header.magic = DEPTH_CODEC_MAGIC;
+  header.width = frame->width;
+  header.height = frame->height;
+  header.size = writer.finish();
+  memcpy(&buffer[offset], &header, sizeof(header));
+
+  const size_t length = sizeof(header) + header.size;
+  buffer.resize(offset + length);
+  return length;
+}
+
+size_t DepthCodec::decode(const unsigned char *data, size_t size, Frame *frame)
+{
+  DepthCodecHeader header;
+  if (size < sizeof(header))
+    return 0;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != DEPTH_CODEC_MAGIC || header.size > size - sizeof(header))
+    return 0;
+  if (header.width != frame->width || header.height != frame->height || frame->bytes_per_pixel != sizeof(float))
+    return 0;
+
+  const size_t n = frame->width * frame->height;
+  impl_->pixels.resize(n);
+  uint16_t *p = &impl_->pixels[0];
+
+  NibbleReader reader(data + sizeof(header), header.size);
+  int prev = 0;
+  for (size_t i = 0; i < n;)
+  {
+    size_t zeros = reader.getVLE();
+    size_t nonzeros = reader.getVLE();
+    if (reader.error() || zeros + nonzeros == 0 || zeros > n - i || nonzeros > n - i - zeros)
+      return 0;
+    memset(p + i, 0, zeros * sizeof(*p));
+    i += zeros;
+    for (size_t end = i + nonzeros; i < end; ++i)
+    {
+      uint32_t zigzag = reader.getVLE();
+      prev += (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+      p[i] = prev;
+    }
+    if (reader.error())
+      return 0;
+  }
+
+  impl_->dequantize(reinterpret_cast<float *>(frame->data), n);
+  return sizeof(header) + header.size;
+}
+
+} /* namespace libfreenect2 */
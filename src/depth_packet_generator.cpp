@@ -0,0 +1,301 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file depth_packet_generator.cpp Forward model of the CPU depth processor. */
+
+#define _USE_MATH_DEFINES
+#include <libfreenect2/depth_packet_generator.h>
+#include <libfreenect2/depth_packet_processor.h>
+#include <libfreenect2/depth_packet_stream_parser.h>
+#include <libfreenect2/data_callback.h>
+#include <libfreenect2/protocol/response.h>
+#include <libfreenect2/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace libfreenect2
+{
+
+const size_t DepthPacketGenerator::PACKET_SIZE;
+const size_t DepthPacketGenerator::ISO_PACKET_SIZE;
+
+static const size_t SUBIMAGE_SIZE = 512 * 424 * 11 / 8;
+
+/* Each measurement wraps this many times over the unambiguous range of
+ * the three frequencies together. The CPU processor unwraps to a phase in
+ * [0, 9), the sum of the three unwrapped phases divided by their factors.
+ */
+static const int WRAPS[3] = {10, 2, 15};
+
+class DepthPacketGeneratorImpl
+{
+public:
+  DepthPacketProcessor::Parameters params;
+  bool good;
+
+  /* Per pixel in processing order: the P0 phase of each frequency. */
+  std::vector<float> p0[3];
+  std::vector<float> xtable, ztable;
+
+  /* Code of the nearest lookup table value, indexed by value - lut_min. */
+  std::vector<uint16_t> inverse_lut;
+  int lut_min, lut_max;
+
+  float noise;
+  unsigned int seed;
+
+  std::vector<unsigned char> iso_buffer;
+
+  DepthPacketGeneratorImpl(): good(false), lut_min(0), lut_max(0), noise(0), seed(1) {}
+
+  void loadP0Tables(const unsigned char *buffer, size_t length)
+  {
+    if (length < sizeof(protocol::P0TablesResponse))
+    {
+      LOG_ERROR << "P0Table response too short!";
+      good = false;
+      return;
+    }
+    const protocol::P0TablesResponse *response = reinterpret_cast<const protocol::P0TablesResponse *>(buffer);
+    const uint16_t *tables[3] = {response->p0table0, response->p0table1, response->p0table2};
+
+    /* The CPU processor flips the tables upside-down. */
+    for (int k = 0; k < 3; ++k)
+    {
+      p0[k].resize(DepthPacketProcessor::TABLE_SIZE);
+      for (int y = 0; y < 424; ++y)
+        for (int x = 0; x < 512; ++x)
+          p0[k][y * 512 + x] = -(float)tables[k][(423 - y) * 512 + x] * 0.000031f * (float)M_PI;
+    }
+  }
+
+  /* Map every value between the table extremes to the code of the nearest
+   * value, excluding the saturation code.
+   */
+  void loadLookupTable(const short *lut)
+  {
+    std::vector<std::pair<int, uint16_t> > values;
+    for (int code = 0; code < (int)DepthPacketProcessor::LUT_SIZE; ++code)
+      if (lut[code] != 32767)
+        values.push_back(std::make_pair((int)lut[code], (uint16_t)code));
+    std::sort(values.begin(), values.end());
+
+    lut_min = values.front().first;
+    lut_max = values.back().first;
+    inverse_lut.resize(lut_max - lut_min + 1);
+    size_t next = 0;
+    for (int v = lut_min; v <= lut_max; ++v)
+    {
+      while (next + 1 < values.size() && values[next + 1].first <= v)
+        next++;
+      size_t nearest = next;
+      if (next + 1 < values.size() && values[next + 1].first - v < v - values[next].first)
+        nearest = next + 1;
+      inverse_lut[v - lut_min] = values[nearest].second;
+    }
+  }
+
+  /* Roughly normal noise, the sum of four uniform samples. */
+  float nextNoise()
+  {
+    float sum = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+      seed = seed * 1103515245 + 12345;
+      sum += (float)((seed >> 8) & 0xffff) / 65536.0f - 0.5f;
+    }
+    return sum * noise * 1.7320508f;
+  }
+
+  uint16_t encode(float value)
+  {
+    int v = (int)std::floor(value + 0.5f);
+    v = std::min(std::max(v, lut_min), lut_max);
+    return inverse_lut[v - lut_min];
+  }
+
+  /* Inverse of the depth mapping in processPixelStage2(): the phase whose
+   * depth after the nonlinear fit is the given depth.
+   */
+  float phaseOfDepth(float depth, float z, float x)
+  {
+    const double u = params.unambigious_dist;
+    const double c = (double)z * x * 90 / (8192.0 * 4 * u * u);
+    const double d = depth;
+    const double discriminant = d * d - 4 * z * d * c;
+    double phase = discriminant >= 0 ? (d + std::sqrt(discriminant)) / (2 * z) : d / z;
+    return (float)(phase - params.phase_offset);
+  }
+
+  static void put(unsigned char *row, int x, uint16_t code)
+  {
+    const int bit = ((x >> 2) + ((x & 0x3) << 7)) * 11;
+    unsigned char *p = row + (bit >> 3);
+    const int shift = bit & 7;
+    const uint32_t bits = (uint32_t)code << shift;
+    p[0] |= bits & 0xff;
+    p[1] |= (bits >> 8) & 0xff;
+    if (shift > 5)
+      p[2] |= (bits >> 16) & 0xff;
+  }
+
+  void generate(const float *depth, const float *ir, unsigned char *packet)
+  {
+    std::memset(packet, 0, DepthPacketGenerator::PACKET_SIZE);
+
+    float phase_cos[3], phase_sin[3];
+    for (int j = 0; j < 3; ++j)
+    {
+      phase_cos[j] = std::cos(params.phase_in_rad[j]);
+      phase_sin[j] = std::sin(params.phase_in_rad[j]);
+    }
+
+    for (int y = 0; y < 424; ++y)
+    {
+      /* Processing row y is output row 423 - y, and is stored in row i of
+       * each sub-image.
+       */
+      const int out = (423 - y) * 512;
+      const int i = y < 212 ? y + 212 : 423 - y;
+      for (int x = 1; x < 511; ++x)
+      {
+        const int offset = y * 512 + x;
+        const float d = depth[out + x];
+        const float amplitude = ir ? ir[out + x] : 2000.0f;
+        const float z = ztable[offset];
+        uint16_t codes[9];
+
+        if (amplitude >= 65535.0f)
+        {
+          /* 32767 marks a saturated measurement. */
+          for (int s = 0; s < 9; ++s)
+            codes[s] = 1024;
+        }
+        else
+        {
+          float phase = 0;
+          bool valid = d > 0 && z > 0 && amplitude > 0;
+          if (valid)
+          {
+            phase = phaseOfDepth(d, z, xtable[offset]) / 9.0f;
+            valid = phase > 0 && phase < 1;
+          }
+
+          for (int k = 0; k < 3; ++k)
+          {
+            /* The processor output is the mean amplitude times
+             * ab_output_multiplier, and the amplitude of one frequency is
+             * 3/2 * A * ab_multiplier_per_frq * ab_multiplier.
+             */
+            const float a = valid ? amplitude / params.ab_output_multiplier / (1.5f * params.ab_multiplier_per_frq[k] * params.ab_multiplier) : 0.0f;
+            const float wrapped = phase * WRAPS[k];
+            const float theta = 2.0f * (float)M_PI * (wrapped - std::floor(wrapped)) + p0[k][offset];
+            const float cos_theta = a * std::cos(theta), sin_theta = a * std::sin(theta);
+            for (int j = 0; j < 3; ++j)
+            {
+              float m = cos_theta * phase_cos[j] - sin_theta * phase_sin[j];
+              if (noise > 0)
+                m += nextNoise();
+              codes[3 * k + j] = encode(m);
+            }
+          }
+        }
+
+        for (int s = 0; s < 9; ++s)
+          put(packet + s * SUBIMAGE_SIZE + i * 704, x, codes[s]);
+      }
+    }
+  }
+};
+
+DepthPacketGenerator::DepthPacketGenerator(const unsigned char *p0_tables, size_t p0_tables_length, const float *xtable, const float *ztable, const short *lut):
+  impl_(new DepthPacketGeneratorImpl())
+{
+  impl_->good = true;
+  impl_->loadP0Tables(p0_tables, p0_tables_length);
+  impl_->xtable.assign(xtable, xtable + DepthPacketProcessor::TABLE_SIZE);
+  impl_->ztable.assign(ztable, ztable + DepthPacketProcessor::TABLE_SIZE);
+  impl_->loadLookupTable(lut);
+}
+
+DepthPacketGenerator::~DepthPacketGenerator()
+{
+  delete impl_;
+}
+
+void DepthPacketGenerator::setNoise(float stddev, unsigned int seed)
+{
+  impl_->noise = stddev;
+  impl_->seed = seed;
+}
+
+bool DepthPacketGenerator::generate(const Frame *depth, const Frame *ir, unsigned char *packet)
+{
+  if (!impl_->good)
+    return false;
+  if (depth->width != 512 || depth->height != 424 || depth->bytes_per_pixel != 4)
+    return false;
+  if (ir != NULL && (ir->width != 512 || ir->height != 424 || ir->bytes_per_pixel != 4))
+    return false;
+
+  impl_->generate(reinterpret_cast<const float *>(depth->data), ir ? reinterpret_cast<const float *>(ir->data) : NULL, packet);
+  return true;
+}
+
+void DepthPacketGenerator::send(const unsigned char *packet, uint32_t sequence, uint32_t timestamp, DataCallback *parser, size_t iso_packet_size)
+{
+  std::vector<unsigned char> &buffer = impl_->iso_buffer;
+  buffer.resize(SUBIMAGE_SIZE + sizeof(DepthSubPacketFooter));
+
+  /* The device sends all ten sub-images, including the unused last one. */
+  for (uint32_t s = 0; s < 10; ++s)
+  {
+    std::memcpy(&buffer[0], packet + s * SUBIMAGE_SIZE, SUBIMAGE_SIZE);
+
+    DepthSubPacketFooter footer;
+    std::memset(&footer, 0, sizeof(footer));
+    footer.timestamp = timestamp;
+    footer.sequence = sequence;
+    footer.subsequence = s;
+    footer.length = SUBIMAGE_SIZE;
+    std::memcpy(&buffer[SUBIMAGE_SIZE], &footer, sizeof(footer));
+
+    for (size_t offset = 0; offset < buffer.size();)
+    {
+      size_t end = std::min(offset + iso_packet_size, buffer.size());
+      /* The parser only finds a footer at the end of a payload. */
+      if (end > SUBIMAGE_SIZE && end < buffer.size())
+        end = offset < SUBIMAGE_SIZE ? SUBIMAGE_SIZE : buffer.size();
+      parser->onDataReceived(&buffer[offset], end - offset);
+      offset = end;
+    }
+  }
+}
+
+} /* namespace libfreenect2 */
@@ -28,6 +28,8 @@
 
 #include <libfreenect2/depth_packet_stream_parser.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/statistics.h>
+#include <libfreenect2/trace_events.h>
 #include <memory.h>
 
 namespace libfreenect2
@@ -35,9 +37,13 @@ namespace libfreenect2
 
 DepthPacketStreamParser::DepthPacketStreamParser() :
     processor_(noopProcessor<DepthPacket>()),
+    loss_callback_(0),
+    histogram_(0),
+    packet_start_(0),
     processed_packets_(-1),
     current_sequence_(0),
-    current_subsequence_(0)
+    current_subsequence_(0),
+    current_timestamp_(0)
 {
   size_t single_image = 512*424*11/8;
   buffer_size_ = 10 * single_image;
@@ -47,10 +53,12 @@ DepthPacketStreamParser::DepthPacketStreamParser() :
   work_buffer_.data = new unsigned char[single_image];
   work_buffer_.capacity = single_image;
   work_buffer_.length = 0;
+  trackAllocation(MemoryPacketBuffers, single_image);
 }
 
 DepthPacketStreamParser::~DepthPacketStreamParser()
 {
+  trackFree(MemoryPacketBuffers, work_buffer_.capacity);
   delete[] work_buffer_.data;
 }
 
@@ -61,6 +69,63 @@ void DepthPacketStreamParser::setPacketProcessor(libfreenect2::BaseDepthPacketPr
   processor_->allocateBuffer(packet_, buffer_size_);
 }
 
+void DepthPacketStreamParser::setDataLossCallback(DataLossCallback *callback)
+{
+  loss_callback_ = callback;
+}
+
+bool DepthPacketStreamParser::ready()
+{
+  return processor_->ready();
+}
+
+void DepthPacketStreamParser::setLatencyHistogram(LatencyHistogram *histogram)
+{
+  histogram_ = histogram;
+}
+
+void DepthPacketStreamParser::flush()
+{
+  if(current_subsequence_ == 0x3ff)
+    processPacket(current_timestamp_);
+  current_subsequence_ = 0;
+}
+
+void DepthPacketStreamParser::processPacket(uint32_t timestamp)
+{
+  if(processor_->ready())
+  {
+    DepthPacket &packet = packet_;
+    packet.sequence = current_sequence_;
+    packet.timestamp = timestamp;
+    packet.buffer = packet_.memory->data;
+    packet.buffer_length = packet_.memory->capacity;
+
+    if(histogram_)
+      histogram_->recordSince(packet_start_);
+    traceInstant("depth_handoff", current_sequence_);
+
+    processor_->process(packet);
+    processor_->allocateBuffer(packet_, buffer_size_);
+
+    processed_packets_++;
+    if (processed_packets_ == 0)
+      processed_packets_ = current_sequence_;
+    int diff = current_sequence_ - processed_packets_;
+    const int interval = 30;
+    if ((current_sequence_ % interval == 0 && diff != 0) || diff >= interval)
+    {
+      LOG_INFO << diff << " packets were lost";
+      processed_packets_ = current_sequence_;
+    }
+  }
+  else
+  {
+    LOG_DEBUG << "skipping depth packet";
+    traceInstant("depth_skipped", current_sequence_);
+  }
+}
+
 void DepthPacketStreamParser::onDataReceived(unsigned char* buffer, size_t in_length)
 {
   if (packet_.memory == NULL || packet_.memory->data == NULL)
@@ -109,46 +174,36 @@ void DepthPacketStreamParser::onDataReceived(unsigned char* buffer, size_t in_le
         {
           if(current_subsequence_ == 0x3ff)
           {
-            if(processor_->ready())
-            {
-              DepthPacket &packet = packet_;
-              packet.sequence = current_sequence_;
-              packet.timestamp = footer->timestamp;
-              packet.buffer = packet_.memory->data;
-              packet.buffer_length = packet_.memory->capacity;
-
-              processor_->process(packet);
-              processor_->allocateBuffer(packet_, buffer_size_);
-
-              processed_packets_++;
-              if (processed_packets_ == 0)
-                processed_packets_ = current_sequence_;
-              int diff = current_sequence_ - processed_packets_;
-              const int interval = 30;
-              if ((current_sequence_ % interval == 0 && diff != 0) || diff >= interval)
-              {
-                LOG_INFO << diff << " packets were lost";
-                processed_packets_ = current_sequence_;
-              }
-            }
-            else
-            {
-              LOG_DEBUG << "skipping depth packet";
-            }
+            processPacket(footer->timestamp);
           }
           else
           {
             LOG_DEBUG << "not all subsequences received " << current_subsequence_;
+            traceInstant("depth_incomplete", current_sequence_);
+            if(loss_callback_)
+              loss_callback_->onDataLost(1);
           }
 
+          // packets skipped because the processor is busy are not counted,
+          // only those which never made it through USB.
+          uint32_t gap = footer->sequence - current_sequence_ - 1;
+          if(loss_callback_ && current_subsequence_ != 0 && gap > 0 && gap < 30)
+            loss_callback_->onDataLost(gap);
+
           current_sequence_ = footer->sequence;
           current_subsequence_ = 0;
         }
 
         Buffer &fb = *packet_.memory;
 
+        if(current_subsequence_ == 0 && histogram_)
+          packet_start_ = LatencyHistogram::now();
+
+        traceInstant("depth_subpacket", footer->sequence);
+
         // set the bit corresponding to the subsequence number to 1
         current_subsequence_ |= 1 << footer->subsequence;
+        current_timestamp_ = footer->timestamp;
 
         if(footer->subsequence * footer->length > fb.capacity)
         {
@@ -27,6 +27,7 @@
 /** @file event_loop.cpp Event handling. */
 
 #include <libfreenect2/usb/event_loop.h>
+#include <libfreenect2/thread_policy.h>
 
 #include <libusb.h>
 #ifdef _WIN32
@@ -51,6 +52,7 @@ void EventLoop::static_execute(void *cookie)
 
 EventLoop::EventLoop() :
     shutdown_(false),
+    policy_pending_(false),
     thread_(0),
     usb_context_(0)
 {
@@ -88,6 +90,13 @@ void EventLoop::stop()
   }
 }
 
+void EventLoop::setThreadPolicy(const ThreadPolicy &policy)
+{
+  libfreenect2::lock_guard guard(policy_mutex_);
+  policy_ = policy;
+  policy_pending_ = true;
+}
+
 /** Execute the job, until shut down. */
 void EventLoop::execute()
 {
@@ -98,6 +107,15 @@ void EventLoop::execute()
 
   while(!shutdown_)
   {
+    {
+      libfreenect2::lock_guard guard(policy_mutex_);
+      if(policy_pending_)
+      {
+        applyThreadPolicy("USB", policy_, &threadPolicyReport(Freenect2::UsbThread));
+        policy_pending_ = false;
+      }
+    }
+
     libusb_handle_events_timeout_completed(reinterpret_cast<libusb_context *>(usb_context_), &t, 0);
   }
 }
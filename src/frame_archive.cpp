@@ -0,0 +1,488 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file frame_archive.cpp Indexed storage of processed frames. */
+
+#include <libfreenect2/frame_archive.h>
+#include <libfreenect2/mapped_file.h>
+#include <libfreenect2/threading.h>
+#include <libfreenect2/logging.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace libfreenect2
+{
+
+/* An archive is a file header, frames and an index followed by a footer.
+ * Each frame is a FrameArchiveEntry followed by the data, padded to 64 bytes
+ * so that frame data keeps the alignment of Frame. The index repeats all
+ * entries, so that frames can be recovered by scanning if it is missing.
+ */
+struct FrameArchiveHeader
+{
+  char magic[8]; ///< "LF2FRAME"
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct FrameArchiveEntry
+{
+  uint32_t magic; ///< FRAME_ARCHIVE_ENTRY_MAGIC
+  uint32_t type;
+  uint64_t offset; ///< File offset of the frame data.
+  uint64_t size;   ///< Bytes of frame data.
+  uint32_t width;
+  uint32_t height;
+  uint32_t bytes_per_pixel;
+  uint32_t format;
+  uint32_t timestamp;
+  uint32_t sequence;
+  uint32_t status;
+  float exposure;
+  float gain;
+  float gamma;
+};
+
+struct FrameArchiveFooter
+{
+  uint64_t index_offset;
+  uint64_t count;
+  char magic[8]; ///< "LF2INDEX"
+};
+
+static const uint32_t FRAME_ARCHIVE_VERSION = 1;
+static const uint32_t FRAME_ARCHIVE_ENTRY_MAGIC = 0x4632464c; // "LF2F"
+static const size_t FRAME_ARCHIVE_ALIGNMENT = 64;
+
+static inline uint64_t alignOffset(uint64_t offset)
+{
+  return (offset + FRAME_ARCHIVE_ALIGNMENT - 1) & ~(uint64_t)(FRAME_ARCHIVE_ALIGNMENT - 1);
+}
+
+class FrameArchiveWriterImpl
+{
+public:
+  struct Item
+  {
+    FrameArchiveEntry entry;
+    unsigned char *data;
+  };
+
+  FILE *file_;
+  libfreenect2::mutex mutex_;
+  libfreenect2::condition_variable cond_;
+  std::deque<Item> queue_;
+  size_t queued_bytes_;
+  const size_t max_queued_bytes_;
+  size_t dropped_;
+  bool shutdown_;
+  bool failed_;
+  libfreenect2::thread *thread_;
+
+  // Used by the writer thread only.
+  uint64_t offset_;
+  std::vector<FrameArchiveEntry> index_;
+
+  FrameArchiveWriterImpl(size_t max_queued_bytes):
+    file_(NULL),
+    queued_bytes_(0),
+    max_queued_bytes_(max_queued_bytes),
+    dropped_(0),
+    shutdown_(false),
+    failed_(false),
+    thread_(NULL),
+    offset_(0)
+  {
+  }
+
+  static void static_execute(void *cookie)
+  {
+    static_cast<FrameArchiveWriterImpl *>(cookie)->execute();
+  }
+
+  bool writeBytes(const void *data, size_t length)
+  {
+    if (length > 0 && fwrite(data, 1, length, file_) != length)
+    {
+      LOG_ERROR << "failed to write archive: " << strerror(errno);
+      return false;
+    }
+    offset_ += length;
+    return true;
+  }
+
+  bool pad()
+  {
+    static const unsigned char zeros[FRAME_ARCHIVE_ALIGNMENT] = {0};
+    return writeBytes(zeros, alignOffset(offset_) - offset_);
+  }
+
+  void execute()
+  {
+    this_thread::set_name("ArchiveWriter");
+    bool ok = true;
+
+    for(;;)
+    {
+      Item item;
+      {
+        libfreenect2::unique_lock l(mutex_);
+        while(queue_.empty() && !shutdown_)
+          WAIT_CONDITION(cond_, mutex_, l);
+        if(queue_.empty())
+          break;
+        item = queue_.front();
+        queue_.pop_front();
+      }
+
+      if (ok)
+      {
+        item.entry.offset = offset_ + sizeof(item.entry);
+        ok = writeBytes(&item.entry, sizeof(item.entry)) && writeBytes(item.data, item.entry.size) && pad();
+        if (ok)
+          index_.push_back(item.entry);
+      }
+      delete[] item.data;
+
+      libfreenect2::lock_guard l(mutex_);
+      queued_bytes_ -= item.entry.size;
+      failed_ = failed_ || !ok;
+    }
+  }
+};
+
+FrameArchiveWriter::FrameArchiveWriter(size_t max_queued_bytes) :
+  impl_(new FrameArchiveWriterImpl(max_queued_bytes))
+{
+}
+
+FrameArchiveWriter::~FrameArchiveWriter()
+{
+  close();
+  delete impl_;
+}
+
+bool FrameArchiveWriter::open(const std::string &path)
+{
+  close();
+
+  impl_->file_ = fopen(path.c_str(), "wb");
+  if (impl_->file_ == NULL)
+  {
+    LOG_ERROR << "failed to open archive " << path << ": " << strerror(errno);
+    return false;
+  }
+
+  FrameArchiveHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "LF2FRAME", sizeof(header.magic));
+  header.version = FRAME_ARCHIVE_VERSION;
+
+  impl_->offset_ = 0;
+  impl_->index_.clear();
+  if (!impl_->writeBytes(&header, sizeof(header)) || !impl_->pad())
+  {
+    fclose(impl_->file_);
+    impl_->file_ = NULL;
+    return false;
+  }
+
+  impl_->shutdown_ = false;
+  impl_->failed_ = false;
+  impl_->dropped_ = 0;
+  impl_->thread_ = new libfreenect2::thread(&FrameArchiveWriterImpl::static_execute, impl_);
+  return true;
+}
+
+bool FrameArchiveWriter::write(unsigned int type, const Frame *frame)
+{
+  const size_t size = frame->dataSize();
+
+  FrameArchiveWriterImpl::Item item;
+  memset(&item.entry, 0, sizeof(item.entry));
+  item.entry.magic = FRAME_ARCHIVE_ENTRY_MAGIC;
+  item.entry.type = type;
+  item.entry.size = size;
+  item.entry.width = frame->width;
+  item.entry.height = frame->height;
+  item.entry.bytes_per_pixel = frame->bytes_per_pixel;
+  item.entry.format = frame->format;
+  item.entry.timestamp = frame->timestamp;
+  item.entry.sequence = frame->sequence;
+  item.entry.status = frame->status;
+  item.entry.exposure = frame->exposure;
+  item.entry.gain = frame->gain;
+  item.entry.gamma = frame->gamma;
+
+  {
+    libfreenect2::lock_guard l(impl_->mutex_);
+    if (impl_->thread_ == NULL)
+      return false;
+    if (impl_->queued_bytes_ + size > impl_->max_queued_bytes_)
+    {
+      if (impl_->dropped_++ == 0)
+        LOG_WARNING << "archive cannot keep up, dropping frames";
+      return false;
+    }
+    impl_->queued_bytes_ += size;
+  }
+
+  // Copy outside the lock; the space is already reserved.
+  item.data = new unsigned char[size];
+  memcpy(item.data, frame->data, size);
+
+  {
+    libfreenect2::lock_guard l(impl_->mutex_);
+    impl_->queue_.push_back(item);
+  }
+  impl_->cond_.notify_one();
+  return true;
+}
+
+bool FrameArchiveWriter::close()
+{
+  if (impl_->thread_ == NULL)
+    return true;
+
+  {
+    libfreenect2::lock_guard l(impl_->mutex_);
+    impl_->shutdown_ = true;
+  }
+  impl_->cond_.notify_one();
+  impl_->thread_->join();
+  delete impl_->thread_;
+  impl_->thread_ = NULL;
+
+  bool ok = !impl_->failed_;
+  if (ok)
+  {
+    FrameArchiveFooter footer;
+    footer.index_offset = impl_->offset_;
+    footer.count = impl_->index_.size();
+    memcpy(footer.magic, "LF2INDEX", sizeof(footer.magic));
+    ok = (impl_->index_.empty() || impl_->writeBytes(&impl_->index_[0], impl_->index_.size() * sizeof(FrameArchiveEntry)))
+      && impl_->writeBytes(&footer, sizeof(footer));
+  }
+  ok = fclose(impl_->file_) == 0 && ok;
+  impl_->file_ = NULL;
+  impl_->index_.clear();
+
+  if (impl_->dropped_ > 0)
+    LOG_WARNING << impl_->dropped_ << " frames were dropped from the archive";
+  return ok;
+}
+
+size_t FrameArchiveWriter::getDroppedFrames() const
+{
+  libfreenect2::lock_guard l(impl_->mutex_);
+  return impl_->dropped_;
+}
+
+class FrameArchiveReaderImpl
+{
+public:
+  MappedFile file_;
+  std::vector<FrameArchiveEntry> entries_;
+  std::vector<size_t> next_;
+  std::map<unsigned int, std::vector<size_t> > by_type_;
+
+  bool valid(const FrameArchiveEntry &e, uint64_t end) const
+  {
+    return e.magic == FRAME_ARCHIVE_ENTRY_MAGIC && e.offset <= end && e.size <= end - e.offset
+      && Frame::dataSize(e.width, e.height, e.bytes_per_pixel, static_cast<Frame::Format>(e.format)) == e.size;
+  }
+
+  bool readIndex()
+  {
+    const unsigned char *data = file_.data();
+    const uint64_t size = file_.size();
+    FrameArchiveFooter footer;
+    if (size < sizeof(FrameArchiveHeader) + sizeof(footer))
+      return false;
+    memcpy(&footer, data + size - sizeof(footer), sizeof(footer));
+    if (memcmp(footer.magic, "LF2INDEX", sizeof(footer.magic)) != 0 || footer.index_offset > size - sizeof(footer)
+        || footer.count != (size - sizeof(footer) - footer.index_offset) / sizeof(FrameArchiveEntry))
+      return false;
+
+    entries_.resize(footer.count);
+    if (footer.count > 0)
+      memcpy(&entries_[0], data + footer.index_offset, footer.count * sizeof(FrameArchiveEntry));
+    for (size_t i = 0; i < entries_.size(); ++i)
+    {
+      if (!valid(entries_[i], footer.index_offset))
+      {
+        entries_.clear();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void scan()
+  {
+    const unsigned char *data = file_.data();
+    const uint64_t size = file_.size();
+    uint64_t offset = alignOffset(sizeof(FrameArchiveHeader));
+    FrameArchiveEntry e;
+    while (offset + sizeof(e) <= size)
+    {
+      memcpy(&e, data + offset, sizeof(e));
+      if (!valid(e, size) || e.offset != offset + sizeof(e))
+        break;
+      entries_.push_back(e);
+      offset = alignOffset(e.offset + e.size);
+    }
+  }
+
+  void buildLookup()
+  {
+    next_.assign(entries_.size(), entries_.size());
+    for (size_t i = 0; i < entries_.size(); ++i)
+    {
+      std::vector<size_t> &list = by_type_[entries_[i].type];
+      if (!list.empty())
+        next_[list.back()] = i;
+      list.push_back(i);
+    }
+  }
+};
+
+FrameArchiveReader::FrameArchiveReader() :
+  impl_(new FrameArchiveReaderImpl)
+{
+}
+
+FrameArchiveReader::~FrameArchiveReader()
+{
+  close();
+  delete impl_;
+}
+
+bool FrameArchiveReader::open(const std::string &path)
+{
+  close();
+  if (!impl_->file_.open(path))
+    return false;
+
+  FrameArchiveHeader header;
+  if (impl_->file_.size() < sizeof(header))
+  {
+    LOG_ERROR << path << " is not a frame archive";
+    close();
+    return false;
+  }
+  memcpy(&header, impl_->file_.data(), sizeof(header));
+  if (memcmp(header.magic, "LF2FRAME", sizeof(header.magic)) != 0 || header.version != FRAME_ARCHIVE_VERSION)
+  {
+    LOG_ERROR << path << " is not a frame archive of version " << FRAME_ARCHIVE_VERSION;
+    close();
+    return false;
+  }
+
+  if (!impl_->readIndex())
+  {
+    impl_->scan();
+    LOG_WARNING << path << " has no index, recovered " << impl_->entries_.size() << " frames";
+  }
+  impl_->buildLookup();
+  return true;
+}
+
+void FrameArchiveReader::close()
+{
+  impl_->file_.close();
+  impl_->entries_.clear();
+  impl_->next_.clear();
+  impl_->by_type_.clear();
+}
+
+size_t FrameArchiveReader::size() const
+{
+  return impl_->entries_.size();
+}
+
+unsigned int FrameArchiveReader::getType(size_t i) const
+{
+  return i < size() ? impl_->entries_[i].type : 0;
+}
+
+uint32_t FrameArchiveReader::getTimestamp(size_t i) const
+{
+  return i < size() ? impl_->entries_[i].timestamp : 0;
+}
+
+uint32_t FrameArchiveReader::getSequence(size_t i) const
+{
+  return i < size() ? impl_->entries_[i].sequence : 0;
+}
+
+Frame *FrameArchiveReader::getFrame(size_t i) const
+{
+  if (i >= size())
+    return NULL;
+
+  const FrameArchiveEntry &e = impl_->entries_[i];
+  Frame *frame = new Frame(e.width, e.height, e.bytes_per_pixel, impl_->file_.data() + e.offset);
+  frame->format = static_cast<Frame::Format>(e.format);
+  frame->timestamp = e.timestamp;
+  frame->sequence = e.sequence;
+  frame->status = e.status;
+  frame->exposure = e.exposure;
+  frame->gain = e.gain;
+  frame->gamma = e.gamma;
+  return frame;
+}
+
+struct TimestampLess
+{
+  const std::vector<FrameArchiveEntry> &entries;
+  TimestampLess(const std::vector<FrameArchiveEntry> &entries): entries(entries) {}
+  bool operator()(size_t i, uint32_t timestamp) const { return entries[i].timestamp < timestamp; }
+};
+
+size_t FrameArchiveReader::find(unsigned int type, uint32_t timestamp) const
+{
+  std::map<unsigned int, std::vector<size_t> >::const_iterator it = impl_->by_type_.find(type);
+  if (it == impl_->by_type_.end())
+    return size();
+
+  const std::vector<size_t> &list = it->second;
+  std::vector<size_t>::const_iterator found = std::lower_bound(list.begin(), list.end(), timestamp, TimestampLess(impl_->entries_));
+  return found != list.end() ? *found : size();
+}
+
+size_t FrameArchiveReader::next(size_t i) const
+{
+  return i < size() ? impl_->next_[i] : size();
+}
+
+} /* namespace libfreenect2 */
@@ -28,6 +28,17 @@
 
 #include <libfreenect2/frame_listener_impl.h>
 #include <libfreenect2/threading.h>
+#include <libfreenect2/trace_events.h>
+
+#include <deque>
+#ifdef LIBFREENECT2_THREADING_STDLIB
+#include <functional>
+#endif
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
 
 namespace libfreenect2
 {
@@ -59,6 +70,24 @@ Frame::~Frame()
   delete[] rawdata;
 }
 
+bool Frame::decode()
+{
+  return true;
+}
+
+size_t Frame::dataSize() const
+{
+  return dataSize(width, height, bytes_per_pixel, format);
+}
+
+size_t Frame::dataSize(size_t width, size_t height, size_t bytes_per_pixel, Format format)
+{
+  const size_t size = width * height * bytes_per_pixel;
+  if (format == I420 || format == NV12)
+    return size + ((width + 1) / 2) * ((height + 1) / 2) * 2;
+  return size;
+}
+
 FrameListener::~FrameListener() {}
 
 /** Implementation class for synchronizing different types of frames. */
@@ -104,25 +133,40 @@ bool SyncMultiFrameListener::hasNewFrame() const
   return impl_->hasNewFrame();
 }
 
+static void traceFrames(const char *name, const FrameMap &frames)
+{
+  for(FrameMap::const_iterator it = frames.begin(); it != frames.end(); ++it)
+    traceInstant(name, it->second->sequence);
+}
+
+/** Decode frames delivered with Freenect2Device::Config::DeferColorDecode.
+ * Called without holding the listener lock, so producers are not blocked.
+ */
+static void decodeFrames(FrameMap &frames)
+{
+  for(FrameMap::iterator it = frames.begin(); it != frames.end(); ++it)
+    it->second->decode();
+}
+
 bool SyncMultiFrameListener::waitForNewFrame(FrameMap &frame, int milliseconds)
 {
 #ifdef LIBFREENECT2_THREADING_STDLIB
-  libfreenect2::unique_lock l(impl_->mutex_);
+  {
+    libfreenect2::unique_lock l(impl_->mutex_);
 
-  auto predicate = std::bind(&SyncMultiFrameListenerImpl::hasNewFrame, impl_);
+    auto predicate = std::bind(&SyncMultiFrameListenerImpl::hasNewFrame, impl_);
+
+    if(!impl_->condition_.wait_for(l, std::chrono::milliseconds(milliseconds), predicate))
+      return false;
 
-  if(impl_->condition_.wait_for(l, std::chrono::milliseconds(milliseconds), predicate))
-  {
     frame = impl_->next_frame_;
     impl_->next_frame_.clear();
     impl_->ready_frame_types_ = 0;
-
-    return true;
-  }
-  else
-  {
-    return false;
+    traceFrames("consumer_acquire", frame);
   }
+
+  decodeFrames(frame);
+  return true;
 #else
   waitForNewFrame(frame);
   return true;
@@ -131,21 +175,28 @@ bool SyncMultiFrameListener::waitForNewFrame(FrameMap &frame, int milliseconds)
 
 void SyncMultiFrameListener::waitForNewFrame(FrameMap &frame)
 {
-  libfreenect2::unique_lock l(impl_->mutex_);
-
-  while(!impl_->hasNewFrame())
   {
-    WAIT_CONDITION(impl_->condition_, impl_->mutex_, l)
+    libfreenect2::unique_lock l(impl_->mutex_);
+
+    while(!impl_->hasNewFrame())
+    {
+      WAIT_CONDITION(impl_->condition_, impl_->mutex_, l)
+    }
+
+    frame = impl_->next_frame_;
+    impl_->next_frame_.clear();
+    impl_->ready_frame_types_ = 0;
+    impl_->current_frame_released_ = false;
+    traceFrames("consumer_acquire", frame);
   }
 
-  frame = impl_->next_frame_;
-  impl_->next_frame_.clear();
-  impl_->ready_frame_types_ = 0;
-  impl_->current_frame_released_ = false;
+  decodeFrames(frame);
 }
 
 void SyncMultiFrameListener::release(FrameMap &frame)
 {
+  traceFrames("consumer_release", frame);
+
   for(FrameMap::iterator it = frame.begin(); it != frame.end(); ++it)
   {
     delete it->second;
@@ -191,4 +242,516 @@ bool SyncMultiFrameListener::onNewFrame(Frame::Type type, Frame *frame)
   return true;
 }
 
+/** Implementation class for pairing frames by timestamp. */
+class TimestampSyncFrameListenerImpl
+{
+public:
+  typedef std::deque<Frame *> FrameQueue;
+
+  libfreenect2::mutex mutex_;
+  libfreenect2::condition_variable condition_;
+
+  const unsigned int subscribed_frame_types_;
+  const int32_t tolerance_;
+  const size_t queue_size_;
+
+  FrameQueue color_, ir_, depth_;
+
+  FrameMap next_frame_;
+  bool has_next_frame_;
+  int next_skew_;
+
+  int skew_;
+  size_t dropped_;
+
+  TimestampSyncFrameListenerImpl(unsigned int frame_types, uint32_t tolerance, size_t queue_size) :
+    subscribed_frame_types_(frame_types),
+    tolerance_(tolerance),
+    queue_size_(queue_size > 0 ? queue_size : 1),
+    has_next_frame_(false),
+    next_skew_(0),
+    skew_(0),
+    dropped_(0)
+  {
+  }
+
+  ~TimestampSyncFrameListenerImpl()
+  {
+    clear(color_);
+    clear(ir_);
+    clear(depth_);
+    for(FrameMap::iterator it = next_frame_.begin(); it != next_frame_.end(); ++it)
+      delete it->second;
+  }
+
+  bool hasNewFrame() const
+  {
+    return has_next_frame_;
+  }
+
+  /** Timestamp difference robust to wraparound. */
+  static int32_t diff(uint32_t a, uint32_t b)
+  {
+    return (int32_t)(a - b);
+  }
+
+  FrameQueue &queue(Frame::Type type)
+  {
+    if(type == Frame::Color)
+      return color_;
+    return type == Frame::Ir ? ir_ : depth_;
+  }
+
+  void clear(FrameQueue &q)
+  {
+    for(FrameQueue::iterator it = q.begin(); it != q.end(); ++it)
+      delete *it;
+    q.clear();
+  }
+
+  void dropFront(FrameQueue &q)
+  {
+    delete q.front();
+    q.pop_front();
+    dropped_++;
+  }
+
+  void push(FrameQueue &q, Frame *frame)
+  {
+    if(q.size() >= queue_size_)
+      dropFront(q);
+    q.push_back(frame);
+  }
+
+  bool wantColor() const { return (subscribed_frame_types_ & Frame::Color) != 0; }
+  bool wantIr() const { return (subscribed_frame_types_ & Frame::Ir) != 0; }
+  bool wantDepth() const { return (subscribed_frame_types_ & Frame::Depth) != 0; }
+
+  /** Find the oldest depth packet with all subscribed IR/depth frames present. */
+  bool depthFront(uint32_t &timestamp)
+  {
+    for(;;)
+    {
+      if((wantIr() && ir_.empty()) || (wantDepth() && depth_.empty()))
+        return false;
+
+      if(wantIr() && wantDepth())
+      {
+        // IR and depth of the same packet share the timestamp; drop orphans.
+        int32_t d = diff(ir_.front()->timestamp, depth_.front()->timestamp);
+        if(d < 0)
+        {
+          dropFront(ir_);
+          continue;
+        }
+        if(d > 0)
+        {
+          dropFront(depth_);
+          continue;
+        }
+      }
+
+      timestamp = wantDepth() ? depth_.front()->timestamp : ir_.front()->timestamp;
+      return true;
+    }
+  }
+
+  void takeDepthFront(FrameMap &set)
+  {
+    if(wantIr())
+    {
+      set[Frame::Ir] = ir_.front();
+      ir_.pop_front();
+    }
+    if(wantDepth())
+    {
+      set[Frame::Depth] = depth_.front();
+      depth_.pop_front();
+    }
+  }
+
+  void dropDepthFront()
+  {
+    if(wantIr())
+      dropFront(ir_);
+    if(wantDepth())
+      dropFront(depth_);
+  }
+
+  void publish(const FrameMap &set, int skew)
+  {
+    if(has_next_frame_)
+    {
+      // The previous set was not picked up in time.
+      for(FrameMap::iterator it = next_frame_.begin(); it != next_frame_.end(); ++it)
+        delete it->second;
+      dropped_ += next_frame_.size();
+    }
+    next_frame_ = set;
+    next_skew_ = skew;
+    has_next_frame_ = true;
+  }
+
+  /** Pair buffered frames.
+   * @return true if a new set is available.
+   */
+  bool match()
+  {
+    bool published = false;
+
+    if(!wantIr() && !wantDepth())
+    {
+      while(!color_.empty())
+      {
+        FrameMap set;
+        set[Frame::Color] = color_.front();
+        color_.pop_front();
+        publish(set, 0);
+        published = true;
+      }
+      return published;
+    }
+
+    uint32_t timestamp;
+    while(depthFront(timestamp))
+    {
+      FrameMap set;
+
+      if(!wantColor())
+      {
+        takeDepthFront(set);
+        publish(set, 0);
+        published = true;
+        continue;
+      }
+
+      // The nearest color frame is the last one before or the first one at
+      // or after the depth timestamp. Without the latter a closer color frame
+      // may still arrive.
+      size_t next = 0;
+      while(next < color_.size() && diff(color_[next]->timestamp, timestamp) < 0)
+        next++;
+      if(next == color_.size())
+        break;
+
+      size_t best = next;
+      if(next > 0 && diff(timestamp, color_[next - 1]->timestamp) < diff(color_[next]->timestamp, timestamp))
+        best = next - 1;
+
+      // Older color frames are even further from later depth frames.
+      for(; best > 0; --best)
+        dropFront(color_);
+
+      int32_t skew = diff(color_.front()->timestamp, timestamp);
+      if(skew <= tolerance_ && skew >= -tolerance_)
+      {
+        takeDepthFront(set);
+        set[Frame::Color] = color_.front();
+        color_.pop_front();
+        publish(set, skew);
+        published = true;
+      }
+      else
+      {
+        dropDepthFront();
+      }
+    }
+
+    return published;
+  }
+};
+
+TimestampSyncFrameListener::TimestampSyncFrameListener(unsigned int frame_types, uint32_t tolerance, size_t queue_size) :
+    impl_(new TimestampSyncFrameListenerImpl(frame_types, tolerance, queue_size))
+{
+}
+
+TimestampSyncFrameListener::~TimestampSyncFrameListener()
+{
+  delete impl_;
+}
+
+bool TimestampSyncFrameListener::hasNewFrame() const
+{
+  libfreenect2::lock_guard l(impl_->mutex_);
+
+  return impl_->hasNewFrame();
+}
+
+bool TimestampSyncFrameListener::waitForNewFrame(FrameMap &frame, int milliseconds)
+{
+#ifdef LIBFREENECT2_THREADING_STDLIB
+  {
+    libfreenect2::unique_lock l(impl_->mutex_);
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+    while(!impl_->hasNewFrame())
+    {
+      if(impl_->condition_.wait_until(l, deadline) == std::cv_status::timeout && !impl_->hasNewFrame())
+        return false;
+    }
+
+    frame = impl_->next_frame_;
+    impl_->next_frame_.clear();
+    impl_->has_next_frame_ = false;
+    impl_->skew_ = impl_->next_skew_;
+  }
+
+  decodeFrames(frame);
+  return true;
+#else
+  waitForNewFrame(frame);
+  return true;
+#endif // LIBFREENECT2_THREADING_STDLIB
+}
+
+void TimestampSyncFrameListener::waitForNewFrame(FrameMap &frame)
+{
+  {
+    libfreenect2::unique_lock l(impl_->mutex_);
+
+    while(!impl_->hasNewFrame())
+    {
+      WAIT_CONDITION(impl_->condition_, impl_->mutex_, l)
+    }
+
+    frame = impl_->next_frame_;
+    impl_->next_frame_.clear();
+    impl_->has_next_frame_ = false;
+    impl_->skew_ = impl_->next_skew_;
+  }
+
+  decodeFrames(frame);
+}
+
+void TimestampSyncFrameListener::release(FrameMap &frame)
+{
+  for(FrameMap::iterator it = frame.begin(); it != frame.end(); ++it)
+  {
+    delete it->second;
+    it->second = 0;
+  }
+
+  frame.clear();
+}
+
+int TimestampSyncFrameListener::getSkew() const
+{
+  libfreenect2::lock_guard l(impl_->mutex_);
+  return impl_->skew_;
+}
+
+size_t TimestampSyncFrameListener::getDroppedFrames() const
+{
+  libfreenect2::lock_guard l(impl_->mutex_);
+  return impl_->dropped_;
+}
+
+bool TimestampSyncFrameListener::onNewFrame(Frame::Type type, Frame *frame)
+{
+  if((impl_->subscribed_frame_types_ & type) == 0) return false;
+
+  bool published;
+  {
+    libfreenect2::lock_guard l(impl_->mutex_);
+
+    impl_->push(impl_->queue(type), frame);
+    published = impl_->match();
+  }
+
+  if(published)
+    impl_->condition_.notify_one();
+
+  return true;
+}
+
+FrameSet::FrameSet()
+{
+  frames[0] = frames[1] = frames[2] = NULL;
+}
+
+/** Implementation class for the lock-free frame slots. */
+class TripleBufferFrameListenerImpl
+{
+public:
+  Frame *volatile slots_[3]; ///< Newest frames not yet acquired.
+  const unsigned int subscribed_frame_types_;
+  int event_fd_;
+
+  // Only used while the consumer blocks in waitForNewFrame().
+  libfreenect2::mutex mutex_;
+  libfreenect2::condition_variable condition_;
+  volatile size_t waiting_;
+
+  TripleBufferFrameListenerImpl(unsigned int frame_types, bool use_event_fd) :
+    subscribed_frame_types_(frame_types),
+    event_fd_(-1),
+    waiting_(0)
+  {
+    slots_[0] = slots_[1] = slots_[2] = NULL;
+#if defined(__linux__)
+    if(use_event_fd)
+      event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+  }
+
+  ~TripleBufferFrameListenerImpl()
+  {
+    for(size_t i = 0; i < 3; ++i)
+      delete slots_[i];
+#if defined(__linux__)
+    if(event_fd_ >= 0)
+      close(event_fd_);
+#endif
+  }
+
+  bool subscribed(size_t i) const
+  {
+    static const Frame::Type types[3] = {Frame::Color, Frame::Ir, Frame::Depth};
+    return (subscribed_frame_types_ & types[i]) != 0;
+  }
+
+  /** Only the consumer empties slots, so a complete set stays complete. */
+  bool complete() const
+  {
+    for(size_t i = 0; i < 3; ++i)
+      if(subscribed(i) && atomic_load_pointer(&slots_[i]) == NULL)
+        return false;
+    return true;
+  }
+
+  void signal()
+  {
+#if defined(__linux__)
+    if(event_fd_ >= 0)
+    {
+      uint64_t one = 1;
+      if(write(event_fd_, &one, sizeof(one)) < 0)
+      {
+        // counter saturated; the consumer is already signalled
+      }
+    }
+#endif
+    // The fence before complete() orders this load after the slot store.
+    if(atomic_load_size(&waiting_) != 0)
+    {
+      libfreenect2::lock_guard l(mutex_);
+      condition_.notify_one();
+    }
+  }
+
+  /** Announce a waiting consumer, then check. Needs mutex_. */
+  bool startWaiting()
+  {
+    atomic_store_size(&waiting_, 1);
+    atomic_fence();
+    return complete();
+  }
+
+  void clearSignal()
+  {
+#if defined(__linux__)
+    if(event_fd_ >= 0)
+    {
+      uint64_t count;
+      if(read(event_fd_, &count, sizeof(count)) < 0)
+      {
+        // EAGAIN: not signalled
+      }
+    }
+#endif
+  }
+};
+
+TripleBufferFrameListener::TripleBufferFrameListener(unsigned int frame_types, bool use_event_fd) :
+    impl_(new TripleBufferFrameListenerImpl(frame_types, use_event_fd))
+{
+}
+
+TripleBufferFrameListener::~TripleBufferFrameListener()
+{
+  delete impl_;
+}
+
+bool TripleBufferFrameListener::tryAcquire(FrameSet &frames)
+{
+  // Reset before checking, so a set completed after the check signals again.
+  impl_->clearSignal();
+
+  if(!impl_->complete())
+    return false;
+
+  for(size_t i = 0; i < 3; ++i)
+  {
+    frames.frames[i] = impl_->subscribed(i) ? atomic_exchange_pointer(&impl_->slots_[i], (Frame *)NULL) : NULL;
+    if(frames.frames[i] != NULL)
+      frames.frames[i]->decode();
+  }
+
+  return true;
+}
+
+bool TripleBufferFrameListener::waitForNewFrame(FrameSet &frames, int milliseconds)
+{
+#ifdef LIBFREENECT2_THREADING_STDLIB
+  while(!tryAcquire(frames))
+  {
+    libfreenect2::unique_lock l(impl_->mutex_);
+    auto predicate = std::bind(&TripleBufferFrameListenerImpl::startWaiting, impl_);
+    const bool ready = impl_->condition_.wait_for(l, std::chrono::milliseconds(milliseconds), predicate);
+    atomic_store_size(&impl_->waiting_, 0);
+    if(!ready)
+      return false;
+  }
+  return true;
+#else
+  waitForNewFrame(frames);
+  return true;
+#endif // LIBFREENECT2_THREADING_STDLIB
+}
+
+void TripleBufferFrameListener::waitForNewFrame(FrameSet &frames)
+{
+  while(!tryAcquire(frames))
+  {
+    libfreenect2::unique_lock l(impl_->mutex_);
+    while(!impl_->startWaiting())
+    {
+      WAIT_CONDITION(impl_->condition_, impl_->mutex_, l)
+    }
+    atomic_store_size(&impl_->waiting_, 0);
+  }
+}
+
+void TripleBufferFrameListener::release(FrameSet &frames)
+{
+  for(size_t i = 0; i < 3; ++i)
+  {
+    delete frames.frames[i];
+    frames.frames[i] = NULL;
+  }
+}
+
+int TripleBufferFrameListener::getEventFd() const
+{
+  return impl_->event_fd_;
+}
+
+bool TripleBufferFrameListener::onNewFrame(Frame::Type type, Frame *frame)
+{
+  if((impl_->subscribed_frame_types_ & type) == 0) return false;
+
+  Frame *previous = atomic_exchange_pointer(&impl_->slots_[FrameSet::index(type)], frame);
+  // Not acquired in time; the consumer only wants the newest.
+  delete previous;
+
+  // Without a full fence, two producers finishing together may each store
+  // their slot and still load the other as empty, and neither signals.
+  atomic_fence();
+  if(previous == NULL && impl_->complete())
+    impl_->signal();
+
+  return true;
+}
+
 } /* namespace libfreenect2 */
@@ -33,12 +33,20 @@
 #include <limits>
 #include <cmath>
 #include <cstdlib>
+#include <ctime>
+#include <sstream>
 #define WRITE_LIBUSB_ERROR(__RESULT) libusb_error_name(__RESULT) << " " << libusb_strerror((libusb_error)__RESULT)
 
 #include <libfreenect2/libfreenect2.hpp>
 
 #include <libfreenect2/usb/event_loop.h>
 #include <libfreenect2/usb/transfer_pool.h>
+#include <libfreenect2/thread_policy.h>
+#include <libfreenect2/stream_recorder.h>
+#include <libfreenect2/calibration_cache.h>
+#include <libfreenect2/statistics.h>
+#include <libfreenect2/trace.h>
+#include <libfreenect2/replay_device.h>
 #include <libfreenect2/depth_packet_processor.h>
 #include <libfreenect2/rgb_packet_processor.h>
 #include <libfreenect2/protocol/usb_control.h>
@@ -231,6 +239,17 @@ private:
   std::string serial_, firmware_;
   Freenect2Device::IrCameraParams ir_camera_params_;
   Freenect2Device::ColorCameraParams rgb_camera_params_;
+
+  StreamRecorder recorder_;
+  RecordingDataCallback *rgb_recording_callback_;
+  RecordingDataCallback *ir_recording_callback_;
+
+  std::string calibration_cache_dir_;
+
+  DeviceStatistics statistics_;
+
+  void setIrCameraTables(const Freenect2Device::IrCameraParams &params, const float *xtable, const float *ztable, const short *lut);
+  void loadP0Tables(unsigned char *buffer, size_t length);
 public:
   Freenect2DeviceImpl(Freenect2Impl *context, const PacketPipeline *pipeline, libusb_device *usb_device, libusb_device_handle *usb_device_handle, const std::string &serial);
   virtual ~Freenect2DeviceImpl();
@@ -256,6 +275,7 @@ public:
   virtual bool startStreams(bool rgb, bool depth);
   virtual bool stop();
   virtual bool close();
+  virtual Freenect2Device::Statistics getStatistics();
 };
 
 struct PrintBusAndDevice
@@ -296,12 +316,19 @@ public:
 
   bool initialized;
 
+  ThreadPolicy thread_policies_[3];
+
   Freenect2Impl(void *usb_context) :
     managed_usb_context_(usb_context == 0),
     usb_context_(reinterpret_cast<libusb_context *>(usb_context)),
     has_device_enumeration_(false),
     initialized(false)
   {
+    thread_policies_[Freenect2::UsbThread] = threadPolicyFromEnvironment("LIBFREENECT2_USB_THREAD");
+    thread_policies_[Freenect2::ColorThread] = threadPolicyFromEnvironment("LIBFREENECT2_COLOR_THREAD");
+    thread_policies_[Freenect2::DepthThread] = threadPolicyFromEnvironment("LIBFREENECT2_DEPTH_THREAD");
+    usb_event_loop_.setThreadPolicy(thread_policies_[Freenect2::UsbThread]);
+
 #ifdef __linux__
     if (libusb_get_version()->nano < 10952)
     {
@@ -341,6 +368,13 @@ public:
     }
   }
 
+  void setThreadPolicy(Freenect2::ThreadType type, const ThreadPolicy &policy)
+  {
+    thread_policies_[type] = policy;
+    if(type == Freenect2::UsbThread)
+      usb_event_loop_.setThreadPolicy(policy);
+  }
+
   void addDevice(Freenect2DeviceImpl *device)
   {
     if (!initialized)
@@ -516,6 +550,11 @@ Freenect2Device::~Freenect2Device()
 {
 }
 
+Freenect2Device::Statistics Freenect2Device::getStatistics()
+{
+  return Statistics();
+}
+
 Freenect2DeviceImpl::Freenect2DeviceImpl(Freenect2Impl *context, const PacketPipeline *pipeline, libusb_device *usb_device, libusb_device_handle *usb_device_handle, const std::string &serial) :
   state_(Created),
   has_usb_interfaces_(false),
@@ -529,10 +568,36 @@ Freenect2DeviceImpl::Freenect2DeviceImpl(Freenect2Impl *context, const PacketPip
   command_seq_(0),
   pipeline_(pipeline),
   serial_(serial),
-  firmware_("<unknown>")
+  firmware_("<unknown>"),
+  rgb_recording_callback_(0),
+  ir_recording_callback_(0)
 {
   rgb_transfer_pool_.setCallback(pipeline_->getRgbPacketParser());
   ir_transfer_pool_.setCallback(pipeline_->getIrPacketParser());
+
+  const char *record_dir = std::getenv("LIBFREENECT2_RECORD");
+  if (record_dir && record_dir[0] != '\0')
+  {
+    std::ostringstream path;
+    path << record_dir << "/" << serial_ << "-" << (unsigned long)std::time(0) << ".lf2raw";
+    if (recorder_.open(path.str()))
+    {
+      rgb_recording_callback_ = new RecordingDataCallback(pipeline_->getRgbPacketParser(), &recorder_, StreamRecorder::RgbData);
+      ir_recording_callback_ = new RecordingDataCallback(pipeline_->getIrPacketParser(), &recorder_, StreamRecorder::IrData);
+      rgb_transfer_pool_.setCallback(rgb_recording_callback_);
+      ir_transfer_pool_.setCallback(ir_recording_callback_);
+    }
+  }
+
+  const char *cache_dir = std::getenv("LIBFREENECT2_CALIBRATION_CACHE");
+  if (cache_dir)
+    calibration_cache_dir_ = cache_dir;
+
+  rgb_transfer_pool_.setAllocator(pipeline_->getAllocator());
+  ir_transfer_pool_.setAllocator(pipeline_->getAllocator());
+  pipeline_->getRgbPacketParser()->setDataLossCallback(&rgb_transfer_pool_);
+  pipeline_->getIrPacketParser()->setDataLossCallback(&ir_transfer_pool_);
+  statistics_.attach(pipeline_);
 }
 
 Freenect2DeviceImpl::~Freenect2DeviceImpl()
@@ -540,6 +605,8 @@ Freenect2DeviceImpl::~Freenect2DeviceImpl()
   close();
   context_->removeDevice(this);
 
+  delete rgb_recording_callback_;
+  delete ir_recording_callback_;
   delete pipeline_;
 }
 
@@ -590,45 +657,88 @@ Freenect2Device::IrCameraParams Freenect2DeviceImpl::getIrCameraParams()
 void Freenect2DeviceImpl::setColorCameraParams(const Freenect2Device::ColorCameraParams &params)
 {
   rgb_camera_params_ = params;
+  recorder_.write(StreamRecorder::ColorParams, &params, sizeof(params));
 }
 
 void Freenect2DeviceImpl::setIrCameraParams(const Freenect2Device::IrCameraParams &params)
+{
+  if (pipeline_->getDepthPacketProcessor() != 0 || recorder_.isOpen())
+  {
+    IrCameraTables tables(params);
+    setIrCameraTables(params, &tables.xtable[0], &tables.ztable[0], &tables.lut[0]);
+  }
+  else
+  {
+    setIrCameraTables(params, NULL, NULL, NULL);
+  }
+}
+
+/** Set the IR camera parameters with the tables derived from them, or NULL if nobody needs them. */
+void Freenect2DeviceImpl::setIrCameraTables(const Freenect2Device::IrCameraParams &params, const float *xtable, const float *ztable, const short *lut)
 {
   ir_camera_params_ = params;
+  recorder_.write(StreamRecorder::IrParams, &params, sizeof(params));
+  if (xtable == NULL)
+    return;
+
+  recorder_.write(StreamRecorder::XTable, xtable, DepthPacketProcessor::TABLE_SIZE * sizeof(float));
+  recorder_.write(StreamRecorder::ZTable, ztable, DepthPacketProcessor::TABLE_SIZE * sizeof(float));
+  recorder_.write(StreamRecorder::LookupTable, lut, DepthPacketProcessor::LUT_SIZE * sizeof(short));
   DepthPacketProcessor *proc = pipeline_->getDepthPacketProcessor();
   if (proc != 0)
   {
-    IrCameraTables tables(params);
-    proc->loadXZTables(&tables.xtable[0], &tables.ztable[0]);
-    proc->loadLookupTable(&tables.lut[0]);
+    proc->loadXZTables(xtable, ztable);
+    proc->loadLookupTable(lut);
   }
 }
 
+void Freenect2DeviceImpl::loadP0Tables(unsigned char *buffer, size_t length)
+{
+  recorder_.write(StreamRecorder::P0Tables, buffer, length);
+  if(pipeline_->getDepthPacketProcessor() != 0)
+    pipeline_->getDepthPacketProcessor()->loadP0TablesFromCommandResponse(buffer, length);
+}
+
 Freenect2Device::Config::Config() :
   MinDepth(0.5f),
   MaxDepth(4.5f), //set to > 8000 for best performance when using the kde pipeline
   EnableBilateralFilter(true),
-  EnableEdgeAwareFilter(true) {}
+  EnableEdgeAwareFilter(true),
+  ColorScale(1),
+  ColorFormat(Frame::BGRX),
+  DeferColorDecode(false),
+  ColorRegionX(0),
+  ColorRegionY(0),
+  ColorRegionWidth(0),
+  ColorRegionHeight(0) {}
 
 void Freenect2DeviceImpl::setConfiguration(const Freenect2Device::Config &config)
 {
   DepthPacketProcessor *proc = pipeline_->getDepthPacketProcessor();
   if (proc != 0)
     proc->setConfiguration(config);
+  RgbPacketProcessor *rgb_proc = pipeline_->getRgbPacketProcessor();
+  if (rgb_proc != 0)
+    rgb_proc->setConfiguration(config);
 }
 
 void Freenect2DeviceImpl::setColorFrameListener(libfreenect2::FrameListener* rgb_frame_listener)
 {
   // TODO: should only be possible, if not started
   if(pipeline_->getRgbPacketProcessor() != 0)
-    pipeline_->getRgbPacketProcessor()->setFrameListener(rgb_frame_listener);
+    pipeline_->getRgbPacketProcessor()->setFrameListener(statistics_.colorListener(rgb_frame_listener));
 }
 
 void Freenect2DeviceImpl::setIrAndDepthFrameListener(libfreenect2::FrameListener* ir_frame_listener)
 {
   // TODO: should only be possible, if not started
   if(pipeline_->getDepthPacketProcessor() != 0)
-    pipeline_->getDepthPacketProcessor()->setFrameListener(ir_frame_listener);
+    pipeline_->getDepthPacketProcessor()->setFrameListener(statistics_.depthListener(ir_frame_listener));
+}
+
+Freenect2Device::Statistics Freenect2DeviceImpl::getStatistics()
+{
+  return statistics_.getStatistics();
 }
 
 bool Freenect2DeviceImpl::open()
@@ -661,16 +771,22 @@ bool Freenect2DeviceImpl::open()
   unsigned rgb_num_xfers = 20;
   unsigned ir_pkts_per_xfer = 8;
   unsigned ir_num_xfers = 60;
+  // Upper bounds when adapting to packet loss; equal counts disable adaptation.
+  unsigned rgb_max_xfers = 2 * rgb_num_xfers;
+  unsigned ir_max_xfers = 2 * ir_num_xfers;
 
 #if defined(__APPLE__)
   ir_pkts_per_xfer = 128;
   ir_num_xfers = 4;
+  ir_max_xfers = 8;
 #elif defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
   // For multi-Kinect setup, there is a 64 fd limit on poll().
   rgb_xfer_size = 1048576;
   rgb_num_xfers = 3;
+  rgb_max_xfers = 3;
   ir_pkts_per_xfer = 64;
   ir_num_xfers = 8;
+  ir_max_xfers = 8;
 #endif
 
   const char *xfer_str;
@@ -682,12 +798,16 @@ bool Freenect2DeviceImpl::open()
   if(xfer_str) ir_pkts_per_xfer = std::atoi(xfer_str);
   xfer_str = std::getenv("LIBFREENECT2_IR_TRANSFERS");
   if(xfer_str) ir_num_xfers = std::atoi(xfer_str);
+  xfer_str = std::getenv("LIBFREENECT2_RGB_MAX_TRANSFERS");
+  rgb_max_xfers = xfer_str ? std::atoi(xfer_str) : std::max(rgb_max_xfers, rgb_num_xfers);
+  xfer_str = std::getenv("LIBFREENECT2_IR_MAX_TRANSFERS");
+  ir_max_xfers = xfer_str ? std::atoi(xfer_str) : std::max(ir_max_xfers, ir_num_xfers);
 
   LOG_INFO << "transfer pool sizes"
-           << " rgb: " << rgb_num_xfers << "*" << rgb_xfer_size
-           << " ir: " << ir_num_xfers << "*" << ir_pkts_per_xfer << "*" << max_iso_packet_size;
-  rgb_transfer_pool_.allocate(rgb_num_xfers, rgb_xfer_size);
-  ir_transfer_pool_.allocate(ir_num_xfers, ir_pkts_per_xfer, max_iso_packet_size);
+           << " rgb: " << rgb_num_xfers << "(max " << rgb_max_xfers << ")*" << rgb_xfer_size
+           << " ir: " << ir_num_xfers << "(max " << ir_max_xfers << ")*" << ir_pkts_per_xfer << "*" << max_iso_packet_size;
+  rgb_transfer_pool_.allocate(rgb_num_xfers, rgb_xfer_size, rgb_max_xfers);
+  ir_transfer_pool_.allocate(ir_num_xfers, ir_pkts_per_xfer, max_iso_packet_size, ir_max_xfers);
 
   state_ = Open;
 
@@ -725,15 +845,38 @@ bool Freenect2DeviceImpl::startStreams(bool enable_rgb, bool enable_depth)
     LOG_WARNING << "serial number reported by libusb " << serial_ << " differs from serial number " << new_serial << " in device protocol! ";
   }
 
-  if (!command_tx_.execute(ReadDepthCameraParametersCommand(nextCommandSeq()), result)) return false;
-  setIrCameraParams(DepthCameraParamsResponse(result).toIrCameraParams());
+  recorder_.write(StreamRecorder::SerialNumber, new_serial.data(), new_serial.size());
+  recorder_.write(StreamRecorder::FirmwareVersion, firmware_.data(), firmware_.size());
 
-  if (!command_tx_.execute(ReadP0TablesCommand(nextCommandSeq()), result)) return false;
-  if(pipeline_->getDepthPacketProcessor() != 0)
-    pipeline_->getDepthPacketProcessor()->loadP0TablesFromCommandResponse(&result[0], result.size());
+  // The calibration of a known serial number and firmware comes from the cache,
+  // which saves reading the P0 tables and computing the depth tables.
+  CalibrationCache cache;
+  const std::string cache_path = calibration_cache_dir_.empty() ? std::string() : CalibrationCache::path(calibration_cache_dir_, new_serial);
+  if (!cache_path.empty() && cache.open(cache_path, new_serial, firmware_))
+  {
+    LOG_INFO << "using calibration cache " << cache_path;
+    setIrCameraTables(cache.ir_params, cache.xtable, cache.ztable, cache.lut);
+    loadP0Tables(cache.p0_tables, cache.p0_tables_length);
+    setColorCameraParams(cache.color_params);
+    cache.close();
+  }
+  else
+  {
+    if (!command_tx_.execute(ReadDepthCameraParametersCommand(nextCommandSeq()), result)) return false;
+    const IrCameraTables tables(DepthCameraParamsResponse(result).toIrCameraParams());
+    setIrCameraTables(tables, &tables.xtable[0], &tables.ztable[0], &tables.lut[0]);
 
-  if (!command_tx_.execute(ReadRgbCameraParametersCommand(nextCommandSeq()), result)) return false;
-  setColorCameraParams(RgbCameraParamsResponse(result).toColorCameraParams());
+    CommandTransaction::Result p0_tables;
+    if (!command_tx_.execute(ReadP0TablesCommand(nextCommandSeq()), p0_tables)) return false;
+    loadP0Tables(&p0_tables[0], p0_tables.size());
+
+    if (!command_tx_.execute(ReadRgbCameraParametersCommand(nextCommandSeq()), result)) return false;
+    setColorCameraParams(RgbCameraParamsResponse(result).toColorCameraParams());
+
+    if (!cache_path.empty())
+      CalibrationCache::write(cache_path, new_serial, firmware_, ir_camera_params_, rgb_camera_params_,
+                              &p0_tables[0], p0_tables.size(), &tables.xtable[0], &tables.ztable[0], &tables.lut[0]);
+  }
 
   if (!command_tx_.execute(SetModeEnabledWith0x00640064Command(nextCommandSeq()), result)) return false;
   if (!command_tx_.execute(SetModeDisabledCommand(nextCommandSeq()), result)) return false;
@@ -778,6 +921,8 @@ bool Freenect2DeviceImpl::startStreams(bool enable_rgb, bool enable_depth)
   command_tx_.execute(ReadData0x26Command(nextCommandSeq()), result);
   command_tx_.execute(ReadData0x26Command(nextCommandSeq()), result);
 */
+  statistics_.reset();
+
   if (enable_rgb)
   {
     LOG_INFO << "submitting rgb transfers...";
@@ -890,6 +1035,8 @@ bool Freenect2DeviceImpl::close()
   rgb_transfer_pool_.deallocate();
   ir_transfer_pool_.deallocate();
 
+  recorder_.close();
+
   LOG_INFO << "closing usb device...";
 
   libusb_close(usb_device_handle_);
@@ -946,11 +1093,33 @@ PacketPipeline *createDefaultPacketPipeline()
 Freenect2::Freenect2(void *usb_context) :
     impl_(new Freenect2Impl(usb_context))
 {
+  const char *trace = std::getenv("LIBFREENECT2_TRACE");
+  if (trace && trace[0] != '\0')
+    startTracing();
 }
 
 Freenect2::~Freenect2()
 {
   delete impl_;
+
+  const char *trace = std::getenv("LIBFREENECT2_TRACE");
+  if (trace && trace[0] != '\0' && writeTrace(trace))
+    LOG_INFO << "trace written to " << trace;
+}
+
+void Freenect2::setThreadPolicy(ThreadType type, const ThreadPolicy &policy)
+{
+  impl_->setThreadPolicy(type, policy);
+}
+
+ThreadPolicy Freenect2::getThreadPolicy(ThreadType type) const
+{
+  return threadPolicyReport(type).applied();
+}
+
+std::string Freenect2::getThreadPolicyFailures(ThreadType type) const
+{
+  return threadPolicyReport(type).failures();
 }
 
 int Freenect2::enumerateDevices()
@@ -1069,6 +1238,7 @@ Freenect2Device *Freenect2Impl::openDevice(int idx, const PacketPipeline *pipeli
     }
   }
 
+  pipeline->setThreadPolicy(thread_policies_[Freenect2::ColorThread], thread_policies_[Freenect2::DepthThread]);
   device = new Freenect2DeviceImpl(this, pipeline, dev.dev, dev_handle, dev.serial);
   addDevice(device);
 
@@ -1115,4 +1285,37 @@ Freenect2Device *Freenect2::openDefaultDevice(const PacketPipeline *pipeline)
   return openDevice(0, pipeline);
 }
 
+Freenect2Device *Freenect2::openReplayDevice(const std::string &path)
+{
+  return openReplayDevice(path, createDefaultPacketPipeline());
+}
+
+Freenect2Device *Freenect2::openReplayDevice(const std::string &path, const PacketPipeline *pipeline, ReplayMode mode, float rate)
+{
+  if (mode == ReplayDefault)
+  {
+    mode = ReplayRealtime;
+    const char *env = std::getenv("LIBFREENECT2_REPLAY_MODE");
+    if (env && std::string(env) == "fast")
+    {
+      mode = ReplayFastest;
+    }
+    else if (env && std::atof(env) > 0)
+    {
+      mode = ReplayFixedRate;
+      rate = std::atof(env);
+    }
+  }
+
+  pipeline->setThreadPolicy(impl_->thread_policies_[Freenect2::ColorThread], impl_->thread_policies_[Freenect2::DepthThread]);
+
+  ReplayDevice *device = new ReplayDevice(pipeline, mode, rate);
+  if (!device->open(path))
+  {
+    delete device;
+    return 0;
+  }
+  return device;
+}
+
 } /* namespace libfreenect2 */
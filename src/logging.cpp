@@ -33,10 +33,7 @@
 #include <algorithm>
 
 #ifdef LIBFREENECT2_WITH_PROFILING
-#include <vector>
-#include <numeric>
-#include <functional>
-#include <cmath>
+#include <libfreenect2/statistics.h>
 #endif
 
 #ifdef LIBFREENECT2_WITH_CXX11_SUPPORT
@@ -258,29 +255,15 @@ class WithPerfLoggingImpl: public Timer
 {
 public:
 #ifdef LIBFREENECT2_WITH_PROFILING
-  std::vector<double> stats;
+  LatencyHistogram stats;
   std::string name;
 
-  WithPerfLoggingImpl()
-  {
-    stats.reserve(30*100);
-  }
-
   ~WithPerfLoggingImpl()
   {
-    if (stats.size() < 2)
+    Freenect2Device::LatencyStatistics s = stats.getStatistics();
+    if (s.count < 2)
       return;
-    std::vector<double> &v = stats;
-    std::sort(v.begin(), v.end());
-    double sum = std::accumulate(v.begin(), v.end(), 0.0);
-    size_t n = v.size();
-    double mean = sum / n;
-    std::vector<double> diff(n);
-    std::transform(v.begin(), v.end(), diff.begin(), std::bind2nd(std::minus<double>(), mean));
-    double sqsum = std::inner_product(diff.begin(), diff.end(), diff.begin(), 0.0);
-    double std = std::sqrt(sqsum / (n-1));
-
-    std::cout << name << v[0] << " " << v[n/20] << " " << v[n/2] << " " << v[n - (n+19)/20] << " " << v[n-1] << " mean=" << mean << " std=" << std <<  " n=" << n << std::endl;
+    std::cout << name << "p50=" << s.p50 << " p99=" << s.p99 << " p999=" << s.p999 << " max=" << s.max << " n=" << s.count << std::endl;
   }
 #endif
 
@@ -295,7 +278,7 @@ public:
       std::stringstream &ss = static_cast<std::stringstream &>(stream);
       name = ss.str();
     }
-    stats.push_back(this_duration*1e3);
+    stats.record((uint64_t)(this_duration*1e9));
 #endif
     if (count < 100)
     {
@@ -0,0 +1,134 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file mapped_file.cpp Read access to files through a memory mapping. */
+
+#include <libfreenect2/mapped_file.h>
+#include <libfreenect2/logging.h>
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace libfreenect2
+{
+
+MappedFile::MappedFile() :
+  data_(NULL),
+  size_(0)
+#ifdef _WIN32
+  , file_handle_(INVALID_HANDLE_VALUE),
+  mapping_handle_(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+bool MappedFile::open(const std::string &path)
+{
+  close();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    LOG_ERROR << "failed to open " << path << ": error " << GetLastError();
+    return false;
+  }
+  file_handle_ = file;
+  LARGE_INTEGER size;
+  if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+  {
+    size_ = (size_t)size.QuadPart;
+    mapping_handle_ = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (mapping_handle_ != NULL)
+      data_ = static_cast<unsigned char *>(MapViewOfFile(mapping_handle_, FILE_MAP_COPY, 0, 0, 0));
+  }
+  if (data_ == NULL)
+  {
+    LOG_ERROR << "failed to map " << path << ": error " << GetLastError();
+    close();
+    return false;
+  }
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    LOG_ERROR << "failed to open " << path << ": " << strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    void *p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED)
+    {
+      data_ = static_cast<unsigned char *>(p);
+      size_ = st.st_size;
+    }
+  }
+  if (data_ == NULL)
+    LOG_ERROR << "failed to map " << path << ": " << strerror(errno);
+  ::close(fd);
+  if (data_ == NULL)
+    return false;
+#endif
+
+  return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+  if (data_ != NULL)
+    UnmapViewOfFile(data_);
+  if (mapping_handle_ != NULL)
+    CloseHandle(mapping_handle_);
+  if (file_handle_ != INVALID_HANDLE_VALUE)
+    CloseHandle(file_handle_);
+  mapping_handle_ = NULL;
+  file_handle_ = INVALID_HANDLE_VALUE;
+#else
+  if (data_ != NULL)
+    munmap(data_, size_);
+#endif
+  data_ = NULL;
+  size_ = 0;
+}
+
+} /* namespace libfreenect2 */
@@ -244,9 +244,9 @@ public:
 
     deviceInitialized = initDevice(deviceId);
 
-    input_buffer_allocator = new PoolAllocator(new OpenCLAllocator(context, queue, true));
-    ir_buffer_allocator = new PoolAllocator(new OpenCLAllocator(context, queue, false));
-    depth_buffer_allocator = new PoolAllocator(new OpenCLAllocator(context, queue, false));
+    input_buffer_allocator = new PoolAllocator(new TrackingAllocator(new OpenCLAllocator(context, queue, true), MemoryPacketBuffers));
+    ir_buffer_allocator = new PoolAllocator(new TrackingAllocator(new OpenCLAllocator(context, queue, false), MemoryFrames));
+    depth_buffer_allocator = new PoolAllocator(new TrackingAllocator(new OpenCLAllocator(context, queue, false), MemoryFrames));
 
     newIrFrame();
     newDepthFrame();
@@ -252,9 +252,9 @@ public:
 
     deviceInitialized = initDevice(deviceId);
 
-    input_buffer_allocator = new PoolAllocator(new OpenCLKdeAllocator(context, queue, true));
-    ir_buffer_allocator = new PoolAllocator(new OpenCLKdeAllocator(context, queue, false));
-    depth_buffer_allocator = new PoolAllocator(new OpenCLKdeAllocator(context, queue, false));
+    input_buffer_allocator = new PoolAllocator(new TrackingAllocator(new OpenCLKdeAllocator(context, queue, true), MemoryPacketBuffers));
+    ir_buffer_allocator = new PoolAllocator(new TrackingAllocator(new OpenCLKdeAllocator(context, queue, false), MemoryFrames));
+    depth_buffer_allocator = new PoolAllocator(new TrackingAllocator(new OpenCLKdeAllocator(context, queue, false), MemoryFrames));
 
     newIrFrame();
     newDepthFrame();
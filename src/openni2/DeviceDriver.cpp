@@ -399,6 +399,21 @@ namespace Freenect2Driver
       return id;
     }
 
+    // Recordings of LIBFREENECT2_RECORD open as freenect2-replay://<path>, or by their path.
+    bool uri_to_replay_path(const std::string uri, std::string& path) {
+      const std::string scheme = uriScheme + "-replay://";
+      const std::string extension = ".lf2raw";
+      if (uri.compare(0, scheme.length(), scheme) == 0) {
+        path = uri.substr(scheme.length());
+        return true;
+      }
+      if (uri.length() > extension.length() && uri.compare(uri.length() - extension.length(), extension.length(), extension) == 0) {
+        path = uri;
+        return true;
+      }
+      return false;
+    }
+
     void register_uri(std::string uri) {
       OniDeviceInfo info;
       strncpy(info.uri, uri.c_str(), ONI_MAX_STR);
@@ -490,6 +505,12 @@ namespace Freenect2Driver
         WriteMessage("    " + it->first + " = " + it->second);
       }
 
+      // recordings are not enumerated, so they are registered when first opened
+      std::string replay_path;
+      const bool replay = uri_to_replay_path(uri, replay_path);
+      if (replay)
+        register_uri(uri);
+
       for (OniDeviceMap::iterator iter = devices.begin(); iter != devices.end(); iter++)
       {
         std::string iter_uri(iter->first.uri);
@@ -502,11 +523,17 @@ namespace Freenect2Driver
           else 
           {
             WriteMessage("Opening device " + std::string(uri));
-            int id = uri_to_devid(iter->first.uri);
-            DeviceImpl* device = new DeviceImpl(id);
+            int id = replay ? -1 : uri_to_devid(iter->first.uri);
             // The LIBFREENECT2_PIPELINE variable allows to select
-            // the non-default pipeline
-            device->setFreenect2Device(freenect2.openDevice(id));
+            // the non-default pipeline, LIBFREENECT2_REPLAY_MODE the pacing of recordings
+            libfreenect2::Freenect2Device* dev = replay ? freenect2.openReplayDevice(replay_path) : freenect2.openDevice(id);
+            if (!dev)
+            {
+              LogError("Could not open device " + std::string(uri));
+              return NULL;
+            }
+            DeviceImpl* device = new DeviceImpl(id);
+            device->setFreenect2Device(dev);
             device->setConfigStrings(config);
             iter->second = device;
             return device;
@@ -32,10 +32,29 @@
 #include <libfreenect2/rgb_packet_stream_parser.h>
 #include <libfreenect2/depth_packet_stream_parser.h>
 #include <libfreenect2/protocol/response.h>
+#include <libfreenect2/allocator.h>
+#include <libfreenect2/thread_policy.h>
+#include <cstdlib>
 
 namespace libfreenect2
 {
 
+#ifdef LIBFREENECT2_WITH_TURBOJPEG_SUPPORT
+/* LIBFREENECT2_COLOR_DECODERS > 1 decodes consecutive packets in parallel. */
+static RgbPacketProcessor *newTurboJpegRgbPacketProcessor()
+{
+  const char *env = std::getenv("LIBFREENECT2_COLOR_DECODERS");
+  const int decoders = env ? std::atoi(env) : 1;
+  if (decoders <= 1)
+    return new TurboJpegRgbPacketProcessor();
+
+  std::vector<RgbPacketProcessor *> processors;
+  for (int i = 0; i < decoders; ++i)
+    processors.push_back(new TurboJpegRgbPacketProcessor());
+  return new ParallelRgbPacketProcessor(processors);
+}
+#endif
+
 static RgbPacketProcessor *getDefaultRgbPacketProcessor()
 {
 #if defined(LIBFREENECT2_WITH_VT_SUPPORT)
@@ -46,16 +65,16 @@ static RgbPacketProcessor *getDefaultRgbPacketProcessor()
     return vaapi;
   else
     delete vaapi;
-  return new TurboJpegRgbPacketProcessor();
+  return newTurboJpegRgbPacketProcessor();
 #elif defined(LIBFREENECT2_WITH_TEGRAJPEG_SUPPORT)
   RgbPacketProcessor *tegra = new TegraJpegRgbPacketProcessor();
   if (tegra->good())
     return tegra;
   else
     delete tegra;
-  return new TurboJpegRgbPacketProcessor();
+  return newTurboJpegRgbPacketProcessor();
 #elif defined(LIBFREENECT2_WITH_TURBOJPEG_SUPPORT)
-  return new TurboJpegRgbPacketProcessor();
+  return newTurboJpegRgbPacketProcessor();
 #else
   #error No jpeg decoder is enabled
 #endif
@@ -72,19 +91,40 @@ public:
   DepthPacketProcessor *depth_processor_;
   BaseDepthPacketProcessor *async_depth_processor_;
 
+  Allocator *allocator_;
+
+  PacketPipelineComponents();
   ~PacketPipelineComponents();
-  void initialize(RgbPacketProcessor *rgb, DepthPacketProcessor *depth);
+  void initialize(RgbPacketProcessor *rgb, DepthPacketProcessor *depth, unsigned int memory = PacketPipeline::MemoryDefault);
 };
 
-void PacketPipelineComponents::initialize(RgbPacketProcessor *rgb, DepthPacketProcessor *depth)
+PacketPipelineComponents::PacketPipelineComponents():
+  rgb_parser_(NULL), depth_parser_(NULL),
+  rgb_processor_(NULL), async_rgb_processor_(NULL),
+  depth_processor_(NULL), async_depth_processor_(NULL),
+  allocator_(NULL)
 {
+}
+
+void PacketPipelineComponents::initialize(RgbPacketProcessor *rgb, DepthPacketProcessor *depth, unsigned int memory)
+{
+  memory = resolveMemoryFlags(memory);
+  allocator_ = new TrackingAllocator(createAllocator(memory), MemoryUsbTransfers);
+
   rgb_parser_ = new RgbPacketStreamParser();
   depth_parser_ = new DepthPacketStreamParser();
 
   rgb_processor_ = rgb;
   depth_processor_ = depth;
 
-  async_rgb_processor_ = new AsyncPacketProcessor<RgbPacket>(rgb_processor_);
+  // Before the parsers allocate their first packet buffers.
+  rgb_processor_->setMemoryFlags(memory);
+  depth_processor_->setMemoryFlags(memory);
+
+  if (rgb_processor_->asynchronous())
+    async_rgb_processor_ = rgb_processor_;
+  else
+    async_rgb_processor_ = new AsyncPacketProcessor<RgbPacket>(rgb_processor_);
   async_depth_processor_ = new AsyncPacketProcessor<DepthPacket>(depth_processor_);
 
   rgb_parser_->setPacketProcessor(async_rgb_processor_);
@@ -93,12 +133,14 @@ void PacketPipelineComponents::initialize(RgbPacketProcessor *rgb, DepthPacketPr
 
 PacketPipelineComponents::~PacketPipelineComponents()
 {
-  delete async_rgb_processor_;
+  if (async_rgb_processor_ != rgb_processor_)
+    delete async_rgb_processor_;
   delete async_depth_processor_;
   delete rgb_processor_;
   delete depth_processor_;
   delete rgb_parser_;
   delete depth_parser_;
+  delete allocator_;
 }
 
 PacketPipeline::PacketPipeline(): comp_(new PacketPipelineComponents()) {}
@@ -128,17 +170,38 @@ DepthPacketProcessor *PacketPipeline::getDepthPacketProcessor() const
   return comp_->depth_processor_;
 }
 
-CpuPacketPipeline::CpuPacketPipeline()
+Allocator *PacketPipeline::getAllocator() const
+{
+  return comp_->allocator_;
+}
+
+void PacketPipeline::setThreadPolicy(const ThreadPolicy &color, const ThreadPolicy &depth) const
+{
+  if(comp_->async_rgb_processor_ != NULL)
+    comp_->async_rgb_processor_->setThreadPolicy(color, &threadPolicyReport(Freenect2::ColorThread));
+  if(comp_->async_depth_processor_ != NULL)
+    comp_->async_depth_processor_->setThreadPolicy(depth, &threadPolicyReport(Freenect2::DepthThread));
+}
+
+void PacketPipeline::setLatencyHistograms(LatencyHistogram *color, LatencyHistogram *depth) const
+{
+  if(comp_->async_rgb_processor_ != NULL)
+    comp_->async_rgb_processor_->setLatencyHistogram(color);
+  if(comp_->async_depth_processor_ != NULL)
+    comp_->async_depth_processor_->setLatencyHistogram(depth);
+}
+
+CpuPacketPipeline::CpuPacketPipeline(unsigned int memory)
 {
-  comp_->initialize(getDefaultRgbPacketProcessor(), new CpuDepthPacketProcessor());
+  comp_->initialize(getDefaultRgbPacketProcessor(), new CpuDepthPacketProcessor(), memory);
 }
 
 CpuPacketPipeline::~CpuPacketPipeline() { }
 
 #ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
-OpenGLPacketPipeline::OpenGLPacketPipeline(void *parent_opengl_context, bool debug) : parent_opengl_context_(parent_opengl_context), debug_(debug)
+OpenGLPacketPipeline::OpenGLPacketPipeline(void *parent_opengl_context, bool debug, unsigned int memory) : parent_opengl_context_(parent_opengl_context), debug_(debug)
 {
-  comp_->initialize(getDefaultRgbPacketProcessor(), new OpenGLDepthPacketProcessor(parent_opengl_context_, debug_));
+  comp_->initialize(getDefaultRgbPacketProcessor(), new OpenGLDepthPacketProcessor(parent_opengl_context_, debug_), memory);
 }
 
 OpenGLPacketPipeline::~OpenGLPacketPipeline() { }
@@ -146,33 +209,33 @@ OpenGLPacketPipeline::~OpenGLPacketPipeline() { }
 
 
 #ifdef LIBFREENECT2_WITH_OPENCL_SUPPORT
-OpenCLPacketPipeline::OpenCLPacketPipeline(const int deviceId) : deviceId(deviceId)
+OpenCLPacketPipeline::OpenCLPacketPipeline(const int deviceId, unsigned int memory) : deviceId(deviceId)
 {
-  comp_->initialize(getDefaultRgbPacketProcessor(), new OpenCLDepthPacketProcessor(deviceId));
+  comp_->initialize(getDefaultRgbPacketProcessor(), new OpenCLDepthPacketProcessor(deviceId), memory);
 }
 
 OpenCLPacketPipeline::~OpenCLPacketPipeline() { }
 
 
-OpenCLKdePacketPipeline::OpenCLKdePacketPipeline(const int deviceId) : deviceId(deviceId)
+OpenCLKdePacketPipeline::OpenCLKdePacketPipeline(const int deviceId, unsigned int memory) : deviceId(deviceId)
 {
-  comp_->initialize(getDefaultRgbPacketProcessor(), new OpenCLKdeDepthPacketProcessor(deviceId));
+  comp_->initialize(getDefaultRgbPacketProcessor(), new OpenCLKdeDepthPacketProcessor(deviceId), memory);
 }
 
 OpenCLKdePacketPipeline::~OpenCLKdePacketPipeline() { }
 #endif // LIBFREENECT2_WITH_OPENCL_SUPPORT
 
 #ifdef LIBFREENECT2_WITH_CUDA_SUPPORT
-CudaPacketPipeline::CudaPacketPipeline(const int deviceId) : deviceId(deviceId)
+CudaPacketPipeline::CudaPacketPipeline(const int deviceId, unsigned int memory) : deviceId(deviceId)
 {
-  comp_->initialize(getDefaultRgbPacketProcessor(), new CudaDepthPacketProcessor(deviceId));
+  comp_->initialize(getDefaultRgbPacketProcessor(), new CudaDepthPacketProcessor(deviceId), memory);
 }
 
 CudaKdePacketPipeline::~CudaKdePacketPipeline() { }
 
-CudaKdePacketPipeline::CudaKdePacketPipeline(const int deviceId) : deviceId(deviceId)
+CudaKdePacketPipeline::CudaKdePacketPipeline(const int deviceId, unsigned int memory) : deviceId(deviceId)
 {
-  comp_->initialize(getDefaultRgbPacketProcessor(), new CudaKdeDepthPacketProcessor(deviceId));
+  comp_->initialize(getDefaultRgbPacketProcessor(), new CudaKdeDepthPacketProcessor(deviceId), memory);
 }
 
 CudaPacketPipeline::~CudaPacketPipeline() { }
@@ -0,0 +1,265 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file parallel_rgb_packet_processor.cpp Color processor running several decoders in parallel. */
+
+#include <libfreenect2/rgb_packet_processor.h>
+#include <libfreenect2/async_packet_processor.h>
+#include <libfreenect2/threading.h>
+#include <libfreenect2/logging.h>
+
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace libfreenect2
+{
+
+class ParallelRgbWorker;
+
+class ParallelRgbPacketProcessorImpl
+{
+public:
+  ParallelRgbPacketProcessor *processor;
+  std::vector<ParallelRgbWorker *> workers;
+  std::vector<AsyncPacketProcessor<RgbPacket> *> threads; ///< One per worker.
+  std::string name;
+
+  libfreenect2::mutex busy_mutex;
+  std::vector<bool> busy; ///< Whether a worker has a packet, by index.
+
+  libfreenect2::mutex order_mutex;
+  uint64_t next_ticket;   ///< Ticket of the next packet to decode.
+  uint64_t next_delivery; ///< Ticket of the next frame to deliver.
+  std::map<uint64_t, Frame *> done; ///< Frames waiting for earlier tickets, NULL if decoding failed.
+  FrameListener *listener;
+
+  Allocator *allocator;
+
+  ParallelRgbPacketProcessorImpl(ParallelRgbPacketProcessor *processor):
+    processor(processor),
+    next_ticket(0),
+    next_delivery(0),
+    listener(NULL),
+    allocator(NULL)
+  {
+  }
+
+  /** Take the result of a packet, and deliver frames that are due. */
+  void complete(size_t index, uint64_t ticket, Frame *frame)
+  {
+    {
+      libfreenect2::lock_guard l(order_mutex);
+      done[ticket] = frame;
+      while (!done.empty() && done.begin()->first == next_delivery)
+      {
+        Frame *f = done.begin()->second;
+        done.erase(done.begin());
+        ++next_delivery;
+
+        if (f != NULL && (listener == NULL || !listener->onNewFrame(Frame::Color, f)))
+          delete f;
+      }
+    }
+
+    libfreenect2::lock_guard l(busy_mutex);
+    busy[index] = false;
+  }
+};
+
+/** Runs one decoder and passes its frames on to be reordered. */
+class ParallelRgbWorker: public BaseRgbPacketProcessor, public FrameListener
+{
+public:
+  ParallelRgbPacketProcessorImpl *owner;
+  size_t index;
+  RgbPacketProcessor *decoder;
+  uint64_t ticket; ///< Position of the current packet in the stream.
+  Frame *frame;    ///< Frame decoded from the current packet.
+
+  ParallelRgbWorker(ParallelRgbPacketProcessorImpl *owner, size_t index, RgbPacketProcessor *decoder):
+    owner(owner),
+    index(index),
+    decoder(decoder),
+    ticket(0),
+    frame(NULL)
+  {
+    decoder->setFrameListener(this);
+  }
+
+  virtual ~ParallelRgbWorker()
+  {
+    delete decoder;
+  }
+
+  virtual const char *name() { return decoder->name(); }
+
+  virtual void process(const RgbPacket &packet)
+  {
+    frame = NULL;
+    if (decoder->good())
+      decoder->process(packet);
+    owner->complete(index, ticket, frame);
+    frame = NULL;
+  }
+
+  virtual void releaseBuffer(RgbPacket &p)
+  {
+    owner->processor->releaseBuffer(p);
+  }
+
+  virtual bool onNewFrame(Frame::Type type, Frame *new_frame)
+  {
+    frame = new_frame;
+    return true;
+  }
+};
+
+ParallelRgbPacketProcessor::ParallelRgbPacketProcessor(const std::vector<RgbPacketProcessor *> &decoders) :
+    impl_(new ParallelRgbPacketProcessorImpl(this))
+{
+  for (size_t i = 0; i < decoders.size(); ++i)
+  {
+    impl_->workers.push_back(new ParallelRgbWorker(impl_, i, decoders[i]));
+    impl_->threads.push_back(new AsyncPacketProcessor<RgbPacket>(impl_->workers.back()));
+  }
+  impl_->busy.resize(decoders.size(), false);
+
+  std::ostringstream name;
+  name << (decoders.empty() ? "none" : decoders[0]->name()) << " x" << decoders.size();
+  impl_->name = name.str();
+}
+
+ParallelRgbPacketProcessor::~ParallelRgbPacketProcessor()
+{
+  for (size_t i = 0; i < impl_->threads.size(); ++i)
+    delete impl_->threads[i];
+  for (size_t i = 0; i < impl_->workers.size(); ++i)
+    delete impl_->workers[i];
+  for (std::map<uint64_t, Frame *>::iterator it = impl_->done.begin(); it != impl_->done.end(); ++it)
+    delete it->second;
+  delete impl_->allocator;
+  delete impl_;
+}
+
+bool ParallelRgbPacketProcessor::ready()
+{
+  libfreenect2::lock_guard l(impl_->busy_mutex);
+  for (size_t i = 0; i < impl_->busy.size(); ++i)
+    if (!impl_->busy[i])
+      return true;
+  return false;
+}
+
+bool ParallelRgbPacketProcessor::good()
+{
+  if (impl_->workers.empty())
+    return false;
+  for (size_t i = 0; i < impl_->workers.size(); ++i)
+  {
+    if (!impl_->workers[i]->decoder->good())
+      return false;
+  }
+  return true;
+}
+
+const char *ParallelRgbPacketProcessor::name()
+{
+  return impl_->name.c_str();
+}
+
+void ParallelRgbPacketProcessor::process(const RgbPacket &packet)
+{
+  size_t index = impl_->busy.size();
+  {
+    libfreenect2::lock_guard l(impl_->busy_mutex);
+    for (size_t i = 0; i < impl_->busy.size(); ++i)
+    {
+      if (!impl_->busy[i])
+      {
+        impl_->busy[i] = true;
+        index = i;
+        break;
+      }
+    }
+  }
+
+  if (index == impl_->busy.size())
+  {
+    // The stream parser checks ready() first.
+    LOG_WARNING << "no idle color decoder";
+    RgbPacket p = packet;
+    releaseBuffer(p);
+    return;
+  }
+
+  // Only this thread dispatches, so tickets follow the stream order.
+  impl_->workers[index]->ticket = impl_->next_ticket++;
+  impl_->threads[index]->process(packet);
+}
+
+void ParallelRgbPacketProcessor::setConfiguration(const libfreenect2::RgbPacketProcessor::Config &config)
+{
+  RgbPacketProcessor::setConfiguration(config);
+  for (size_t i = 0; i < impl_->workers.size(); ++i)
+    impl_->workers[i]->decoder->setConfiguration(config);
+}
+
+void ParallelRgbPacketProcessor::setFrameListener(libfreenect2::FrameListener *listener)
+{
+  RgbPacketProcessor::setFrameListener(listener);
+  libfreenect2::lock_guard l(impl_->order_mutex);
+  impl_->listener = listener;
+}
+
+void ParallelRgbPacketProcessor::setMemoryFlags(unsigned int flags)
+{
+  RgbPacketProcessor::setMemoryFlags(flags);
+  for (size_t i = 0; i < impl_->workers.size(); ++i)
+    impl_->workers[i]->decoder->setMemoryFlags(flags);
+}
+
+void ParallelRgbPacketProcessor::setThreadPolicy(const ThreadPolicy &policy, ThreadPolicyReport *report)
+{
+  for (size_t i = 0; i < impl_->threads.size(); ++i)
+    impl_->threads[i]->setThreadPolicy(policy, report);
+}
+
+void ParallelRgbPacketProcessor::setLatencyHistogram(LatencyHistogram *histogram)
+{
+  for (size_t i = 0; i < impl_->threads.size(); ++i)
+    impl_->threads[i]->setLatencyHistogram(histogram);
+}
+
+Allocator *ParallelRgbPacketProcessor::getAllocator()
+{
+  // One buffer per decoder, and one for the stream parser to fill.
+  if (impl_->allocator == NULL)
+    impl_->allocator = new PoolAllocator(new TrackingAllocator(createAllocator(memory_flags_), MemoryPacketBuffers), impl_->workers.size() + 1);
+  return impl_->allocator;
+}
+
+} /* namespace libfreenect2 */
@@ -29,7 +29,16 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <libfreenect2/registration.h>
+#include <libfreenect2/statistics.h>
+#include <libfreenect2/threading.h>
+#include <algorithm>
+#include <cstdlib>
 #include <limits>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace libfreenect2
 {
@@ -43,19 +52,225 @@ namespace libfreenect2
 static const float depth_q = 0.01;
 static const float color_q = 0.002199;
 
+/** Work split into bands of rows, see RegistrationWorkers. */
+class RegistrationJob
+{
+public:
+  virtual ~RegistrationJob() {}
+  virtual void run(int band, int bands) = 0;
+};
+
+/** Threads running a RegistrationJob on all bands. The calling thread
+ * works on band 0.
+ */
+class RegistrationWorkers
+{
+public:
+  RegistrationWorkers(int bands);
+  ~RegistrationWorkers();
+
+  int bands() const { return bands_; }
+
+  /** Run job.run() on every band and wait until all are done. */
+  void run(RegistrationJob &job);
+
+private:
+  struct Worker
+  {
+    RegistrationWorkers *owner;
+    int band;
+  };
+
+  static void static_execute(void *arg);
+  void execute(int band);
+
+  const int bands_;
+  libfreenect2::mutex run_mutex_; ///< One job at a time.
+  libfreenect2::mutex mutex_;
+  libfreenect2::condition_variable start_;
+  libfreenect2::condition_variable done_;
+  RegistrationJob *job_;
+  unsigned long generation_;
+  int pending_;
+  bool stop_;
+  std::vector<Worker> workers_;
+  std::vector<libfreenect2::thread *> threads_;
+};
+
+RegistrationWorkers::RegistrationWorkers(int bands):
+  bands_(bands), job_(NULL), generation_(0), pending_(0), stop_(false), workers_(bands - 1)
+{
+  for (int i = 1; i < bands; ++i)
+  {
+    workers_[i - 1].owner = this;
+    workers_[i - 1].band = i;
+    threads_.push_back(new libfreenect2::thread(&RegistrationWorkers::static_execute, &workers_[i - 1]));
+  }
+}
+
+RegistrationWorkers::~RegistrationWorkers()
+{
+  {
+    libfreenect2::lock_guard l(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+
+  for (size_t i = 0; i < threads_.size(); ++i)
+  {
+    threads_[i]->join();
+    delete threads_[i];
+  }
+}
+
+void RegistrationWorkers::run(RegistrationJob &job)
+{
+  libfreenect2::lock_guard run_lock(run_mutex_);
+  {
+    libfreenect2::lock_guard l(mutex_);
+    job_ = &job;
+    pending_ = bands_ - 1;
+    ++generation_;
+  }
+  start_.notify_all();
+
+  job.run(0, bands_);
+
+  libfreenect2::unique_lock l(mutex_);
+  while (pending_ > 0)
+  {
+    WAIT_CONDITION(done_, mutex_, l)
+  }
+  job_ = NULL;
+}
+
+void RegistrationWorkers::static_execute(void *arg)
+{
+  Worker *worker = static_cast<Worker *>(arg);
+  worker->owner->execute(worker->band);
+}
+
+void RegistrationWorkers::execute(int band)
+{
+  this_thread::set_name("Registration");
+  unsigned long seen = 0;
+
+  for (;;)
+  {
+    RegistrationJob *job;
+    {
+      libfreenect2::unique_lock l(mutex_);
+      while (!stop_ && generation_ == seen)
+      {
+        WAIT_CONDITION(start_, mutex_, l)
+      }
+      if (stop_)
+        return;
+      seen = generation_;
+      job = job_;
+    }
+
+    job->run(band, bands_);
+
+    bool last;
+    {
+      libfreenect2::lock_guard l(mutex_);
+      last = --pending_ == 0;
+    }
+    if (last)
+      done_.notify_all();
+  }
+}
+
+/** Buffers of one call to the frame version of RegistrationImpl::apply(). */
+struct RegistrationState
+{
+  const Frame *rgb;
+  const Frame *depth;
+  Frame *undistorted;
+  Frame *registered;
+  int color_scale;
+  int *map_c_off;      ///< Color offset of each depth pixel, or -1.
+  int c_off_begin;     ///< Smallest valid color offset.
+  int c_off_end;       ///< End of valid color offsets.
+  float *p_filter_map; ///< Minimum depth around each color pixel, or NULL without filter.
+  int filter_begin;    ///< First index of the filter map, relative to p_filter_map.
+  int filter_end;      ///< End index of the filter map, relative to p_filter_map.
+  bool clear_filter;   ///< Clear the whole filter map, not only the part depth pixels reach.
+  int row_min[424];    ///< Smallest color offset of each depth row.
+  int row_max[424];    ///< Largest color offset of each depth row, smaller than row_min if none.
+  int col_min[424];    ///< Smallest color column of each depth row, 0 if offsets wrap to other rows.
+  int col_max[424];    ///< Largest color column of each depth row, the last one if offsets wrap.
+  PointXYZRGB *points; ///< Point cloud of computePointCloud(), or NULL.
+  bool remove_invalid; ///< Leave out points without depth.
+  int row_points[424]; ///< Points with depth in each depth row, if remove_invalid.
+};
+
+/** A depth pixel in the index of RegistrationImpl::colorToDepth(). */
+struct ColorIndexEntry
+{
+  int depth_index;   ///< Index of the depth pixel.
+  float z;           ///< Undistorted depth.
+  unsigned short cx; ///< Color column the depth pixel is mapped to.
+  unsigned short cy; ///< Color row the depth pixel is mapped to.
+};
+
 class RegistrationImpl
 {
 public:
   RegistrationImpl(Freenect2Device::IrCameraParams depth_p, Freenect2Device::ColorCameraParams rgb_p);
+  ~RegistrationImpl();
 
   void apply(int dx, int dy, float dz, float& cx, float &cy) const;
   void apply(const Frame* rgb, const Frame* depth, Frame* undistorted, Frame* registered, const bool enable_filter, Frame* bigdepth, int* color_depth_map) const;
   void undistortDepth(const Frame *depth, Frame *undistorted) const;
+  bool getColorRegion(float min_depth, float max_depth, int &x, int &y, int &width, int &height) const;
   void getPointXYZRGB (const Frame* undistorted, const Frame* registered, int r, int c, float& x, float& y, float& z, float& rgb) const;
   void getPointXYZ (const Frame* undistorted, int r, int c, float& x, float& y, float& z) const;
+  bool computePointCloud(const Frame* rgb, const Frame* depth, PointXYZRGB* points, size_t& count, const bool enable_filter, const bool remove_invalid) const;
+  void enableColorToDepth(bool enable);
+  bool colorToDepth(int cx, int cy, int &depth_index, float &z) const;
+  size_t colorRegionToDepth(int x, int y, int width, int height, int *depth_indices, size_t max_count) const;
   void distort(int mx, int my, float& dx, float& dy) const;
   void depth_to_color(float mx, float my, float& rx, float& ry) const;
 
+  void mapRows(RegistrationState &state, int begin, int end) const;
+  void clearFilter(const RegistrationState &state, int begin, int end) const;
+  void splatFilter(const RegistrationState &state, int begin, int end) const;
+  void registerRows(const RegistrationState &state, int begin, int end) const;
+  void pointRows(const RegistrationState &state, int begin, int end) const;
+
+  template<typename PixelT>
+  void registerColor(const PixelT *rgb_data, PixelT *registered_data, const int *map_c_off, const float *undistorted_data, const float *p_filter_map, int size) const;
+  template<typename PixelT>
+  void pointColors(const PixelT *rgb_data, const RegistrationState &state, int begin, int end) const;
+
+  LatencyHistogram latency; ///< Duration of the frame version of apply().
+
+  RegistrationWorkers *workers; ///< NULL to run apply() on the calling thread only.
+
+private:
+  static int colorScale(const Frame *rgb);
+  void initState(RegistrationState &state, const Frame *rgb, const Frame *depth, Frame *undistorted, const bool enable_filter, Frame *bigdepth, int *color_depth_map) const;
+  void buildColorIndex(const RegistrationState &state) const;
+
+  template<typename T>
+  static T *scratch(std::vector<T> &buffer, size_t size);
+
+  mutable libfreenect2::mutex scratch_mutex; ///< Serializes apply() on the scratch buffers.
+  mutable std::vector<int> c_off_scratch;    ///< Color offsets if the caller does not want them.
+  mutable std::vector<float> filter_scratch; ///< Filter map if the caller does not want it.
+  mutable std::vector<float> undistorted_scratch; ///< Undistorted depth of computePointCloud().
+
+  // Depth pixels of the last frame sorted by cells of the color image, guarded by scratch_mutex.
+  bool color_index_enabled;
+  mutable int color_index_width;  ///< Width of the color image, 0 without index.
+  mutable int color_index_height; ///< Height of the color image.
+  mutable int color_index_shift;  ///< Cells are 1 << shift color pixels wide and high.
+  mutable int color_index_cols;   ///< Cells in a row of the color image.
+  mutable std::vector<int> color_index_cells; ///< First entry of each cell, and the end.
+  mutable std::vector<ColorIndexEntry> color_index;
+
 private:
   Freenect2Device::IrCameraParams depth;    ///< Depth camera parameters.
   Freenect2Device::ColorCameraParams color; ///< Color camera parameters.
@@ -64,6 +279,10 @@ private:
   float depth_to_color_map_x[512 * 424];
   float depth_to_color_map_y[512 * 424];
   int depth_to_color_map_yi[512 * 424];
+  float color_row_min; ///< Smallest color row (+0.5 for rounding) of a depth pixel in full size.
+  float color_row_max; ///< Largest color row (+0.5 for rounding) of a depth pixel in full size.
+  double point_x[512]; ///< X coordinate of each depth column at 1 meter, as in getPointXYZ().
+  double point_y[424]; ///< Y coordinate of each depth row at 1 meter, as in getPointXYZ().
 
   const int filter_width_half;
   const int filter_height_half;
@@ -122,127 +341,670 @@ void RegistrationImpl::apply( int dx, int dy, float dz, float& cx, float &cy) co
 
 void Registration::apply(const Frame *rgb, const Frame *depth, Frame *undistorted, Frame *registered, const bool enable_filter, Frame *bigdepth, int *color_depth_map) const
 {
+  uint64_t start = LatencyHistogram::now();
   impl_->apply(rgb, depth, undistorted, registered, enable_filter, bigdepth, color_depth_map);
+  impl_->latency.recordSince(start);
+}
+
+Freenect2Device::LatencyStatistics Registration::getStatistics() const
+{
+  return impl_->latency.getStatistics();
+}
+
+/** Stages of the frame version of RegistrationImpl::apply(). */
+class RegistrationApplyJob: public RegistrationJob
+{
+public:
+  enum Stage
+  {
+    MapStage,         ///< Color offsets of depth rows.
+    SplatStage,       ///< Clearing and setting the minimum depth around color pixels, by parts of the filter map.
+    RegisterStage,    ///< Registered colors of depth rows.
+    MapRegisterStage, ///< MapStage and RegisterStage without filter.
+    PointStage        ///< Points of depth rows.
+  };
+
+  const RegistrationImpl *impl;
+  RegistrationState *state;
+  Stage stage;
+
+  virtual void run(int band, int bands)
+  {
+    const int row_begin = 424 * band / bands, row_end = 424 * (band + 1) / bands;
+
+    // Parts of the filter map start at color rows, so each has whole rows.
+    const int color_width = state->rgb->width;
+    const int filter_rows = (state->filter_end - state->filter_begin) / color_width;
+    const int filter_begin = state->filter_begin + filter_rows * band / bands * color_width;
+    const int filter_end = state->filter_begin + filter_rows * (band + 1) / bands * color_width;
+
+    switch (stage)
+    {
+    case MapStage:
+      impl->mapRows(*state, row_begin, row_end);
+      break;
+    case SplatStage:
+      impl->clearFilter(*state, filter_begin, filter_end);
+      impl->splatFilter(*state, filter_begin, filter_end);
+      break;
+    case RegisterStage:
+      impl->registerRows(*state, row_begin, row_end);
+      break;
+    case MapRegisterStage:
+      impl->mapRows(*state, row_begin, row_end);
+      impl->registerRows(*state, row_begin, row_end);
+      break;
+    case PointStage:
+      impl->pointRows(*state, row_begin, row_end);
+      break;
+    }
+  }
+
+  void run(Stage next)
+  {
+    stage = next;
+    if (impl->workers)
+      impl->workers->run(*this);
+    else
+      run(0, 1);
+  }
+};
+
+/** Scale of a color image from the full 1920x1080, or 0 if it cannot be registered.
+ * The color image may be decoded at 1/2, 1/4 or 1/8 of 1920x1080.
+ * Gray, I420 and NV12 images have 1 byte per pixel, of which the Y plane is sampled.
+ */
+int RegistrationImpl::colorScale(const Frame *rgb)
+{
+  const int color_scale = rgb && rgb->width > 0 ? 1920 / (int)rgb->width : 0;
+  if ((color_scale != 1 && color_scale != 2 && color_scale != 4 && color_scale != 8) ||
+      rgb->width * color_scale != 1920 || rgb->height * color_scale != 1080 || (rgb->bytes_per_pixel != 4 && rgb->bytes_per_pixel != 1))
+    return 0;
+  return color_scale;
 }
 
 void RegistrationImpl::apply(const Frame *rgb, const Frame *depth, Frame *undistorted, Frame *registered, const bool enable_filter, Frame *bigdepth, int *color_depth_map) const
 {
   // Check if all frames are valid and have the correct size
-  if (!rgb || !depth || !undistorted || !registered ||
-      rgb->width != 1920 || rgb->height != 1080 || rgb->bytes_per_pixel != 4 ||
+  if (!colorScale(rgb) || !depth || !undistorted || !registered ||
       depth->width != 512 || depth->height != 424 || depth->bytes_per_pixel != 4 ||
       undistorted->width != 512 || undistorted->height != 424 || undistorted->bytes_per_pixel != 4 ||
-      registered->width != 512 || registered->height != 424 || registered->bytes_per_pixel != 4)
+      registered->width != 512 || registered->height != 424 || registered->bytes_per_pixel != rgb->bytes_per_pixel)
     return;
 
-  const float *depth_data = (float*)depth->data;
-  const unsigned int *rgb_data = (unsigned int*)rgb->data;
-  float *undistorted_data = (float*)undistorted->data;
-  unsigned int *registered_data = (unsigned int*)registered->data;
-  const int *map_dist = distort_map;
-  const float *map_x = depth_to_color_map_x;
-  const int *map_yi = depth_to_color_map_yi;
+  // The scratch buffers are reused across calls.
+  libfreenect2::lock_guard lock(scratch_mutex);
 
+  RegistrationState state;
+  initState(state, rgb, depth, undistorted, enable_filter, bigdepth, color_depth_map);
+  state.registered = registered;
+
+  RegistrationApplyJob job;
+  job.impl = this;
+  job.state = &state;
+
+  if(enable_filter){
+    // The window of a depth pixel can fall in the band of another thread,
+    // so the filter map is set after all offsets, split by parts of the map.
+    job.run(RegistrationApplyJob::MapStage);
+    job.run(RegistrationApplyJob::SplatStage);
+    job.run(RegistrationApplyJob::RegisterStage);
+  }else{
+    job.run(RegistrationApplyJob::MapRegisterStage);
+  }
+
+  if(color_index_enabled)
+    buildColorIndex(state);
+}
+
+/** Set up 'state' for the stages of mapping valid frames 'rgb' onto 'depth'.
+ * Buffers the caller does not give are scratch buffers, so scratch_mutex must be held.
+ */
+void RegistrationImpl::initState(RegistrationState &state, const Frame *rgb, const Frame *depth, Frame *undistorted, const bool enable_filter, Frame *bigdepth, int *color_depth_map) const
+{
   const int size_depth = 512 * 424;
-  const int size_color = 1920 * 1080;
-  const float color_cx = color.cx + 0.5f; // 0.5f added for later rounding
+  const int color_scale = colorScale(rgb);
+  const int color_width = rgb->width;
+  const int color_height = rgb->height;
+  const int size_color = color_width * color_height;
 
-  // size of filter map with a border of filter_height_half on top and bottom so that no check for borders is needed.
-  // since the color image is wide angle no border to the sides is needed.
-  const int size_filter_map = size_color + 1920 * filter_height_half * 2;
-  // offset to the important data
-  const int offset_filter_map = 1920 * filter_height_half;
+  // Only these color rows are sampled, from the tables. Offsets of pixels
+  // beyond the left or right edge wrap to the next row.
+  const float inv_scale = 1.0f / color_scale;
+  const int row_begin = std::max((int)std::max(color_row_min * inv_scale, 0.0f) - 1, 0);
+  const int row_end = std::min((int)std::min(color_row_max * inv_scale, (float)color_height) + 2, color_height);
 
-  // map for storing the min z values used for each color pixel
-  float *filter_map = NULL;
-  // pointer to the beginning of the important data
-  float *p_filter_map = NULL;
+  state.rgb = rgb;
+  state.depth = depth;
+  state.undistorted = undistorted;
+  state.registered = NULL;
+  state.color_scale = color_scale;
+  state.c_off_begin = row_begin * color_width;
+  state.c_off_end = std::max(row_end, row_begin) * color_width;
+  state.p_filter_map = NULL;
+  state.clear_filter = false;
+  state.points = NULL;
+  state.remove_invalid = false;
 
   // map for storing the color offset for each depth pixel
-  int *depth_to_c_off = color_depth_map ? color_depth_map : new int[size_depth];
-  int *map_c_off = depth_to_c_off;
+  state.map_c_off = color_depth_map ? color_depth_map : scratch(c_off_scratch, size_depth);
 
-  // initializing the depth_map with values outside of the Kinect2 range
-  if(enable_filter){
-    filter_map = bigdepth ? (float*)bigdepth->data : new float[size_filter_map];
-    p_filter_map = filter_map + offset_filter_map;
+  if(enable_filter && bigdepth){
+    // 'bigdepth' has the whole image with a border of filter_height_half on top and bottom,
+    // so that no check for borders is needed. Since the color image is wide angle no border
+    // to the sides is needed.
+    state.filter_begin = -color_width * filter_height_half;
+    state.filter_end = size_color + color_width * filter_height_half;
+    state.p_filter_map = (float*)bigdepth->data - state.filter_begin;
+    state.clear_filter = true;
+  }else if(enable_filter){
+    // the rows depth pixels are mapped to with a border of filter_height_half,
+    // indexed by color offsets like the whole image
+    state.filter_begin = state.c_off_begin - color_width * filter_height_half;
+    state.filter_end = state.c_off_end + color_width * filter_height_half;
+    state.p_filter_map = scratch(filter_scratch, state.filter_end - state.filter_begin) - state.filter_begin;
+  }
+}
 
-    for(float *it = filter_map, *end = filter_map + size_filter_map; it != end; ++it){
-      *it = std::numeric_limits<float>::infinity();
-    }
+bool Registration::computePointCloud(const Frame *rgb, const Frame *depth, PointXYZRGB *points, size_t &count, const bool enable_filter, const bool remove_invalid) const
+{
+  return impl_->computePointCloud(rgb, depth, points, count, enable_filter, remove_invalid);
+}
+
+bool RegistrationImpl::computePointCloud(const Frame *rgb, const Frame *depth, PointXYZRGB *points, size_t &count, const bool enable_filter, const bool remove_invalid) const
+{
+  count = 0;
+  if (!colorScale(rgb) || !depth || !points ||
+      depth->width != 512 || depth->height != 424 || depth->bytes_per_pixel != 4)
+    return false;
+
+  libfreenect2::lock_guard lock(scratch_mutex);
+
+  // The undistorted depth is kept, since the filter needs all of it before any color is looked up.
+  Frame undistorted(512, 424, 4, reinterpret_cast<unsigned char *>(scratch(undistorted_scratch, 512 * 424)));
+
+  RegistrationState state;
+  initState(state, rgb, depth, &undistorted, enable_filter, NULL, NULL);
+  state.points = points;
+  state.remove_invalid = remove_invalid;
+
+  RegistrationApplyJob job;
+  job.impl = this;
+  job.state = &state;
+
+  // With invalid points removed, the points of a band start after those of all rows above it.
+  job.run(RegistrationApplyJob::MapStage);
+  if(enable_filter)
+    job.run(RegistrationApplyJob::SplatStage);
+  job.run(RegistrationApplyJob::PointStage);
+
+  if(color_index_enabled)
+    buildColorIndex(state);
+
+  if(remove_invalid){
+    for(int y = 0; y < 424; ++y)
+      count += state.row_points[y];
+  }else{
+    count = 512 * 424;
   }
+  return true;
+}
 
-  /* Fix depth distortion, and compute pixel to use from 'rgb' based on depth measurement,
-   * stored as x/y offset in the rgb data.
-   */
+void Registration::enableColorToDepth(bool enable)
+{
+  impl_->enableColorToDepth(enable);
+}
 
-  // iterating over all pixels from undistorted depth and registered color image
-  // the four maps have the same structure as the images, so their pointers are increased each iteration as well
-  for(int i = 0; i < size_depth; ++i, ++undistorted_data, ++map_dist, ++map_x, ++map_yi, ++map_c_off){
-    // getting index of distorted depth pixel
-    const int index = *map_dist;
+void RegistrationImpl::enableColorToDepth(bool enable)
+{
+  libfreenect2::lock_guard lock(scratch_mutex);
+  color_index_enabled = enable;
+  color_index_width = 0;
+}
 
-    // check if distorted depth pixel is outside of the depth image
-    if(index < 0){
-      *map_c_off = -1;
-      *undistorted_data = 0;
+/** Sort the depth pixels with a color offset in 'state' by cells of the color image. */
+void RegistrationImpl::buildColorIndex(const RegistrationState &state) const
+{
+  const int color_width = state.rgb->width;
+  const int color_height = state.rgb->height;
+
+  // cells of 8x8 pixels of the full size image
+  int shift = 3;
+  for(int scale = state.color_scale; scale > 1 && shift > 0; scale >>= 1)
+    --shift;
+  const int cols = (color_width + (1 << shift) - 1) >> shift;
+  const int rows = (color_height + (1 << shift) - 1) >> shift;
+  const int cells = cols * rows;
+
+  int *starts = scratch(color_index_cells, cells + 1);
+  ColorIndexEntry *entries = scratch(color_index, 512 * 424);
+  std::fill(starts, starts + cells + 1, 0);
+
+  // exact for offsets of the color image
+  const double inv_width = 1.0 / color_width;
+
+  // count the depth pixels of each cell
+  for(int i = 0; i < 512 * 424; ++i){
+    const int c_off = state.map_c_off[i];
+    if(c_off < 0)
       continue;
-    }
+    const int cy = (int)((c_off + 0.5) * inv_width);
+    const int cx = c_off - cy * color_width;
+    ++starts[(cy >> shift) * cols + (cx >> shift)];
+  }
 
-    // getting depth value for current pixel
-    const float z = depth_data[index];
-    *undistorted_data = z;
+  int start = 0;
+  for(int c = 0; c < cells; ++c){
+    const int count = starts[c];
+    starts[c] = start;
+    start += count;
+  }
 
-    // checking for invalid depth value
-    if(z <= 0.0f){
-      *map_c_off = -1;
+  // fill the cells, moving each start to the end of its cell
+  const float *undistorted_data = (const float*)state.undistorted->data;
+  for(int i = 0; i < 512 * 424; ++i){
+    const int c_off = state.map_c_off[i];
+    if(c_off < 0)
       continue;
+    const int cy = (int)((c_off + 0.5) * inv_width);
+    const int cx = c_off - cy * color_width;
+    ColorIndexEntry &entry = entries[starts[(cy >> shift) * cols + (cx >> shift)]++];
+    entry.depth_index = i;
+    entry.z = undistorted_data[i];
+    entry.cx = cx;
+    entry.cy = cy;
+  }
+
+  for(int c = cells; c > 0; --c)
+    starts[c] = starts[c - 1];
+  starts[0] = 0;
+
+  color_index_width = color_width;
+  color_index_height = color_height;
+  color_index_shift = shift;
+  color_index_cols = cols;
+}
+
+bool Registration::colorToDepth(int cx, int cy, int &depth_index, float &z) const
+{
+  return impl_->colorToDepth(cx, cy, depth_index, z);
+}
+
+bool RegistrationImpl::colorToDepth(int cx, int cy, int &depth_index, float &z) const
+{
+  libfreenect2::lock_guard lock(scratch_mutex);
+  const int color_width = color_index_width;
+  if(color_width == 0 || cx < 0 || cx >= color_width || cy < 0 || cy >= color_index_height)
+    return false;
+
+  const int *starts = &color_index_cells[0];
+  const ColorIndexEntry *entries = &color_index[0];
+  const int size_color = color_width * color_index_height;
+  const int offset = cy * color_width + cx;
+
+  // The window of a depth pixel at a color offset covers offsets + r * color_width + c, like in
+  // splatFilter(), so the candidates for each r are a range of offsets, possibly over two rows.
+  depth_index = -1;
+  z = std::numeric_limits<float>::infinity();
+  for(int r = -filter_height_half; r <= filter_height_half; ++r){
+    const int first = std::max(offset - r * color_width - filter_width_half, 0);
+    const int last = std::min(offset - r * color_width + filter_width_half, size_color - 1);
+
+    for(int begin = first; begin <= last;){
+      const int row = begin / color_width;
+      const int end = std::min(last, row * color_width + color_width - 1);
+      const int *cell = starts + (row >> color_index_shift) * color_index_cols;
+
+      for(int c = (begin - row * color_width) >> color_index_shift; c <= (end - row * color_width) >> color_index_shift; ++c){
+        for(const ColorIndexEntry *it = entries + cell[c], *it_end = entries + cell[c + 1]; it != it_end; ++it){
+          const int it_offset = it->cy * color_width + it->cx;
+          if(it_offset >= begin && it_offset <= end && it->z < z){
+            z = it->z;
+            depth_index = it->depth_index;
+          }
+        }
+      }
+      begin = end + 1;
+    }
+  }
+  return depth_index >= 0;
+}
+
+size_t Registration::colorRegionToDepth(int x, int y, int width, int height, int *depth_indices, size_t max_count) const
+{
+  return impl_->colorRegionToDepth(x, y, width, height, depth_indices, max_count);
+}
+
+size_t RegistrationImpl::colorRegionToDepth(int x, int y, int width, int height, int *depth_indices, size_t max_count) const
+{
+  libfreenect2::lock_guard lock(scratch_mutex);
+  const int x_end = std::min(x + width, color_index_width), y_end = std::min(y + height, color_index_height);
+  x = std::max(x, 0);
+  y = std::max(y, 0);
+  if(x >= x_end || y >= y_end)
+    return 0;
+
+  const int *starts = &color_index_cells[0];
+  const ColorIndexEntry *entries = &color_index[0];
+  size_t count = 0;
+  for(int row = y >> color_index_shift; row <= (y_end - 1) >> color_index_shift; ++row){
+    const int *cell = starts + row * color_index_cols;
+    for(int c = x >> color_index_shift; c <= (x_end - 1) >> color_index_shift; ++c){
+      for(const ColorIndexEntry *it = entries + cell[c], *it_end = entries + cell[c + 1]; it != it_end; ++it){
+        if(it->cx < x || it->cx >= x_end || it->cy < y || it->cy >= y_end)
+          continue;
+        if(count < max_count)
+          depth_indices[count] = it->depth_index;
+        ++count;
+      }
     }
+  }
+  return count;
+}
+
+/** Grow a scratch buffer to at least 'size' elements. */
+template<typename T>
+T *RegistrationImpl::scratch(std::vector<T> &buffer, size_t size)
+{
+  if(buffer.size() < size){
+    trackFree(MemoryRegistration, buffer.size() * sizeof(T));
+    buffer.resize(size);
+    trackAllocation(MemoryRegistration, buffer.size() * sizeof(T));
+  }
+  return &buffer[0];
+}
+
+/** Whether getPointXYZ() gives a point for a depth (meter). */
+static inline bool hasPoint(float depth_val)
+{
+  return !isnan(depth_val) && depth_val > 0.001;
+}
+
+/** Fix depth distortion of depth rows [begin, end), and compute the pixel
+ * to use from 'rgb' based on the depth measurement, stored as offset in the
+ * rgb data.
+ */
+void RegistrationImpl::mapRows(RegistrationState &state, int begin, int end) const
+{
+  const float *depth_data = (float*)state.depth->data;
+  const int color_width = state.rgb->width;
+  const int c_off_begin = state.c_off_begin, c_off_end = state.c_off_end;
+  const int color_scale = state.color_scale;
+  const float color_cx = color.cx + 0.5f; // 0.5f added for later rounding
+  const float inv_scale = 1.0f / color_scale;
+
+  for(int y = begin; y < end; ++y){
+    int i = y * 512;
+    const int row_end = i + 512;
+
+    // the four maps have the same structure as the images, so their pointers are increased each iteration as well
+    const int *map_dist = distort_map + i;
+    const float *map_x = depth_to_color_map_x + i;
+    const float *map_y = depth_to_color_map_y + i;
+    const int *map_yi = depth_to_color_map_yi + i;
+    float *undistorted_data = (float*)state.undistorted->data + i;
+    int *map_c_off = state.map_c_off + i;
+    int col_min = color_width, col_max = -1;
+
+#ifdef __SSE2__
+    // The same arithmetic as below on 4 pixels; depth values are gathered one by one.
+    const __m128i minus_one = _mm_set1_epi32(-1);
+    const __m128i c_off_first = _mm_set1_epi32(c_off_begin - 1);
+    const __m128i c_off_last = _mm_set1_epi32(c_off_end);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 shift_m = _mm_set1_ps(color.shift_m);
+    const __m128 fx = _mm_set1_ps(color.fx);
+    const __m128 cx_4 = _mm_set1_ps(color_cx);
+    const __m128 inv_scale_4 = _mm_set1_ps(inv_scale);
+    const __m128 color_width_4 = _mm_set1_ps((float)color_width);
+    const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    const __m128 minus_inf = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+    __m128 x_min = inf, x_max = minus_inf;
+    for(; i + 4 <= row_end; i += 4, map_dist += 4, map_x += 4, map_y += 4, map_yi += 4, undistorted_data += 4, map_c_off += 4){
+      const __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i *>(map_dist));
+      const __m128 z = _mm_set_ps(map_dist[3] < 0 ? 0.0f : depth_data[map_dist[3]], map_dist[2] < 0 ? 0.0f : depth_data[map_dist[2]],
+                                  map_dist[1] < 0 ? 0.0f : depth_data[map_dist[1]], map_dist[0] < 0 ? 0.0f : depth_data[map_dist[0]]);
+      _mm_storeu_ps(undistorted_data, z);
+
+      // valid if the distorted pixel is inside the depth image and z is not <= 0
+      const __m128i valid = _mm_andnot_si128(_mm_castps_si128(_mm_cmple_ps(z, zero)), _mm_cmpgt_epi32(index, minus_one));
 
-    // calculating x offset for rgb image based on depth value
-    const float rx = (*map_x + (color.shift_m / z)) * color.fx + color_cx;
-    const int cx = rx; // same as round for positive numbers (0.5f was already added to color_cx)
-    // getting y offset for depth image
-    const int cy = *map_yi;
-    // combining offsets
-    const int c_off = cx + cy * 1920;
-
-    // check if c_off is outside of rgb image
-    // checking rx/cx is not needed because the color image is much wider then the depth image
-    if(c_off < 0 || c_off >= size_color){
-      *map_c_off = -1;
+      // x and y offsets in the color image as below; multiplying by inv_scale = 1 is exact
+      const __m128 rx = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_loadu_ps(map_x), _mm_div_ps(shift_m, z)), fx), cx_4);
+      const __m128 x = _mm_mul_ps(rx, inv_scale_4);
+      const __m128i cx = _mm_cvttps_epi32(x);
+      const __m128i cy = _mm_cvttps_epi32(_mm_mul_ps(_mm_add_ps(_mm_loadu_ps(map_y), half), inv_scale_4));
+      // SSE2 has no 32-bit multiply; offsets inside the color image are exact in float
+      const __m128i c_off = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(cy), color_width_4), _mm_cvtepi32_ps(cx)));
+
+      const __m128i inside = _mm_and_si128(_mm_cmpgt_epi32(c_off, c_off_first), _mm_cmplt_epi32(c_off, c_off_last));
+      const __m128i keep = _mm_and_si128(valid, inside);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(map_c_off), _mm_or_si128(_mm_and_si128(keep, c_off), _mm_andnot_si128(keep, minus_one)));
+
+      const __m128 keep_x = _mm_castsi128_ps(keep);
+      x_min = _mm_min_ps(x_min, _mm_or_ps(_mm_and_ps(keep_x, x), _mm_andnot_ps(keep_x, inf)));
+      x_max = _mm_max_ps(x_max, _mm_or_ps(_mm_and_ps(keep_x, x), _mm_andnot_ps(keep_x, minus_inf)));
+    }
+
+    float x_mins[4], x_maxs[4];
+    _mm_storeu_ps(x_mins, x_min);
+    _mm_storeu_ps(x_maxs, x_max);
+    for(int k = 0; k < 4; ++k){
+      // truncating like cx
+      if(x_mins[k] <= x_maxs[k]){
+        col_min = std::min(col_min, (int)x_mins[k]);
+        col_max = std::max(col_max, (int)x_maxs[k]);
+      }
+    }
+#endif
+
+    for(; i < row_end; ++i, ++undistorted_data, ++map_dist, ++map_x, ++map_y, ++map_yi, ++map_c_off){
+      // getting index of distorted depth pixel
+      const int index = *map_dist;
+
+      // check if distorted depth pixel is outside of the depth image
+      if(index < 0){
+        *map_c_off = -1;
+        *undistorted_data = 0;
+        continue;
+      }
+
+      // getting depth value for current pixel
+      const float z = depth_data[index];
+      *undistorted_data = z;
+
+      // checking for invalid depth value
+      if(z <= 0.0f){
+        *map_c_off = -1;
+        continue;
+      }
+
+      // calculating x offset for rgb image based on depth value
+      const float rx = (*map_x + (color.shift_m / z)) * color.fx + color_cx;
+      // getting x and y offsets in the color image, scaled to its size
+      // same as round for positive numbers (0.5f was already added to color_cx and map_yi)
+      const int cx = color_scale == 1 ? (int)rx : (int)(rx * inv_scale);
+      const int cy = color_scale == 1 ? *map_yi : (int)((*map_y + 0.5f) * inv_scale);
+      // combining offsets
+      const int c_off = cx + cy * color_width;
+
+      // check if c_off is outside of rgb image, or the rows it can map to
+      // checking rx/cx is not needed because the color image is much wider then the depth image
+      if(c_off < c_off_begin || c_off >= c_off_end){
+        *map_c_off = -1;
+        continue;
+      }
+      *map_c_off = c_off;
+      col_min = std::min(col_min, cx);
+      col_max = std::max(col_max, cx);
+    }
+
+    // range of offsets in this row, to find the rows that reach a part of the filter map
+    int row_min = c_off_end, row_max = -1;
+    for(const int *it = state.map_c_off + y * 512, *it_end = it + 512; it != it_end; ++it){
+      if(*it < 0)
+        continue;
+      row_min = std::min(row_min, *it);
+      row_max = std::max(row_max, *it);
+    }
+    state.row_min[y] = row_min;
+    state.row_max[y] = row_max;
+
+    // offsets beyond the left or right edge are in other rows
+    if(col_min < 0 || col_max >= color_width){
+      col_min = 0;
+      col_max = color_width - 1;
+    }
+    state.col_min[y] = col_min;
+    state.col_max[y] = col_max;
+
+    if(state.remove_invalid){
+      int points = 0;
+      const float *row = (const float*)state.undistorted->data + y * 512;
+      for(int x = 0; x < 512; ++x)
+        points += hasPoint(row[x] / 1000.0f);
+      state.row_points[y] = points;
+    }
+  }
+}
+
+/** Initialize the filter map between offsets [begin, end) with values outside of the Kinect2 range.
+ * Unless the whole map is wanted, only the cells at color offsets of depth pixels are cleared,
+ * because no others are read.
+ */
+void RegistrationImpl::clearFilter(const RegistrationState &state, int begin, int end) const
+{
+  const float inf = std::numeric_limits<float>::infinity();
+  if(state.clear_filter){
+    std::fill(state.p_filter_map + begin, state.p_filter_map + end, inf);
+    return;
+  }
+
+  // rows of the color image in this part; parts start at rows
+  const int color_width = state.rgb->width;
+  const int first = std::max(begin / color_width, 0);
+  const int last = std::min(end / color_width, (int)state.rgb->height);
+
+  // columns of each row that depth pixels map to
+  int col_min[1080], col_max[1080];
+  for(int r = first; r < last; ++r){
+    col_min[r] = color_width;
+    col_max[r] = -1;
+  }
+  for(int y = 0; y < 424; ++y){
+    if(state.row_min[y] > state.row_max[y])
       continue;
+    const int r_end = std::min(state.row_max[y] / color_width + 1, last);
+    for(int r = std::max(state.row_min[y] / color_width, first); r < r_end; ++r){
+      col_min[r] = std::min(col_min[r], state.col_min[y]);
+      col_max[r] = std::max(col_max[r], state.col_max[y]);
     }
+  }
 
-    // saving the offset for later
-    *map_c_off = c_off;
+  for(int r = first; r < last; ++r){
+    if(col_min[r] <= col_max[r]){
+      float *row = state.p_filter_map + r * color_width;
+      std::fill(row + col_min[r], row + col_max[r] + 1, inf);
+    }
+  }
+}
 
-    if(enable_filter){
-      // setting a window around the filter map pixel corresponding to the color pixel with the current z value
-      int yi = (cy - filter_height_half) * 1920 + cx - filter_width_half; // index of first pixel to set
-      for(int r = -filter_height_half; r <= filter_height_half; ++r, yi += 1920) // index increased by a full row each iteration
-      {
-        float *it = p_filter_map + yi;
-        for(int c = -filter_width_half; c <= filter_width_half; ++c, ++it)
+/** Set a window around the filter map pixel of each depth pixel to the
+ * smallest depth, writing only offsets [begin, end) of the filter map.
+ * Each thread owns a part of the map, so no writes conflict.
+ */
+void RegistrationImpl::splatFilter(const RegistrationState &state, int begin, int end) const
+{
+  const int color_width = state.rgb->width;
+  // offset from the center of a window to its first pixel
+  const int reach = filter_height_half * color_width + filter_width_half;
+  float *p_filter_map = state.p_filter_map;
+
+  for(int y = 0; y < 424; ++y){
+    // skip rows without pixels, or that cannot reach this part
+    if(state.row_min[y] > state.row_max[y] || state.row_max[y] + reach < begin || state.row_min[y] - reach >= end)
+      continue;
+
+    const int *map_c_off = state.map_c_off + y * 512;
+    const float *undistorted_data = (const float*)state.undistorted->data + y * 512;
+    for(int x = 0; x < 512; ++x){
+      const int c_off = map_c_off[x];
+      if(c_off < 0)
+        continue;
+
+      const float z = undistorted_data[x];
+      int yi = c_off - reach; // index of first pixel to set
+
+      if(yi >= begin && c_off + reach < end){
+        // setting a window around the filter map pixel corresponding to the color pixel with the current z value
+        for(int r = -filter_height_half; r <= filter_height_half; ++r, yi += color_width) // index increased by a full row each iteration
         {
-          // only set if the current z is smaller
-          if(z < *it)
-            *it = z;
+          float *it = p_filter_map + yi;
+          for(int c = -filter_width_half; c <= filter_width_half; ++c, ++it)
+          {
+            // only set if the current z is smaller
+            *it = std::min(*it, z);
+          }
+        }
+      }else{
+        // the window crosses the border of this part
+        for(int r = -filter_height_half; r <= filter_height_half; ++r, yi += color_width)
+        {
+          for(int c = 0; c <= 2 * filter_width_half; ++c)
+          {
+            const int index = yi + c;
+            if(index >= begin && index < end && z < p_filter_map[index])
+              p_filter_map[index] = z;
+          }
         }
       }
     }
   }
+}
 
-  /* Construct 'registered' image. */
+/** Construct the 'registered' image of depth rows [begin, end). */
+void RegistrationImpl::registerRows(const RegistrationState &state, int begin, int end) const
+{
+  const int offset = begin * 512, size = (end - begin) * 512;
+  const int *map_c_off = state.map_c_off + offset;
+  const float *undistorted_data = (const float*)state.undistorted->data + offset;
 
-  // reseting the pointers to the beginning
-  map_c_off = depth_to_c_off;
-  undistorted_data = (float*)undistorted->data;
+  if (state.rgb->bytes_per_pixel == 1)
+    registerColor(state.rgb->data, state.registered->data + offset, map_c_off, undistorted_data, state.p_filter_map, size);
+  else
+    registerColor((const unsigned int*)state.rgb->data, (unsigned int*)state.registered->data + offset, map_c_off, undistorted_data, state.p_filter_map, size);
+}
 
+/** Fill 'registered' with the color pixels at the offsets computed by mapRows().
+ * @param p_filter_map Minimum depth around each color pixel, or NULL to disable the filter.
+ * @param size Number of depth pixels.
+ */
+template<typename PixelT>
+void RegistrationImpl::registerColor(const PixelT *rgb_data, PixelT *registered_data, const int *map_c_off, const float *undistorted_data, const float *p_filter_map, int size) const
+{
   /* Filter drops duplicate pixels due to aspect of two cameras. */
-  if(enable_filter){
+  if(p_filter_map){
+    int i = 0;
+#ifdef __SSE2__
+    // The depth test on 4 pixels; minimum depths and colors are gathered one by one.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 tolerance = _mm_set1_ps(filter_tolerance);
+    for(; i + 4 <= size; i += 4, map_c_off += 4, undistorted_data += 4, registered_data += 4){
+      const __m128i c_off = _mm_loadu_si128(reinterpret_cast<const __m128i *>(map_c_off));
+      const __m128 min_z = _mm_set_ps(map_c_off[3] < 0 ? 0.0f : p_filter_map[map_c_off[3]], map_c_off[2] < 0 ? 0.0f : p_filter_map[map_c_off[2]],
+                                      map_c_off[1] < 0 ? 0.0f : p_filter_map[map_c_off[1]], map_c_off[0] < 0 ? 0.0f : p_filter_map[map_c_off[0]]);
+      const __m128 z = _mm_loadu_ps(undistorted_data);
+
+      // check if offset is out of image, and for allowed depth noise
+      const int drop = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(c_off, zero))) |
+                       _mm_movemask_ps(_mm_cmpgt_ps(_mm_div_ps(_mm_sub_ps(z, min_z), z), tolerance));
+      for(int k = 0; k < 4; ++k)
+        registered_data[k] = (drop >> k) & 1 ? 0 : rgb_data[map_c_off[k]];
+    }
+#endif
     // run through all registered color pixels and set them based on filter results
-    for(int i = 0; i < size_depth; ++i, ++map_c_off, ++undistorted_data, ++registered_data){
+    for(; i < size; ++i, ++map_c_off, ++undistorted_data, ++registered_data){
       const int c_off = *map_c_off;
 
       // check if offset is out of image
@@ -257,20 +1019,79 @@ void RegistrationImpl::apply(const Frame *rgb, const Frame *depth, Frame *undist
       // check for allowed depth noise
       *registered_data = (z - min_z) / z > filter_tolerance ? 0 : *(rgb_data + c_off);
     }
-
-    if (!bigdepth) delete[] filter_map;
   }
   else
   {
     // run through all registered color pixels and set them based on c_off
-    for(int i = 0; i < size_depth; ++i, ++map_c_off, ++registered_data){
+    for(int i = 0; i < size; ++i, ++map_c_off, ++registered_data){
       const int c_off = *map_c_off;
 
       // check if offset is out of image
       *registered_data = c_off < 0 ? 0 : *(rgb_data + c_off);
     }
   }
-  if (!color_depth_map) delete[] depth_to_c_off;
+}
+
+/** Construct the points of depth rows [begin, end). */
+void RegistrationImpl::pointRows(const RegistrationState &state, int begin, int end) const
+{
+  if (state.rgb->bytes_per_pixel == 1)
+    pointColors(state.rgb->data, state, begin, end);
+  else
+    pointColors((const unsigned int*)state.rgb->data, state, begin, end);
+}
+
+/** Color of a point from a color pixel. */
+static inline uint32_t pointColor(unsigned int bgrx)
+{
+  return bgrx;
+}
+
+static inline uint32_t pointColor(unsigned char gray)
+{
+  return gray * 0x010101u;
+}
+
+/** Fill the points of depth rows [begin, end) as getPointXYZ(), with the colors registerColor() gives. */
+template<typename PixelT>
+void RegistrationImpl::pointColors(const PixelT *rgb_data, const RegistrationState &state, int begin, int end) const
+{
+  const float bad_point = std::numeric_limits<float>::quiet_NaN();
+  const float *p_filter_map = state.p_filter_map;
+
+  PointXYZRGB *point = state.points + begin * 512;
+  if(state.remove_invalid){
+    point = state.points;
+    for(int y = 0; y < begin; ++y)
+      point += state.row_points[y];
+  }
+
+  for(int y = begin; y < end; ++y){
+    const float *undistorted_data = (const float*)state.undistorted->data + y * 512;
+    const int *map_c_off = state.map_c_off + y * 512;
+
+    for(int x = 0; x < 512; ++x){
+      const float z = undistorted_data[x];
+      const float depth_val = z / 1000.0f;
+      if(!hasPoint(depth_val)){
+        if(state.remove_invalid)
+          continue;
+        point->x = point->y = point->z = bad_point;
+        point->rgb = 0;
+        ++point;
+        continue;
+      }
+
+      point->x = point_x[x] * depth_val;
+      point->y = point_y[y] * depth_val;
+      point->z = depth_val;
+
+      // check if offset is out of image, and for allowed depth noise
+      const int c_off = map_c_off[x];
+      point->rgb = c_off < 0 || (p_filter_map && (z - p_filter_map[c_off]) / z > filter_tolerance) ? 0 : pointColor(rgb_data[c_off]);
+      ++point;
+    }
+  }
 }
 
 void Registration::undistortDepth(const Frame *depth, Frame *undistorted) const
@@ -314,6 +1135,43 @@ void RegistrationImpl::undistortDepth(const Frame *depth, Frame *undistorted) co
   }
 }
 
+bool Registration::getColorRegion(float min_depth, float max_depth, int &x, int &y, int &width, int &height) const
+{
+  return impl_->getColorRegion(min_depth, max_depth, x, y, width, height);
+}
+
+bool RegistrationImpl::getColorRegion(float min_depth, float max_depth, int &x, int &y, int &width, int &height) const
+{
+  // the color x offset is monotonic in 1/z, so the depth limits bound it; depths are in millimeter
+  const float shift_near = color.shift_m / (min_depth * 1000.0f);
+  const float shift_far = color.shift_m / (max_depth * 1000.0f);
+  const float color_cx = color.cx + 0.5f; // same rounding as apply()
+
+  int min_x = 1920, max_x = -1, min_y = 1080, max_y = -1;
+  for(int i = 0; i < 512 * 424; ++i){
+    // pixels outside of the distorted depth image are never sampled
+    if(distort_map[i] < 0)
+      continue;
+
+    const int cy = depth_to_color_map_yi[i];
+    if(cy < 0 || cy >= 1080)
+      continue;
+
+    const int near_x = (int)((depth_to_color_map_x[i] + shift_near) * color.fx + color_cx);
+    const int far_x = (int)((depth_to_color_map_x[i] + shift_far) * color.fx + color_cx);
+    min_x = std::min(min_x, std::min(near_x, far_x));
+    max_x = std::max(max_x, std::max(near_x, far_x));
+    min_y = std::min(min_y, cy);
+    max_y = std::max(max_y, cy);
+  }
+
+  x = std::max(min_x, 0);
+  y = min_y;
+  width = std::min(max_x, 1919) - x + 1;
+  height = max_y - y + 1;
+  return width > 0 && height > 0;
+}
+
 void Registration::getPointXYZRGB (const Frame* undistorted, const Frame* registered, int r, int c, float& x, float& y, float& z, float& rgb) const
 {
   impl_->getPointXYZRGB(undistorted, registered, r, c, x, y, z, rgb);
@@ -360,16 +1218,34 @@ void RegistrationImpl::getPointXYZ (const Frame *undistorted, int r, int c, floa
 }
 
 Registration::Registration(Freenect2Device::IrCameraParams depth_p, Freenect2Device::ColorCameraParams rgb_p):
-  impl_(new RegistrationImpl(depth_p, rgb_p)) {}
+  impl_(new RegistrationImpl(depth_p, rgb_p))
+{
+  trackAllocation(MemoryRegistration, sizeof(RegistrationImpl));
+}
 
 Registration::~Registration()
 {
+  trackFree(MemoryRegistration, sizeof(RegistrationImpl));
   delete impl_;
 }
 
+RegistrationImpl::~RegistrationImpl()
+{
+  delete workers;
+  trackFree(MemoryRegistration, ((c_off_scratch.size() + color_index_cells.size()) * sizeof(int)) + ((filter_scratch.size() + undistorted_scratch.size()) * sizeof(float)) +
+            (color_index.size() * sizeof(ColorIndexEntry)));
+}
+
 RegistrationImpl::RegistrationImpl(Freenect2Device::IrCameraParams depth_p, Freenect2Device::ColorCameraParams rgb_p):
+  workers(NULL), color_index_enabled(false), color_index_width(0), color_index_height(0), color_index_shift(0), color_index_cols(0),
   depth(depth_p), color(rgb_p), filter_width_half(2), filter_height_half(1), filter_tolerance(0.01f)
 {
+  // LIBFREENECT2_REGISTRATION_THREADS sets the number of threads of apply(), by default up to 4.
+  const char *env = std::getenv("LIBFREENECT2_REGISTRATION_THREADS");
+  const int threads = env ? std::atoi(env) : std::min(4, (int)libfreenect2::thread::hardware_concurrency());
+  if (threads > 1)
+    workers = new RegistrationWorkers(std::min(threads, 424));
+
   float mx, my;
   int ix, iy, index;
   float rx, ry;
@@ -378,6 +1254,9 @@ RegistrationImpl::RegistrationImpl(Freenect2Device::IrCameraParams depth_p, Free
   float *map_y = depth_to_color_map_y;
   int *map_yi = depth_to_color_map_yi;
 
+  color_row_min = std::numeric_limits<float>::infinity();
+  color_row_max = -std::numeric_limits<float>::infinity();
+
   for (int y = 0; y < 424; y++) {
     for (int x = 0; x < 512; x++) {
       // compute the dirstored coordinate for current pixel
@@ -398,8 +1277,25 @@ RegistrationImpl::RegistrationImpl(Freenect2Device::IrCameraParams depth_p, Free
       *map_y++ = ry;
       // compute the y offset to minimize later computations
       *map_yi++ = (int)(ry + 0.5f);
+
+      if(index >= 0){
+        color_row_min = std::min(color_row_min, ry + 0.5f);
+        color_row_max = std::max(color_row_max, ry + 0.5f);
+      }
     }
   }
+
+  if(!(color_row_min <= color_row_max)){
+    color_row_min = 0.0f;
+    color_row_max = 1080.0f;
+  }
+
+  // the arithmetic of getPointXYZ() up to the depth
+  const float fx(1/depth.fx), fy(1/depth.fy);
+  for (int x = 0; x < 512; x++)
+    point_x[x] = (x + 0.5 - depth.cx) * fx;
+  for (int y = 0; y < 424; y++)
+    point_y[y] = (y + 0.5 - depth.cy) * fy;
 }
 
 } /* namespace libfreenect2 */
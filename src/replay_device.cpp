@@ -0,0 +1,397 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file replay_device.cpp Playback of raw stream recordings. */
+
+#include <libfreenect2/replay_device.h>
+#include <libfreenect2/stream_recorder.h>
+#include <libfreenect2/depth_packet_stream_parser.h>
+#include <libfreenect2/depth_packet_processor.h>
+#include <libfreenect2/rgb_packet_processor.h>
+#include <libfreenect2/rgb_packet_stream_parser.h>
+#include <libfreenect2/logging.h>
+
+#include <cstring>
+
+namespace libfreenect2
+{
+
+static const size_t DEPTH_SUBPACKET_SIZE = 512*424*11/8;
+
+/* Whether a record carries the last bytes of a color frame. */
+static bool isRgbFrameEnd(const unsigned char *data, size_t length)
+{
+  RgbPacketFooter footer;
+  if (length < sizeof(footer))
+    return false;
+  memcpy(&footer, data + length - sizeof(footer), sizeof(footer));
+  return footer.magic_header == 0x39393939 && footer.magic_footer == 0x42424242;
+}
+
+/* Whether a record carries the footer of the last depth subpacket. */
+static bool isDepthFrameEnd(const unsigned char *data, size_t length)
+{
+  DepthSubPacketFooter footer;
+  if (length < sizeof(footer))
+    return false;
+  memcpy(&footer, data + length - sizeof(footer), sizeof(footer));
+  return footer.subsequence == 9 && footer.length == DEPTH_SUBPACKET_SIZE;
+}
+
+ReplayDevice::ReplayDevice(const PacketPipeline *pipeline, Freenect2::ReplayMode mode, float rate) :
+  pipeline_(pipeline),
+  mode_(mode),
+  rate_(rate),
+  position_(0),
+  serial_("<unknown>"),
+  firmware_("<unknown>"),
+  streaming_(false),
+  enable_rgb_(false),
+  enable_depth_(false),
+  running_(false),
+  thread_(NULL)
+{
+  memset(&p0_tables_, 0, sizeof(p0_tables_));
+  memset(&xtable_, 0, sizeof(xtable_));
+  memset(&ztable_, 0, sizeof(ztable_));
+  memset(&lut_, 0, sizeof(lut_));
+  memset(&ir_camera_params_, 0, sizeof(ir_camera_params_));
+  memset(&rgb_camera_params_, 0, sizeof(rgb_camera_params_));
+  statistics_.attach(pipeline_);
+}
+
+ReplayDevice::~ReplayDevice()
+{
+  close();
+  delete pipeline_;
+}
+
+bool ReplayDevice::open(const std::string &path)
+{
+  LOG_INFO << "opening " << path;
+
+  if (!file_.open(path))
+    return false;
+  unsigned char *map = file_.data();
+  const size_t map_size = file_.size();
+
+  RecordingFileHeader header;
+  if (map_size < sizeof(header))
+  {
+    LOG_ERROR << path << " is not a recording";
+    file_.close();
+    return false;
+  }
+  memcpy(&header, map, sizeof(header));
+  if (memcmp(header.magic, "LF2RAW\0\0", sizeof(header.magic)) != 0 || header.version != StreamRecorder::Version)
+  {
+    LOG_ERROR << path << " is not a recording of version " << StreamRecorder::Version;
+    file_.close();
+    return false;
+  }
+
+  size_t offset = sizeof(header);
+  while (offset + sizeof(RecordHeader) <= map_size)
+  {
+    RecordHeader rh;
+    memcpy(&rh, map + offset, sizeof(rh));
+    size_t padded = (rh.length + (size_t)7) & ~(size_t)7;
+    if (padded > map_size - offset - sizeof(rh))
+    {
+      LOG_WARNING << "recording is truncated at offset " << offset;
+      break;
+    }
+
+    Record r;
+    r.type = rh.type;
+    r.length = rh.length;
+    r.time_ns = rh.time_ns;
+    r.data = map + offset + sizeof(rh);
+    offset += sizeof(rh) + padded;
+
+    switch (r.type)
+    {
+    case StreamRecorder::RgbData:
+    case StreamRecorder::IrData:
+      records_.push_back(r);
+      break;
+    case StreamRecorder::P0Tables:
+      p0_tables_ = r;
+      break;
+    case StreamRecorder::XTable:
+      if (r.length == DepthPacketProcessor::TABLE_SIZE * sizeof(float))
+        xtable_ = r;
+      break;
+    case StreamRecorder::ZTable:
+      if (r.length == DepthPacketProcessor::TABLE_SIZE * sizeof(float))
+        ztable_ = r;
+      break;
+    case StreamRecorder::LookupTable:
+      if (r.length == DepthPacketProcessor::LUT_SIZE * sizeof(short))
+        lut_ = r;
+      break;
+    case StreamRecorder::IrParams:
+      if (r.length == sizeof(ir_camera_params_))
+        memcpy(&ir_camera_params_, r.data, r.length);
+      break;
+    case StreamRecorder::ColorParams:
+      if (r.length == sizeof(rgb_camera_params_))
+        memcpy(&rgb_camera_params_, r.data, r.length);
+      break;
+    case StreamRecorder::SerialNumber:
+      serial_.assign(reinterpret_cast<const char *>(r.data), r.length);
+      break;
+    case StreamRecorder::FirmwareVersion:
+      firmware_.assign(reinterpret_cast<const char *>(r.data), r.length);
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (p0_tables_.data == NULL || xtable_.data == NULL || ztable_.data == NULL || lut_.data == NULL)
+    LOG_WARNING << "recording has no depth calibration";
+
+  LOG_INFO << "opened recording of " << serial_ << " with " << records_.size() << " packets";
+  return true;
+}
+
+std::string ReplayDevice::getSerialNumber()
+{
+  return serial_;
+}
+
+std::string ReplayDevice::getFirmwareVersion()
+{
+  return firmware_;
+}
+
+Freenect2Device::ColorCameraParams ReplayDevice::getColorCameraParams()
+{
+  return rgb_camera_params_;
+}
+
+Freenect2Device::IrCameraParams ReplayDevice::getIrCameraParams()
+{
+  return ir_camera_params_;
+}
+
+void ReplayDevice::setColorCameraParams(const Freenect2Device::ColorCameraParams &params)
+{
+  rgb_camera_params_ = params;
+}
+
+void ReplayDevice::setIrCameraParams(const Freenect2Device::IrCameraParams &params)
+{
+  // The depth processor keeps using the recorded tables.
+  ir_camera_params_ = params;
+}
+
+void ReplayDevice::setConfiguration(const Freenect2Device::Config &config)
+{
+  DepthPacketProcessor *proc = pipeline_->getDepthPacketProcessor();
+  if (proc != 0)
+    proc->setConfiguration(config);
+  RgbPacketProcessor *rgb_proc = pipeline_->getRgbPacketProcessor();
+  if (rgb_proc != 0)
+    rgb_proc->setConfiguration(config);
+}
+
+void ReplayDevice::setColorFrameListener(FrameListener *rgb_frame_listener)
+{
+  if (pipeline_->getRgbPacketProcessor() != 0)
+    pipeline_->getRgbPacketProcessor()->setFrameListener(statistics_.colorListener(rgb_frame_listener));
+}
+
+void ReplayDevice::setIrAndDepthFrameListener(FrameListener *ir_frame_listener)
+{
+  if (pipeline_->getDepthPacketProcessor() != 0)
+    pipeline_->getDepthPacketProcessor()->setFrameListener(statistics_.depthListener(ir_frame_listener));
+}
+
+bool ReplayDevice::start()
+{
+  return startStreams(true, true);
+}
+
+bool ReplayDevice::startStreams(bool rgb, bool depth)
+{
+  LOG_INFO << "starting...";
+  if (file_.data() == NULL || streaming_) return false;
+
+  DepthPacketProcessor *proc = pipeline_->getDepthPacketProcessor();
+  if (proc != 0)
+  {
+    if (p0_tables_.data != NULL)
+      proc->loadP0TablesFromCommandResponse(p0_tables_.data, p0_tables_.length);
+    if (xtable_.data != NULL && ztable_.data != NULL)
+      proc->loadXZTables(reinterpret_cast<float *>(xtable_.data), reinterpret_cast<float *>(ztable_.data));
+    if (lut_.data != NULL)
+      proc->loadLookupTable(reinterpret_cast<short *>(lut_.data));
+  }
+
+  if (position_ >= records_.size())
+    position_ = 0;
+
+  statistics_.reset();
+  enable_rgb_ = rgb;
+  enable_depth_ = depth;
+  running_ = true;
+  streaming_ = true;
+  thread_ = new libfreenect2::thread(&ReplayDevice::static_execute, this);
+
+  LOG_INFO << "started";
+  return true;
+}
+
+bool ReplayDevice::stop()
+{
+  LOG_INFO << "stopping...";
+  if (!streaming_)
+  {
+    LOG_INFO << "already stopped, doing nothing";
+    return false;
+  }
+
+  running_ = false;
+  thread_->join();
+  delete thread_;
+  thread_ = NULL;
+  streaming_ = false;
+
+  LOG_INFO << "stopped";
+  return true;
+}
+
+bool ReplayDevice::close()
+{
+  LOG_INFO << "closing...";
+  if (streaming_)
+    stop();
+
+  if (pipeline_->getRgbPacketProcessor() != 0)
+    pipeline_->getRgbPacketProcessor()->setFrameListener(0);
+
+  if (pipeline_->getDepthPacketProcessor() != 0)
+    pipeline_->getDepthPacketProcessor()->setFrameListener(0);
+
+  file_.close();
+  records_.clear();
+  LOG_INFO << "closed";
+  return true;
+}
+
+Freenect2Device::Statistics ReplayDevice::getStatistics()
+{
+  return statistics_.getStatistics();
+}
+
+void ReplayDevice::static_execute(void *cookie)
+{
+  static_cast<ReplayDevice *>(cookie)->execute();
+}
+
+/* Sleep in short steps so that stop() is not delayed by long gaps. */
+bool ReplayDevice::waitUntil(uint64_t time_ns)
+{
+  for (;;)
+  {
+    if (!running_)
+      return false;
+    uint64_t now = StreamRecorder::now();
+    if (now >= time_ns)
+      return true;
+    uint64_t remaining_us = (time_ns - now) / 1000;
+    this_thread::sleep_for(chrono::microseconds(remaining_us < 10000 ? remaining_us : 10000));
+  }
+}
+
+/* Wait until a completed frame will not be dropped by the processor. */
+bool ReplayDevice::waitForParser(DataCallback *parser)
+{
+  while (!parser->ready())
+  {
+    if (!running_)
+      return false;
+    this_thread::sleep_for(chrono::microseconds(100));
+  }
+  return true;
+}
+
+void ReplayDevice::execute()
+{
+  this_thread::set_name("Replay");
+
+  DataCallback *parsers[2] = {pipeline_->getRgbPacketParser(), pipeline_->getIrPacketParser()};
+  const bool enabled[2] = {enable_rgb_, enable_depth_};
+
+  const uint64_t start_time = StreamRecorder::now();
+  const uint64_t first_record_time = position_ < records_.size() ? records_[position_].time_ns : 0;
+  const uint64_t frame_period = rate_ > 0 ? (uint64_t)(1e9 / rate_) : 0;
+  size_t frames[2] = {0, 0};
+  bool frame_start[2] = {true, true};
+
+  for (; position_ < records_.size() && running_; ++position_)
+  {
+    Record &r = records_[position_];
+    const int stream = r.type == StreamRecorder::RgbData ? 0 : 1;
+    if (!enabled[stream])
+      continue;
+
+    const bool frame_end = stream == 0 ? isRgbFrameEnd(r.data, r.length) : isDepthFrameEnd(r.data, r.length);
+
+    bool proceed = true;
+    switch (mode_)
+    {
+    case Freenect2::ReplayFixedRate:
+      if (frame_start[stream])
+        proceed = waitUntil(start_time + frames[stream]++ * frame_period);
+      break;
+    case Freenect2::ReplayFastest:
+      if (frame_end)
+        proceed = waitForParser(parsers[stream]);
+      break;
+    default:
+      proceed = waitUntil(start_time + (r.time_ns > first_record_time ? r.time_ns - first_record_time : 0));
+      break;
+    }
+    if (!proceed)
+      break;
+
+    parsers[stream]->onDataReceived(r.data, r.length);
+    frame_start[stream] = frame_end;
+  }
+
+  if (position_ >= records_.size())
+  {
+    // The depth parser holds the last packet back until more data arrives.
+    if (enable_depth_ && waitForParser(parsers[1]))
+      parsers[1]->flush();
+    LOG_INFO << "end of recording";
+  }
+}
+
+} /* namespace libfreenect2 */
@@ -45,6 +45,11 @@ RgbPacketProcessor::~RgbPacketProcessor()
 {
 }
 
+void RgbPacketProcessor::setConfiguration(const libfreenect2::RgbPacketProcessor::Config &config)
+{
+  config_ = config;
+}
+
 void RgbPacketProcessor::setFrameListener(libfreenect2::FrameListener *listener)
 {
   listener_ = listener;
@@ -29,6 +29,8 @@
 #include <libfreenect2/config.h>
 #include <libfreenect2/rgb_packet_stream_parser.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/statistics.h>
+#include <libfreenect2/trace_events.h>
 #include <memory.h>
 
 namespace libfreenect2
@@ -43,25 +45,10 @@ LIBFREENECT2_PACK(struct RawRgbPacket
   unsigned char jpeg_buffer[0];
 });
 
-// starting from JPEG EOI: 0xff 0xd9
-// char pad_0xa5[]; //0-3 bytes alignment of 0xa5
-// char filler[filler_length] = "ZZZZ...";
-LIBFREENECT2_PACK(struct RgbPacketFooter {
-  uint32_t magic_header; // is '9999' equal 0x39393939
-  uint32_t sequence;
-  uint32_t filler_length;
-  uint32_t unknown1; // seems 0 always
-  uint32_t unknown2; // seems 0 always
-  uint32_t timestamp;
-  float exposure; // ? ranges from 0.5 to about 60.0 with powerfull light at camera or totally covered
-  float gain; // ? ranges from 1.0 when camera is clear to 1.5 when camera is covered.
-  uint32_t magic_footer; // is 'BBBB' equal 0x42424242
-  uint32_t packet_size;
-  float gamma; // ranges from 1.0f to about 6.4 when camera is fully covered
-  uint32_t unknown4[3]; // seems to be 0 all the time.
-});
-
 RgbPacketStreamParser::RgbPacketStreamParser() :
+    loss_callback_(0),
+    histogram_(0),
+    packet_start_(0),
     buffer_size_(2*1024*1024),
     processor_(noopProcessor<RgbPacket>())
 {
@@ -79,6 +66,21 @@ void RgbPacketStreamParser::setPacketProcessor(BaseRgbPacketProcessor *processor
   processor_->allocateBuffer(packet_, buffer_size_);
 }
 
+void RgbPacketStreamParser::setDataLossCallback(DataLossCallback *callback)
+{
+  loss_callback_ = callback;
+}
+
+bool RgbPacketStreamParser::ready()
+{
+  return processor_->ready();
+}
+
+void RgbPacketStreamParser::setLatencyHistogram(LatencyHistogram *histogram)
+{
+  histogram_ = histogram;
+}
+
 void RgbPacketStreamParser::onDataReceived(unsigned char* buffer, size_t length)
 {
   if (packet_.memory == NULL || packet_.memory->data == NULL)
@@ -91,6 +93,9 @@ void RgbPacketStreamParser::onDataReceived(unsigned char* buffer, size_t length)
   // package containing data
   if(length > 0)
   {
+    if(fb.length == 0 && histogram_)
+      packet_start_ = LatencyHistogram::now();
+
     if(fb.length + length <= fb.capacity)
     {
       memcpy(fb.data + fb.length, buffer, length);
@@ -100,6 +105,8 @@ void RgbPacketStreamParser::onDataReceived(unsigned char* buffer, size_t length)
     {
       LOG_INFO << "buffer overflow!";
       fb.length = 0;
+      if(loss_callback_)
+        loss_callback_->onDataLost(1);
       return;
     }
 
@@ -117,6 +124,8 @@ void RgbPacketStreamParser::onDataReceived(unsigned char* buffer, size_t length)
       {
         LOG_INFO << "packetsize or sequence doesn't match!";
         fb.length = 0;
+        if(loss_callback_)
+          loss_callback_->onDataLost(1);
         return;
       }
 
@@ -159,6 +168,10 @@ void RgbPacketStreamParser::onDataReceived(unsigned char* buffer, size_t length)
         rgb_packet.jpeg_buffer = raw_packet->jpeg_buffer;
         rgb_packet.jpeg_buffer_length = jpeg_length;
 
+        if(histogram_)
+          histogram_->recordSince(packet_start_);
+        traceInstant("color_handoff", rgb_packet.sequence);
+
         // call the processor
         processor_->process(rgb_packet);
         //allocatePacket() should never return NULL when processor is ready()
@@ -167,6 +180,7 @@ void RgbPacketStreamParser::onDataReceived(unsigned char* buffer, size_t length)
       else
       {
         LOG_DEBUG << "skipping rgb packet!";
+        traceInstant("color_skipped", raw_packet->sequence);
       }
 
       // reset front buffer
@@ -0,0 +1,283 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file statistics.cpp Latency histograms and memory accounting. */
+
+#include <libfreenect2/statistics.h>
+#include <libfreenect2/data_callback.h>
+#include <libfreenect2/trace_events.h>
+
+#include <cmath>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace libfreenect2
+{
+
+Freenect2Device::LatencyStatistics::LatencyStatistics() :
+  count(0), p50(0), p99(0), p999(0), max(0)
+{
+}
+
+Freenect2Device::MemoryStatistics::MemoryStatistics() :
+  current(0), peak(0), allocations(0), rate(0)
+{
+}
+
+static MemoryCounters memory_counters_[MemoryTagCount];
+
+/* Never destroyed, static objects of the application may free memory
+ * after the destructors of this library ran.
+ */
+static libfreenect2::mutex &memoryMutex()
+{
+  static libfreenect2::mutex *mutex = new libfreenect2::mutex;
+  return *mutex;
+}
+
+void trackAllocation(MemoryTag tag, size_t bytes)
+{
+  libfreenect2::lock_guard l(memoryMutex());
+  MemoryCounters &c = memory_counters_[tag];
+  c.current += bytes;
+  if (c.current > c.peak)
+    c.peak = c.current;
+  c.allocations++;
+  c.allocated_bytes += bytes;
+}
+
+void trackFree(MemoryTag tag, size_t bytes)
+{
+  libfreenect2::lock_guard l(memoryMutex());
+  MemoryCounters &c = memory_counters_[tag];
+  c.current -= bytes < c.current ? bytes : c.current;
+}
+
+MemoryCounters getMemoryCounters(MemoryTag tag)
+{
+  libfreenect2::lock_guard l(memoryMutex());
+  return memory_counters_[tag];
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+  reset();
+}
+
+/* Values below SubBucketCount have a bucket each. Above, each power of two
+ * range is split into SubBucketHalf buckets, whose width is at most 1/128 of
+ * their values.
+ */
+int LatencyHistogram::index(uint64_t microseconds)
+{
+  if (microseconds >= ((uint64_t)1 << 32))
+    microseconds = ((uint64_t)1 << 32) - 1;
+  if (microseconds < (uint64_t)SubBucketCount)
+    return (int)microseconds;
+
+  int shift = 0;
+  while ((microseconds >> shift) >= (uint64_t)SubBucketCount)
+    shift++;
+  return SubBucketCount + (shift - 1) * SubBucketHalf + (int)(microseconds >> shift) - SubBucketHalf;
+}
+
+uint64_t LatencyHistogram::highestEquivalentValue(int index)
+{
+  if (index < SubBucketCount)
+    return index;
+
+  int shift = (index - SubBucketCount) / SubBucketHalf + 1;
+  uint64_t sub_bucket = (index - SubBucketCount) % SubBucketHalf + SubBucketHalf;
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds)
+{
+  uint64_t microseconds = nanoseconds / 1000;
+  int i = index(microseconds);
+
+  libfreenect2::lock_guard l(mutex_);
+  counts_[i]++;
+  total_++;
+  if (microseconds > max_)
+    max_ = microseconds;
+}
+
+void LatencyHistogram::reset()
+{
+  libfreenect2::lock_guard l(mutex_);
+  std::memset(counts_, 0, sizeof(counts_));
+  total_ = 0;
+  max_ = 0;
+}
+
+Freenect2Device::LatencyStatistics LatencyHistogram::getStatistics() const
+{
+  static const double percentiles[3] = {0.5, 0.99, 0.999};
+  double values[3] = {0, 0, 0};
+  Freenect2Device::LatencyStatistics stats;
+
+  libfreenect2::lock_guard l(mutex_);
+  if (total_ == 0)
+    return stats;
+
+  uint64_t seen = 0;
+  int p = 0;
+  for (int i = 0; i < BucketCount && p < 3; ++i)
+  {
+    seen += counts_[i];
+    // nearest rank
+    while (p < 3 && seen >= (uint64_t)std::ceil(percentiles[p] * total_))
+    {
+      uint64_t value = highestEquivalentValue(i);
+      values[p++] = (value < max_ ? value : max_) * 1e-3;
+    }
+  }
+
+  stats.count = total_;
+  stats.p50 = values[0];
+  stats.p99 = values[1];
+  stats.p999 = values[2];
+  stats.max = max_ * 1e-3;
+  return stats;
+}
+
+uint64_t LatencyHistogram::now()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  uint64_t f = frequency.QuadPart, c = counter.QuadPart;
+  return c / f * 1000000000u + c % f * 1000000000u / f;
+#else
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+#endif
+}
+
+LatencyFrameListener::LatencyFrameListener(LatencyHistogram *histogram) :
+  histogram_(histogram),
+  listener_(0)
+{
+}
+
+bool LatencyFrameListener::onNewFrame(Frame::Type type, Frame *frame)
+{
+  FrameListener *listener = listener_;
+  if (listener == 0)
+    return false;
+
+  TraceScope trace("listener", frame->sequence);
+  uint64_t start = LatencyHistogram::now();
+  bool taken = listener->onNewFrame(type, frame);
+  histogram_->recordSince(start);
+  return taken;
+}
+
+DeviceStatistics::DeviceStatistics() :
+  color_listener_(&listener_),
+  depth_listener_(&listener_)
+{
+  reset();
+}
+
+void DeviceStatistics::attach(const PacketPipeline *pipeline)
+{
+  pipeline->getRgbPacketParser()->setLatencyHistogram(&color_assembly_);
+  pipeline->getIrPacketParser()->setLatencyHistogram(&depth_assembly_);
+  pipeline->setLatencyHistograms(&color_decode_, &depth_decode_);
+}
+
+void DeviceStatistics::detach(const PacketPipeline *pipeline)
+{
+  pipeline->getRgbPacketParser()->setLatencyHistogram(0);
+  pipeline->getIrPacketParser()->setLatencyHistogram(0);
+  pipeline->setLatencyHistograms(0, 0);
+}
+
+FrameListener *DeviceStatistics::colorListener(FrameListener *listener)
+{
+  color_listener_.setListener(listener);
+  return listener != 0 ? &color_listener_ : 0;
+}
+
+FrameListener *DeviceStatistics::depthListener(FrameListener *listener)
+{
+  depth_listener_.setListener(listener);
+  return listener != 0 ? &depth_listener_ : 0;
+}
+
+void DeviceStatistics::reset()
+{
+  color_assembly_.reset();
+  depth_assembly_.reset();
+  color_decode_.reset();
+  depth_decode_.reset();
+  listener_.reset();
+
+  start_ns_ = LatencyHistogram::now();
+  for (int i = 0; i < MemoryTagCount; ++i)
+    start_memory_[i] = getMemoryCounters((MemoryTag)i);
+}
+
+Freenect2Device::MemoryStatistics DeviceStatistics::memoryStatistics(MemoryTag tag) const
+{
+  MemoryCounters c = getMemoryCounters(tag);
+  const MemoryCounters &start = start_memory_[tag];
+  double seconds = (LatencyHistogram::now() - start_ns_) * 1e-9;
+
+  Freenect2Device::MemoryStatistics stats;
+  stats.current = c.current;
+  stats.peak = c.peak;
+  stats.allocations = c.allocations - start.allocations;
+  stats.rate = seconds > 0 ? (c.allocated_bytes - start.allocated_bytes) / seconds : 0;
+  return stats;
+}
+
+Freenect2Device::Statistics DeviceStatistics::getStatistics() const
+{
+  Freenect2Device::Statistics stats;
+  stats.color_assembly = color_assembly_.getStatistics();
+  stats.depth_assembly = depth_assembly_.getStatistics();
+  stats.color_decode = color_decode_.getStatistics();
+  stats.depth_decode = depth_decode_.getStatistics();
+  stats.listener = listener_.getStatistics();
+  stats.usb_transfers = memoryStatistics(MemoryUsbTransfers);
+  stats.packet_buffers = memoryStatistics(MemoryPacketBuffers);
+  stats.depth_processing = memoryStatistics(MemoryDepthProcessing);
+  stats.frames = memoryStatistics(MemoryFrames);
+  stats.registration = memoryStatistics(MemoryRegistration);
+  return stats;
+}
+
+} /* namespace libfreenect2 */
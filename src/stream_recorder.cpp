@@ -0,0 +1,298 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file stream_recorder.cpp Recording of raw device streams. */
+
+#include <libfreenect2/stream_recorder.h>
+#include <libfreenect2/threading.h>
+#include <libfreenect2/logging.h>
+#include <libfreenect2/statistics.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+namespace libfreenect2
+{
+
+/* 16 blocks of 8MB buffer more than a second of both streams. */
+static const size_t BLOCK_SIZE = 8 * 1024 * 1024;
+static const size_t MAX_BLOCKS = 16;
+
+class StreamRecorderImpl
+{
+public:
+  struct Block
+  {
+    unsigned char *data;
+    size_t length;
+  };
+
+  FILE *file_;
+  libfreenect2::mutex mutex_;
+  libfreenect2::condition_variable cond_;
+  std::vector<Block> free_;
+  std::deque<Block> full_;
+  Block current_;
+  size_t num_blocks_;
+  size_t dropped_;
+  bool shutdown_;
+  libfreenect2::thread *thread_;
+
+  StreamRecorderImpl():
+    file_(NULL),
+    num_blocks_(0),
+    dropped_(0),
+    shutdown_(false),
+    thread_(NULL)
+  {
+    current_.data = NULL;
+    current_.length = 0;
+  }
+
+  static void static_execute(void *cookie)
+  {
+    static_cast<StreamRecorderImpl *>(cookie)->execute();
+  }
+
+  void execute()
+  {
+    this_thread::set_name("Recorder");
+    bool failed = false;
+
+    for(;;)
+    {
+      Block b;
+      {
+        libfreenect2::unique_lock l(mutex_);
+        while(full_.empty() && !shutdown_)
+          WAIT_CONDITION(cond_, mutex_, l);
+        if(full_.empty())
+          break;
+        b = full_.front();
+        full_.pop_front();
+      }
+
+      if(!failed && fwrite(b.data, 1, b.length, file_) != b.length)
+      {
+        LOG_ERROR << "failed to write recording: " << strerror(errno);
+        failed = true;
+      }
+
+      {
+        libfreenect2::lock_guard l(mutex_);
+        free_.push_back(b);
+      }
+    }
+  }
+
+  /* Called with mutex_ held. */
+  bool nextBlock()
+  {
+    if(current_.data != NULL)
+    {
+      full_.push_back(current_);
+      current_.data = NULL;
+      cond_.notify_one();
+    }
+
+    if(!free_.empty())
+    {
+      current_ = free_.back();
+      free_.pop_back();
+    }
+    else if(num_blocks_ < MAX_BLOCKS)
+    {
+      current_.data = new unsigned char[BLOCK_SIZE];
+      num_blocks_++;
+    }
+    else
+    {
+      return false;
+    }
+    current_.length = 0;
+    return true;
+  }
+};
+
+StreamRecorder::StreamRecorder():
+  impl_(new StreamRecorderImpl)
+{
+}
+
+StreamRecorder::~StreamRecorder()
+{
+  close();
+  delete impl_;
+}
+
+bool StreamRecorder::open(const std::string &path)
+{
+  close();
+
+  impl_->file_ = fopen(path.c_str(), "wb");
+  if(impl_->file_ == NULL)
+  {
+    LOG_ERROR << "failed to open recording " << path << ": " << strerror(errno);
+    return false;
+  }
+  // Blocks are already large; skip stdio buffering.
+  setvbuf(impl_->file_, NULL, _IONBF, 0);
+
+  RecordingFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "LF2RAW", 6);
+  header.version = Version;
+  if(fwrite(&header, sizeof(header), 1, impl_->file_) != 1)
+  {
+    LOG_ERROR << "failed to write recording " << path << ": " << strerror(errno);
+    fclose(impl_->file_);
+    impl_->file_ = NULL;
+    return false;
+  }
+
+  impl_->shutdown_ = false;
+  impl_->dropped_ = 0;
+  impl_->thread_ = new libfreenect2::thread(&StreamRecorderImpl::static_execute, impl_);
+  LOG_INFO << "recording raw streams to " << path;
+  return true;
+}
+
+void StreamRecorder::close()
+{
+  if(impl_->thread_ == NULL)
+    return;
+
+  {
+    libfreenect2::lock_guard l(impl_->mutex_);
+    if(impl_->current_.data != NULL)
+    {
+      impl_->full_.push_back(impl_->current_);
+      impl_->current_.data = NULL;
+    }
+    impl_->shutdown_ = true;
+  }
+  impl_->cond_.notify_one();
+  impl_->thread_->join();
+  delete impl_->thread_;
+  impl_->thread_ = NULL;
+
+  fclose(impl_->file_);
+  impl_->file_ = NULL;
+
+  for(size_t i = 0; i < impl_->free_.size(); ++i)
+    delete[] impl_->free_[i].data;
+  impl_->free_.clear();
+  impl_->num_blocks_ = 0;
+
+  if(impl_->dropped_ > 0)
+    LOG_WARNING << impl_->dropped_ << " records were dropped from the recording";
+}
+
+bool StreamRecorder::isOpen() const
+{
+  return impl_->thread_ != NULL;
+}
+
+void StreamRecorder::write(RecordType type, const void *data, size_t length)
+{
+  size_t padded = (length + 7) & ~(size_t)7;
+  size_t size = sizeof(RecordHeader) + padded;
+
+  RecordHeader header;
+  header.type = type;
+  header.length = length;
+  header.time_ns = now();
+
+  libfreenect2::lock_guard l(impl_->mutex_);
+  if(impl_->thread_ == NULL)
+    return;
+
+  if(size > BLOCK_SIZE)
+  {
+    impl_->dropped_++;
+    return;
+  }
+
+  StreamRecorderImpl::Block &b = impl_->current_;
+  if(b.data == NULL || b.length + size > BLOCK_SIZE)
+  {
+    if(!impl_->nextBlock())
+    {
+      if(impl_->dropped_++ == 0)
+        LOG_WARNING << "recording cannot keep up, dropping records";
+      return;
+    }
+  }
+
+  memcpy(b.data + b.length, &header, sizeof(header));
+  memcpy(b.data + b.length + sizeof(header), data, length);
+  memset(b.data + b.length + sizeof(header) + length, 0, padded - length);
+  b.length += size;
+}
+
+size_t StreamRecorder::getDroppedRecords() const
+{
+  libfreenect2::lock_guard l(impl_->mutex_);
+  return impl_->dropped_;
+}
+
+uint64_t StreamRecorder::now()
+{
+  return LatencyHistogram::now();
+}
+
+RecordingDataCallback::RecordingDataCallback(DataCallback *parser, StreamRecorder *recorder, StreamRecorder::RecordType type):
+  parser_(parser),
+  recorder_(recorder),
+  type_(type)
+{
+}
+
+void RecordingDataCallback::onDataReceived(unsigned char *buffer, size_t n)
+{
+  recorder_->write(type_, buffer, n);
+  parser_->onDataReceived(buffer, n);
+}
+
+void RecordingDataCallback::setDataLossCallback(DataLossCallback *callback)
+{
+  parser_->setDataLossCallback(callback);
+}
+
+bool RecordingDataCallback::ready()
+{
+  return parser_->ready();
+}
+
+void RecordingDataCallback::flush()
+{
+  parser_->flush();
+}
+
+} /* namespace libfreenect2 */
@@ -0,0 +1,307 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file thread_policy.cpp Thread placement and scheduling. */
+
+#include <libfreenect2/thread_policy.h>
+#include <libfreenect2/logging.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace libfreenect2
+{
+
+#if defined(__linux__)
+static const long MAX_CPUS = CPU_SETSIZE;
+#else
+static const long MAX_CPUS = 1024;
+#endif
+
+/** Parse one CPU id, rejecting ids from MAX_CPUS on. */
+static bool parseCpu(const char *begin, const char **end, int &cpu)
+{
+  char *stop;
+  errno = 0;
+  long value = std::strtol(begin, &stop, 10);
+  if (stop == begin || errno != 0 || value < 0 || value >= MAX_CPUS)
+    return false;
+  cpu = (int)value;
+  *end = stop;
+  return true;
+}
+
+/** Parse a CPU list like "0-3,8". Ids must be below MAX_CPUS, which also
+ * bounds the size of the list.
+ */
+static bool parseCpuList(const std::string &list, std::vector<int> &cpus)
+{
+  std::istringstream in(list);
+  std::string range;
+  while (std::getline(in, range, ','))
+  {
+    const char *p = range.c_str();
+    int first, last;
+    if (!parseCpu(p, &p, first))
+      return false;
+    last = first;
+    if (*p == '-' && !parseCpu(p + 1, &p, last))
+      return false;
+    if (*p != '\0' || last < first)
+      return false;
+    for (int cpu = first; cpu <= last; ++cpu)
+      cpus.push_back(cpu);
+  }
+  return true;
+}
+
+static bool readNodeCpus(int node, std::vector<int> &cpus)
+{
+  std::ostringstream path;
+  path << "/sys/devices/system/node/node" << node << "/cpulist";
+  std::ifstream in(path.str().c_str());
+  std::string list;
+  if (!std::getline(in, list))
+    return false;
+  return parseCpuList(list, cpus);
+}
+
+static std::string formatCpuList(const std::vector<int> &cpus)
+{
+  std::ostringstream out;
+  for (size_t i = 0; i < cpus.size(); ++i)
+    out << (i ? "," : "") << cpus[i];
+  return out.str();
+}
+
+void ThreadPolicyReport::record(const ThreadPolicy &applied, const std::string &failures)
+{
+  libfreenect2::lock_guard guard(mutex_);
+  applied_ = applied;
+  failures_ = failures;
+}
+
+ThreadPolicy ThreadPolicyReport::applied() const
+{
+  libfreenect2::lock_guard guard(mutex_);
+  return applied_;
+}
+
+std::string ThreadPolicyReport::failures() const
+{
+  libfreenect2::lock_guard guard(mutex_);
+  return failures_;
+}
+
+// Constructed before main(), unlike function-local statics with C++98 compilers.
+static ThreadPolicyReport reports[3];
+
+ThreadPolicyReport &threadPolicyReport(Freenect2::ThreadType type)
+{
+  return reports[type];
+}
+
+void applyThreadPolicy(const char *name, const ThreadPolicy &policy, ThreadPolicyReport *report)
+{
+  ThreadPolicy result;
+  std::ostringstream applied, failed;
+
+  if (policy.cpus.empty() && policy.numa_node < 0 && policy.realtime_priority == 0 && policy.nice == 0)
+  {
+    if (report != NULL)
+      report->record(result, std::string());
+    return;
+  }
+
+  std::vector<int> cpus;
+  bool on_node = false;
+  if (!policy.cpus.empty() && !parseCpuList(policy.cpus, cpus))
+  {
+    failed << " invalid cpu list '" << policy.cpus << "' (ids must be below " << MAX_CPUS << ");";
+    cpus.clear();
+  }
+  if (policy.numa_node >= 0)
+  {
+    std::vector<int> node_cpus;
+    on_node = readNodeCpus(policy.numa_node, node_cpus);
+    if (!on_node)
+      failed << " unknown numa node " << policy.numa_node << ";";
+    else if (cpus.empty())
+      cpus = node_cpus;
+    else
+    {
+      std::vector<int> both;
+      std::sort(cpus.begin(), cpus.end());
+      std::sort(node_cpus.begin(), node_cpus.end());
+      std::set_intersection(cpus.begin(), cpus.end(), node_cpus.begin(), node_cpus.end(), std::back_inserter(both));
+      if (both.empty())
+        failed << " no cpus of '" << policy.cpus << "' on numa node " << policy.numa_node << ";";
+      cpus = both;
+    }
+  }
+
+  if (!cpus.empty())
+  {
+#if defined(__linux__)
+    // parseCpuList() keeps the ids below CPU_SETSIZE, which CPU_SET() does not check.
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); ++i)
+      CPU_SET(cpus[i], &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == 0)
+    {
+      result.cpus = formatCpuList(cpus);
+      applied << " cpus " << result.cpus << ";";
+    }
+    else
+      failed << " cpus " << formatCpuList(cpus) << ": " << strerror(errno) << ";";
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    std::vector<int> in_mask;
+    for (size_t i = 0; i < cpus.size(); ++i)
+      if (cpus[i] < (int)(8 * sizeof(mask)))
+      {
+        mask |= (DWORD_PTR)1 << cpus[i];
+        in_mask.push_back(cpus[i]);
+      }
+    if (mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0)
+    {
+      result.cpus = formatCpuList(in_mask);
+      applied << " cpus " << result.cpus << ";";
+    }
+    else
+      failed << " cpus " << formatCpuList(cpus) << ";";
+#else
+    failed << " cpu pinning is not supported on this platform;";
+#endif
+    if (on_node && !result.cpus.empty())
+      result.numa_node = policy.numa_node;
+  }
+
+  if (policy.realtime_priority > 0)
+  {
+#if defined(_WIN32)
+    if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+    {
+      result.realtime_priority = policy.realtime_priority;
+      applied << " time critical priority;";
+    }
+    else
+      failed << " time critical priority;";
+#else
+    sched_param param;
+    param.sched_priority = policy.realtime_priority;
+    int r = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (r == 0)
+    {
+      result.realtime_priority = policy.realtime_priority;
+      applied << " SCHED_FIFO " << policy.realtime_priority << ";";
+    }
+    else
+      failed << " SCHED_FIFO " << policy.realtime_priority << ": " << strerror(r) << ";";
+#endif
+  }
+  else if (policy.nice != 0)
+  {
+#if defined(__linux__)
+    // On Linux the nice level is per thread.
+    if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), policy.nice) == 0)
+    {
+      result.nice = policy.nice;
+      applied << " nice " << policy.nice << ";";
+    }
+    else
+      failed << " nice " << policy.nice << ": " << strerror(errno) << ";";
+#elif defined(_WIN32)
+    int priority = policy.nice < 0 ? THREAD_PRIORITY_ABOVE_NORMAL : THREAD_PRIORITY_BELOW_NORMAL;
+    if (SetThreadPriority(GetCurrentThread(), priority))
+    {
+      result.nice = policy.nice;
+      applied << " priority " << priority << ";";
+    }
+    else
+      failed << " priority " << priority << ";";
+#else
+    failed << " per-thread nice is not supported on this platform;";
+#endif
+  }
+
+  if (!applied.str().empty())
+    LOG_INFO << "thread " << name << " policy applied:" << applied.str();
+  if (!failed.str().empty())
+    LOG_WARNING << "thread " << name << " policy not applied:" << failed.str();
+  if (report != NULL)
+    report->record(result, failed.str().empty() ? std::string() : failed.str().substr(1));
+}
+
+ThreadPolicy threadPolicyFromEnvironment(const char *variable)
+{
+  ThreadPolicy policy;
+  const char *env = std::getenv(variable);
+  if (env == NULL)
+    return policy;
+
+  std::istringstream in(env);
+  std::string token;
+  while (in >> token)
+  {
+    size_t eq = token.find('=');
+    std::string key = token.substr(0, eq);
+    std::string value = eq == std::string::npos ? std::string() : token.substr(eq + 1);
+
+    if (key == "cpus")
+      policy.cpus = value;
+    else if (key == "node")
+      policy.numa_node = std::atoi(value.c_str());
+    else if (key == "fifo")
+      policy.realtime_priority = std::atoi(value.c_str());
+    else if (key == "nice")
+      policy.nice = std::atoi(value.c_str());
+    else
+      LOG_WARNING << "unknown " << variable << " option: " << token;
+  }
+  return policy;
+}
+
+} /* namespace libfreenect2 */
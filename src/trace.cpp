@@ -0,0 +1,299 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file trace.cpp Tracing of the frame pipeline. */
+
+#include <libfreenect2/trace_events.h>
+#include <libfreenect2/threading.h>
+#include <libfreenect2/statistics.h>
+#include <libfreenect2/logging.h>
+
+#include <cstdio>
+#include <vector>
+
+#if !defined(LIBFREENECT2_THREADING_STDLIB) && !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+namespace libfreenect2
+{
+
+struct TraceEvent
+{
+  uint64_t time_ns;
+  const char *name;
+  uint32_t sequence;
+  char phase; ///< 'B', 'E' or 'i' as in the Chrome trace event format.
+};
+
+/* Ring buffer written by a single thread. The writer fills a slot, then
+ * publishes it by advancing head. A reader copies the published slots and
+ * discards those the writer may have overwritten meanwhile.
+ */
+struct TraceRing
+{
+  std::vector<TraceEvent> events;
+  volatile size_t head; ///< Number of events ever written.
+  int tid;
+  std::string thread_name;
+  bool finished; ///< The thread has exited, see releaseRing().
+};
+
+static volatile bool tracing_enabled_ = false;
+static uint64_t tracing_start_ = 0;
+static size_t events_per_thread_ = 65536;
+
+static libfreenect2::mutex rings_mutex_;
+static std::vector<TraceRing *> rings_;
+static int next_tid_ = 1;
+static thread_local TraceRing *thread_ring_ = NULL;
+
+/* Whether the ring has events of the current trace. Needs rings_mutex_. */
+static bool hasCurrentEvents(const TraceRing *ring)
+{
+  const size_t head = atomic_load_size(&ring->head);
+  return head > 0 && ring->events[(head - 1) % ring->events.size()].time_ns >= tracing_start_;
+}
+
+/* Delete the rings of exited threads, or only those without events of the
+ * current trace. Needs rings_mutex_.
+ */
+static void deleteFinishedRings(bool keep_current_events)
+{
+  size_t kept = 0;
+  for (size_t i = 0; i < rings_.size(); ++i)
+  {
+    TraceRing *ring = rings_[i];
+    if (ring->finished && !(keep_current_events && hasCurrentEvents(ring)))
+      delete ring;
+    else
+      rings_[kept++] = ring;
+  }
+  rings_.resize(kept);
+}
+
+/* Called when the thread of a ring exits. The ring is deleted right away
+ * unless writeTrace() still needs its events, then at the next startTracing().
+ */
+static void releaseRing(TraceRing *ring)
+{
+  libfreenect2::lock_guard l(rings_mutex_);
+  ring->finished = true;
+  deleteFinishedRings(true);
+}
+
+#if defined(LIBFREENECT2_THREADING_STDLIB)
+/* Releases the ring of its thread on exit. */
+struct ThreadRingOwner
+{
+  TraceRing *ring;
+  ThreadRingOwner(): ring(NULL) {}
+  ~ThreadRingOwner()
+  {
+    if (ring != NULL)
+      releaseRing(ring);
+    thread_ring_ = NULL;
+  }
+};
+static thread_local ThreadRingOwner thread_ring_owner_;
+
+static void ownRing(TraceRing *ring)
+{
+  thread_ring_owner_.ring = ring;
+}
+#elif !defined(_WIN32)
+// Pre-C++11 thread_local cannot have destructors, use a pthread key instead.
+static pthread_key_t ring_key_;
+static pthread_once_t ring_key_once_ = PTHREAD_ONCE_INIT;
+
+static void releaseRingKey(void *ring)
+{
+  releaseRing(static_cast<TraceRing *>(ring));
+}
+
+static void createRingKey()
+{
+  pthread_key_create(&ring_key_, releaseRingKey);
+}
+
+static void ownRing(TraceRing *ring)
+{
+  pthread_once(&ring_key_once_, createRingKey);
+  pthread_setspecific(ring_key_, ring);
+}
+#else
+// Without a thread exit hook, rings are kept until the process exits.
+static void ownRing(TraceRing *ring)
+{
+}
+#endif
+
+static TraceRing *threadRing()
+{
+  if (thread_ring_ != NULL)
+    return thread_ring_;
+
+  TraceRing *ring = new TraceRing;
+  ring->head = 0;
+  ring->finished = false;
+  {
+    libfreenect2::lock_guard l(rings_mutex_);
+    ring->events.resize(events_per_thread_);
+    ring->tid = next_tid_++;
+    rings_.push_back(ring);
+  }
+  ownRing(ring);
+
+  char name[17] = {0};
+#if defined(__linux__)
+  prctl(PR_GET_NAME, name);
+#endif
+  ring->thread_name = name[0] != '\0' ? name : "thread";
+  thread_ring_ = ring;
+  return ring;
+}
+
+static void record(char phase, const char *name, uint32_t sequence)
+{
+  TraceRing *ring = threadRing();
+  size_t head = ring->head;
+  TraceEvent &e = ring->events[head % ring->events.size()];
+  e.time_ns = LatencyHistogram::now();
+  e.name = name;
+  e.sequence = sequence;
+  e.phase = phase;
+  atomic_store_size(&ring->head, head + 1);
+}
+
+void traceBegin(const char *name, uint32_t sequence)
+{
+  if (tracing_enabled_)
+    record('B', name, sequence);
+}
+
+void traceEnd()
+{
+  if (tracing_enabled_)
+    record('E', NULL, TraceNoSequence);
+}
+
+void traceInstant(const char *name, uint32_t sequence)
+{
+  if (tracing_enabled_)
+    record('i', name, sequence);
+}
+
+TraceScope::TraceScope(const char *name, uint32_t sequence) :
+  active_(tracing_enabled_)
+{
+  if (active_)
+    record('B', name, sequence);
+}
+
+TraceScope::~TraceScope()
+{
+  // also close spans that were begun before tracing stopped
+  if (active_)
+    record('E', NULL, TraceNoSequence);
+}
+
+void startTracing(size_t events_per_thread)
+{
+  {
+    libfreenect2::lock_guard l(rings_mutex_);
+    events_per_thread_ = events_per_thread > 0 ? events_per_thread : 1;
+    tracing_start_ = LatencyHistogram::now();
+    deleteFinishedRings(false);
+  }
+  tracing_enabled_ = true;
+}
+
+void stopTracing()
+{
+  tracing_enabled_ = false;
+}
+
+bool writeTrace(const std::string &path)
+{
+  FILE *file = std::fopen(path.c_str(), "w");
+  if (file == NULL)
+  {
+    LOG_ERROR << "failed to open trace " << path;
+    return false;
+  }
+
+  // Rings of exiting threads are deleted under the lock.
+  libfreenect2::lock_guard l(rings_mutex_);
+  const std::vector<TraceRing *> &rings = rings_;
+  const uint64_t start = tracing_start_;
+
+  std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  const char *separator = "";
+  std::vector<TraceEvent> events;
+  for (size_t r = 0; r < rings.size(); ++r)
+  {
+    TraceRing *ring = rings[r];
+    const size_t capacity = ring->events.size();
+
+    size_t head = atomic_load_size(&ring->head);
+    size_t first = head > capacity ? head - capacity : 0;
+    events.clear();
+    for (size_t i = first; i < head; ++i)
+      events.push_back(ring->events[i % capacity]);
+    // slots the writer reached while copying are not consistent
+    size_t head_after = atomic_load_size(&ring->head);
+    size_t valid = head_after + 1 > capacity ? head_after + 1 - capacity : 0;
+    size_t skip = valid > first ? valid - first : 0;
+
+    std::fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+      separator, ring->tid, ring->thread_name.c_str());
+    separator = ",\n";
+
+    for (size_t i = skip; i < events.size(); ++i)
+    {
+      const TraceEvent &e = events[i];
+      if (e.time_ns < start)
+        continue;
+      std::fprintf(file, ",\n{\"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, \"tid\": %d", e.phase, (e.time_ns - start) * 1e-3, ring->tid);
+      if (e.name != NULL)
+        std::fprintf(file, ", \"name\": \"%s\"", e.name);
+      if (e.phase == 'i')
+        std::fprintf(file, ", \"s\": \"t\"");
+      if (e.sequence != TraceNoSequence)
+        std::fprintf(file, ", \"args\": {\"sequence\": %u}", e.sequence);
+      std::fprintf(file, "}");
+    }
+  }
+  std::fprintf(file, "\n]}\n");
+
+  bool ok = !std::ferror(file);
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok)
+    LOG_ERROR << "failed to write trace " << path;
+  return ok;
+}
+
+} /* namespace libfreenect2 */
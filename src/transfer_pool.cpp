@@ -28,6 +28,9 @@
 
 #include <libfreenect2/usb/transfer_pool.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/trace_events.h>
+
+#include <algorithm>
 
 #define WRITE_LIBUSB_ERROR(__RESULT) libusb_error_name(__RESULT) << " " << libusb_strerror((libusb_error)__RESULT)
 
@@ -36,13 +39,27 @@ namespace libfreenect2
 namespace usb
 {
 
+/* Loss-free rounds (one round completes the target number of transfers)
+ * before one transfer is retired. Doubled after each growth so a pool that
+ * keeps oscillating settles at the larger size.
+ */
+static const size_t INITIAL_SHRINK_ROUNDS = 100;
+static const size_t MAX_SHRINK_ROUNDS = 6400;
+
 TransferPool::TransferPool(libusb_device_handle* device_handle, unsigned char device_endpoint) :
     callback_(0),
     device_handle_(device_handle),
     device_endpoint_(device_endpoint),
+    allocator_(0),
     buffer_(0),
-    buffer_size_(0),
-    enable_submit_(false)
+    enable_submit_(false),
+    min_transfers_(0),
+    target_transfers_(0),
+    active_transfers_(0),
+    completed_transfers_(0),
+    lost_packets_(0),
+    stable_rounds_(0),
+    shrink_rounds_(INITIAL_SHRINK_ROUNDS)
 {
 }
 
@@ -76,9 +93,16 @@ void TransferPool::deallocate()
 
   if(buffer_ != 0)
   {
-    delete[] buffer_;
+    if(allocator_ != 0)
+    {
+      allocator_->free(buffer_);
+    }
+    else
+    {
+      delete[] buffer_->data;
+      delete buffer_;
+    }
     buffer_ = 0;
-    buffer_size_ = 0;
   }
 }
 
@@ -90,8 +114,12 @@ bool TransferPool::submit()
     return false;
   }
 
-  size_t failcount = 0;
-  for(size_t i = 0; i < transfers_.size(); ++i)
+  libfreenect2::lock_guard guard(control_mutex_);
+  completed_transfers_ = 0;
+  lost_packets_ = 0;
+  stable_rounds_ = 0;
+
+  for(size_t i = 0; i < transfers_.size() && active_transfers_ < target_transfers_; ++i)
   {
     libusb_transfer *transfer = transfers_[i].transfer;
     transfers_[i].setStopped(false);
@@ -102,11 +130,14 @@ bool TransferPool::submit()
     {
       LOG_ERROR << "failed to submit transfer: " << WRITE_LIBUSB_ERROR(r);
       transfers_[i].setStopped(true);
-      failcount++;
+    }
+    else
+    {
+      active_transfers_++;
     }
   }
 
-  if (failcount == transfers_.size())
+  if (active_transfers_ == 0)
   {
     LOG_ERROR << "all submissions failed. Try debugging with environment variable: LIBUSB_DEBUG=3.";
     return false;
@@ -145,13 +176,89 @@ void TransferPool::setCallback(DataCallback *callback)
   callback_ = callback;
 }
 
-void TransferPool::allocateTransfers(size_t num_transfers, size_t transfer_size)
+void TransferPool::setAllocator(Allocator *allocator)
+{
+  allocator_ = allocator;
+}
+
+void TransferPool::onDataLost(size_t n)
+{
+  libfreenect2::lock_guard guard(control_mutex_);
+  lost_packets_ += n;
+}
+
+void TransferPool::adjustTransfers()
+{
+  completed_transfers_ = 0;
+
+  if(lost_packets_ > 0)
+  {
+    stable_rounds_ = 0;
+    if(enable_submit_ && target_transfers_ < transfers_.size())
+    {
+      size_t step = std::max<size_t>(1, target_transfers_ / 4);
+      target_transfers_ = std::min(transfers_.size(), target_transfers_ + step);
+      shrink_rounds_ = std::min(shrink_rounds_ * 2, MAX_SHRINK_ROUNDS);
+      LOG_INFO << "endpoint 0x" << std::hex << (int)device_endpoint_ << std::dec << ": "
+               << lost_packets_ << " packets lost, growing to " << target_transfers_ << " transfers";
+
+      for(TransferQueue::iterator it = transfers_.begin(); it != transfers_.end() && active_transfers_ < target_transfers_; ++it)
+      {
+        if(!it->getStopped())
+          continue;
+
+        it->setStopped(false);
+        int r = libusb_submit_transfer(it->transfer);
+        if(r != LIBUSB_SUCCESS)
+        {
+          LOG_ERROR << "failed to submit transfer: " << WRITE_LIBUSB_ERROR(r);
+          it->setStopped(true);
+          break;
+        }
+        active_transfers_++;
+      }
+    }
+    lost_packets_ = 0;
+  }
+  else if(target_transfers_ > min_transfers_ && ++stable_rounds_ >= shrink_rounds_)
+  {
+    stable_rounds_ = 0;
+    target_transfers_--;
+    LOG_INFO << "endpoint 0x" << std::hex << (int)device_endpoint_ << std::dec << ": "
+             << "stream stable, shrinking to " << target_transfers_ << " transfers";
+  }
+}
+
+void TransferPool::allocateTransfers(size_t num_transfers, size_t max_transfers, size_t transfer_size)
 {
-  buffer_size_ = num_transfers * transfer_size;
-  buffer_ = new unsigned char[buffer_size_];
+  min_transfers_ = num_transfers;
+  target_transfers_ = num_transfers;
+  num_transfers = std::max(num_transfers, max_transfers);
+
+  size_t buffer_size = num_transfers * transfer_size;
+  if(allocator_ != 0)
+  {
+    buffer_ = allocator_->allocate(buffer_size);
+    if(buffer_->data == 0)
+    {
+      LOG_WARNING << "falling back to heap memory for transfer buffers";
+      allocator_->free(buffer_);
+      allocator_ = 0;
+      buffer_ = 0;
+    }
+  }
+
+  if(buffer_ == 0)
+  {
+    buffer_ = new Buffer;
+    buffer_->data = new unsigned char[buffer_size];
+    buffer_->capacity = buffer_size;
+    buffer_->allocator = 0;
+  }
+  buffer_->length = buffer_size;
   transfers_.reserve(num_transfers);
 
-  unsigned char *ptr = buffer_;
+  unsigned char *ptr = buffer_->data;
 
   for(size_t i = 0; i < num_transfers; ++i)
   {
@@ -183,16 +290,26 @@ void TransferPool::onTransferComplete(TransferPool::Transfer* t)
   if(t->transfer->status == LIBUSB_TRANSFER_CANCELLED)
   {
     t->setStopped(true);
+    libfreenect2::lock_guard guard(control_mutex_);
+    active_transfers_--;
     return;
   }
 
   // process data
   processTransfer(t->transfer);
 
-  if(!enable_submit_)
   {
-    t->setStopped(true);
-    return;
+    libfreenect2::lock_guard guard(control_mutex_);
+
+    if(!enable_submit_ || active_transfers_ > target_transfers_)
+    {
+      t->setStopped(true);
+      active_transfers_--;
+      return;
+    }
+
+    if(++completed_transfers_ >= target_transfers_)
+      adjustTransfers();
   }
 
   // resubmit self
@@ -202,6 +319,8 @@ void TransferPool::onTransferComplete(TransferPool::Transfer* t)
   {
     LOG_ERROR << "failed to submit transfer: " << WRITE_LIBUSB_ERROR(r);
     t->setStopped(true);
+    libfreenect2::lock_guard guard(control_mutex_);
+    active_transfers_--;
   }
 }
 
@@ -214,9 +333,9 @@ BulkTransferPool::~BulkTransferPool()
 {
 }
 
-void BulkTransferPool::allocate(size_t num_transfers, size_t transfer_size)
+void BulkTransferPool::allocate(size_t num_transfers, size_t transfer_size, size_t max_transfers)
 {
-  allocateTransfers(num_transfers, transfer_size);
+  allocateTransfers(num_transfers, max_transfers, transfer_size);
 }
 
 libusb_transfer* BulkTransferPool::allocateTransfer()
@@ -231,7 +350,13 @@ void BulkTransferPool::fillTransfer(libusb_transfer* transfer)
 
 void BulkTransferPool::processTransfer(libusb_transfer* transfer)
 {
-  if(transfer->status != LIBUSB_TRANSFER_COMPLETED) return;
+  TraceScope trace("color_transfer");
+
+  if(transfer->status != LIBUSB_TRANSFER_COMPLETED)
+  {
+    onDataLost(1);
+    return;
+  }
 
   if(callback_)
     callback_->onDataReceived(transfer->buffer, transfer->actual_length);
@@ -248,12 +373,12 @@ IsoTransferPool::~IsoTransferPool()
 {
 }
 
-void IsoTransferPool::allocate(size_t num_transfers, size_t num_packets, size_t packet_size)
+void IsoTransferPool::allocate(size_t num_transfers, size_t num_packets, size_t packet_size, size_t max_transfers)
 {
   num_packets_ = num_packets;
   packet_size_ = packet_size;
 
-  allocateTransfers(num_transfers, num_packets_ * packet_size_);
+  allocateTransfers(num_transfers, max_transfers, num_packets_ * packet_size_);
 }
 
 libusb_transfer* IsoTransferPool::allocateTransfer()
@@ -271,17 +396,27 @@ void IsoTransferPool::fillTransfer(libusb_transfer* transfer)
 
 void IsoTransferPool::processTransfer(libusb_transfer* transfer)
 {
+  TraceScope trace("depth_transfer");
   unsigned char *ptr = transfer->buffer;
+  size_t lost = 0;
 
   for(size_t i = 0; i < num_packets_; ++i)
   {
-    if(transfer->iso_packet_desc[i].status != LIBUSB_TRANSFER_COMPLETED) continue;
+    if(transfer->iso_packet_desc[i].status != LIBUSB_TRANSFER_COMPLETED)
+    {
+      lost++;
+      ptr += transfer->iso_packet_desc[i].length;
+      continue;
+    }
 
     if(callback_)
       callback_->onDataReceived(ptr, transfer->iso_packet_desc[i].actual_length);
 
     ptr += transfer->iso_packet_desc[i].length;
   }
+
+  if(lost > 0)
+    onDataLost(lost);
 }
 
 } /* namespace usb */
@@ -28,35 +28,93 @@
 
 #include <libfreenect2/rgb_packet_processor.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/trace_events.h>
+#include <libfreenect2/statistics.h>
 #include <turbojpeg.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 namespace libfreenect2
 {
 
-/** Implementation of the Turbo-Jpeg decoder processor. */
-class TurboJpegRgbPacketProcessorImpl: public WithPerfLogging
+static bool isPlanar(Frame::Format format)
 {
-public:
+  return format == Frame::I420 || format == Frame::NV12;
+}
+
+/** Create a frame for decoded images of the size and format. */
+static Frame *newDecodedFrame(size_t width, size_t height, Frame::Format format, unsigned int memory_flags)
+{
+  Frame *frame;
+  if (format == Frame::BGRX || format == Frame::RGBX)
+  {
+    frame = createFrame(width, height, tjPixelSize[TJPF_BGRX], memory_flags);
+  }
+  else
+  {
+    // The chroma planes of 4:2:0 follow the Y plane.
+    frame = createFrame(Frame::dataSize(width, height, 1, format), 1, 1, memory_flags);
+    frame->width = width;
+    frame->height = height;
+  }
+  frame->format = format;
+  return frame;
+}
+
+/** Region of the color image to decode, see Freenect2Device::Config::ColorRegionX. */
+struct JpegRegion
+{
+  int x, y, width, height; ///< In pixels of the full size image. Empty means the whole image.
+
+  JpegRegion(): x(0), y(0), width(0), height(0) {}
 
+  bool empty() const
+  {
+    return width <= 0 || height <= 0;
+  }
+};
+
+/** Fill the pixels of @p frame outside of a rectangle with zeros. */
+static void clearOutside(Frame *frame, size_t x, size_t y, size_t width, size_t height)
+{
+  const size_t bpp = frame->bytes_per_pixel, pitch = frame->width * bpp;
+  std::memset(frame->data, 0, y * pitch);
+  for (size_t r = y; r < y + height; ++r)
+  {
+    unsigned char *row = frame->data + r * pitch;
+    std::memset(row, 0, x * bpp);
+    std::memset(row + (x + width) * bpp, 0, pitch - (x + width) * bpp);
+  }
+  std::memset(frame->data + (y + height) * pitch, 0, (frame->height - y - height) * pitch);
+}
+
+/** TurboJPEG handles and scratch space to decode images. */
+class JpegDecoder
+{
+public:
   tjhandle decompressor;
+  tjhandle transformer; ///< Crops images, created on first use.
 
-  Frame *frame;
+  std::vector<unsigned char> chroma; ///< U and V planes before conversion to 4:2:0.
 
-  TurboJpegRgbPacketProcessorImpl()
+  unsigned char *cropped; ///< Cropped JPEG image, allocated with tjAlloc.
+  unsigned long cropped_capacity;
+
+  JpegDecoder():
+    transformer(0),
+    cropped(NULL),
+    cropped_capacity(0)
   {
     decompressor = tjInitDecompress();
     if(decompressor == 0)
     {
       LOG_ERROR << "Failed to initialize TurboJPEG decompressor! TurboJPEG error: '" << tjGetErrorStr() << "'";
     }
-
-    newFrame();
   }
 
-  ~TurboJpegRgbPacketProcessorImpl()
+  ~JpegDecoder()
   {
-    delete frame;
-
     if(decompressor != 0)
     {
       if(tjDestroy(decompressor) == -1)
@@ -64,12 +122,310 @@ public:
         LOG_ERROR << "Failed to destroy TurboJPEG decompressor! TurboJPEG error: '" << tjGetErrorStr() << "'";
       }
     }
+    if(transformer != 0)
+      tjDestroy(transformer);
+    tjFree(cropped);
+  }
+
+  /** Decode a JPEG image into @p frame, at the size and format of the frame.
+   * @param region Part of the image to decode; the rest of the frame is
+   * cleared. Ignored for I420 and NV12.
+   */
+  bool decode(unsigned char *jpeg, size_t jpeg_length, Frame *frame, const JpegRegion &region)
+  {
+    const int width = frame->width, height = frame->height;
+    switch (frame->format)
+    {
+    case Frame::I420:
+    case Frame::NV12:
+      return decodePlanar(jpeg, jpeg_length, frame);
+    default:
+      break;
+    }
+
+    if (!region.empty())
+      return decodeRegion(jpeg, jpeg_length, frame, region);
+
+    return tjDecompress2(decompressor, jpeg, jpeg_length, frame->data, width, width * frame->bytes_per_pixel, height, pixelFormat(frame->format), 0) == 0;
+  }
+
+private:
+  static int pixelFormat(Frame::Format format)
+  {
+    switch (format)
+    {
+    case Frame::Gray:
+      return TJPF_GRAY;
+    case Frame::RGBX:
+      return TJPF_RGBX;
+    default:
+      return TJPF_BGRX;
+    }
+  }
+
+  /** Crop the JPEG image losslessly, then decode the crop at its place in
+   * @p frame. Skips the inverse DCT and color conversion of the rest.
+   */
+  bool decodeRegion(unsigned char *jpeg, size_t jpeg_length, Frame *frame, const JpegRegion &region)
+  {
+    int jpeg_width, jpeg_height, subsamp, colorspace;
+    if (tjDecompressHeader3(decompressor, jpeg, jpeg_length, &jpeg_width, &jpeg_height, &subsamp, &colorspace) != 0)
+      return false;
+
+    // Lossless crops start at an MCU boundary.
+    const int mcu_width = tjMCUWidth[subsamp], mcu_height = tjMCUHeight[subsamp];
+    const int x = std::min(region.x, jpeg_width - 1) / mcu_width * mcu_width;
+    const int y = std::min(region.y, jpeg_height - 1) / mcu_height * mcu_height;
+    const int width = std::min(region.x + region.width, jpeg_width) - x;
+    const int height = std::min(region.y + region.height, jpeg_height) - y;
+    if (width <= 0 || height <= 0)
+      return false;
+
+    if (transformer == 0 && (transformer = tjInitTransform()) == 0)
+      return false;
+
+    tjtransform transform;
+    std::memset(&transform, 0, sizeof(transform));
+    transform.r.x = x;
+    transform.r.y = y;
+    transform.r.w = width;
+    transform.r.h = height;
+    transform.op = TJXOP_NONE;
+    transform.options = TJXOPT_CROP;
+
+    // The crop never exceeds the worst case for the whole image, so size the
+    // buffer for that once and keep TurboJPEG from reallocating it.
+    const unsigned long required = tjBufSize(jpeg_width, jpeg_height, subsamp);
+    if (required == (unsigned long)-1)
+      return false;
+    if (cropped_capacity < required)
+    {
+      tjFree(cropped);
+      cropped_capacity = 0;
+      if ((cropped = tjAlloc(required)) == NULL)
+        return false;
+      cropped_capacity = required;
+    }
+
+    unsigned long cropped_length = cropped_capacity;
+    if (tjTransform(transformer, jpeg, jpeg_length, 1, &cropped, &cropped_length, &transform, TJFLAG_NOREALLOC) != 0)
+      return false;
+
+    // Offsets are multiples of the MCU size, so they divide by the scale.
+    const int scale = jpeg_width / frame->width;
+    const size_t out_x = x / scale, out_y = y / scale;
+    const size_t out_width = (width + scale - 1) / scale, out_height = (height + scale - 1) / scale;
+    const size_t pitch = frame->width * frame->bytes_per_pixel;
+
+    clearOutside(frame, out_x, out_y, out_width, out_height);
+    unsigned char *target = frame->data + out_y * pitch + out_x * frame->bytes_per_pixel;
+    return tjDecompress2(decompressor, cropped, cropped_length, target, out_width, pitch, out_height, pixelFormat(frame->format), 0) == 0;
+  }
+
+  /** Decode into @p frame as 4:2:0 without color conversion. The camera sends
+   * 4:2:2, so chroma rows are averaged in pairs.
+   */
+  bool decodePlanar(unsigned char *jpeg, size_t jpeg_length, Frame *frame)
+  {
+    const int width = frame->width, height = frame->height;
+    int jpeg_width, jpeg_height, subsamp, colorspace;
+    if (tjDecompressHeader3(decompressor, jpeg, jpeg_length, &jpeg_width, &jpeg_height, &subsamp, &colorspace) != 0)
+      return false;
+
+    const int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+    unsigned char *y_plane = frame->data;
+    unsigned char *uv_plane = y_plane + (size_t)width * height;
+
+    if (subsamp == TJSAMP_GRAY)
+    {
+      if (tjDecompress2(decompressor, jpeg, jpeg_length, y_plane, width, width, height, TJPF_GRAY, 0) != 0)
+        return false;
+      std::fill(uv_plane, uv_plane + (size_t)chroma_width * chroma_height * 2, 128);
+      return true;
+    }
+
+    // Source chroma samples per 4:2:0 sample, from the subsampling itself:
+    // dividing the plane sizes breaks on odd scaled sizes (135 / 68 at 1/8).
+    const int sub_x = tjMCUWidth[subsamp] / 8, sub_y = tjMCUHeight[subsamp] / 8;
+    if (sub_x < 1 || sub_x > 2 || sub_y < 1 || sub_y > 2)
+    {
+      LOG_ERROR << "unsupported JPEG chroma subsampling " << subsamp;
+      return false;
+    }
+    const int fx = 2 / sub_x, fy = 2 / sub_y;
+
+    const int plane_width = tjPlaneWidth(1, width, subsamp), plane_height = tjPlaneHeight(1, height, subsamp);
+    if (plane_width != (width + sub_x - 1) / sub_x || plane_height != (height + sub_y - 1) / sub_y)
+    {
+      LOG_ERROR << "unexpected JPEG chroma plane " << plane_width << "x" << plane_height << " for " << width << "x" << height;
+      return false;
+    }
+
+    const size_t plane_size = (size_t)plane_width * plane_height;
+    chroma.resize(plane_size * 2);
+    unsigned char *planes[3] = {y_plane, &chroma[0], &chroma[plane_size]};
+    int strides[3] = {width, plane_width, plane_width};
+    if (tjDecompressToYUVPlanes(decompressor, jpeg, jpeg_length, planes, width, strides, height, 0) != 0)
+      return false;
+
+    // I420 has separate U and V planes, NV12 interleaves them.
+    const bool interleaved = frame->format == Frame::NV12;
+    unsigned char *dst_u = uv_plane;
+    unsigned char *dst_v = interleaved ? uv_plane + 1 : uv_plane + (size_t)chroma_width * chroma_height;
+    const int step = interleaved ? 2 : 1;
+    const int dst_stride = chroma_width * step;
+
+    for (int y = 0; y < chroma_height; ++y)
+    {
+      const int y0 = std::min(y * fy, plane_height - 1), y1 = std::min(y * fy + fy - 1, plane_height - 1);
+      const unsigned char *u0 = planes[1] + y0 * plane_width, *u1 = planes[1] + y1 * plane_width;
+      const unsigned char *v0 = planes[2] + y0 * plane_width, *v1 = planes[2] + y1 * plane_width;
+      unsigned char *u = dst_u + y * dst_stride, *v = dst_v + y * dst_stride;
+      for (int x = 0; x < chroma_width; ++x, u += step, v += step)
+      {
+        const int x0 = std::min(x * fx, plane_width - 1), x1 = std::min(x * fx + fx - 1, plane_width - 1);
+        *u = (u0[x0] + u0[x1] + u1[x0] + u1[x1] + 2) >> 2;
+        *v = (v0[x0] + v0[x1] + v1[x0] + v1[x1] + 2) >> 2;
+      }
+    }
+    return true;
+  }
+
+  /* Disable copy and assignment constructors */
+  JpegDecoder(const JpegDecoder&);
+  JpegDecoder& operator=(const JpegDecoder&);
+};
+
+/** Color frame holding JPEG data until the consumer calls decode().
+ * Until then it is a Frame::Raw frame like those of DumpRgbPacketProcessor.
+ * It does not depend on the processor and can outlive it.
+ */
+class DeferredJpegFrame: public Frame
+{
+private:
+  std::vector<unsigned char> jpeg;
+  size_t decoded_width, decoded_height;
+  Frame::Format decoded_format;
+  JpegRegion region;
+  unsigned int memory_flags;
+  Frame *decoded; ///< Holds the pixels after decode().
+
+public:
+  DeferredJpegFrame(const RgbPacket &packet, size_t width, size_t height, Frame::Format format, const JpegRegion &region, unsigned int memory_flags):
+    Frame(1, 1, packet.jpeg_buffer_length, packet.jpeg_buffer),
+    jpeg(packet.jpeg_buffer, packet.jpeg_buffer + packet.jpeg_buffer_length),
+    decoded_width(width),
+    decoded_height(height),
+    decoded_format(format),
+    region(region),
+    memory_flags(memory_flags),
+    decoded(NULL)
+  {
+    data = &jpeg[0];
+    this->format = Frame::Raw;
+    timestamp = packet.timestamp;
+    sequence = packet.sequence;
+    exposure = packet.exposure;
+    gain = packet.gain;
+    gamma = packet.gamma;
+    trackAllocation(MemoryFrames, jpeg.size());
+  }
+
+  virtual ~DeferredJpegFrame()
+  {
+    if (!jpeg.empty())
+      trackFree(MemoryFrames, jpeg.size());
+    delete decoded;
+    data = NULL;
+  }
+
+  virtual bool decode()
+  {
+    if (decoded != NULL)
+      return true;
+
+    JpegDecoder decoder;
+    if (decoder.decompressor == 0)
+      return false;
+
+    TraceScope trace("jpeg_decode", sequence);
+    Frame *frame = newDecodedFrame(decoded_width, decoded_height, decoded_format, memory_flags);
+    const bool ok = decoder.decode(&jpeg[0], jpeg.size(), frame, region);
+    if (!ok)
+    {
+      LOG_ERROR << "Failed to decompress rgb image! TurboJPEG error: '" << tjGetErrorStr() << "'";
+      delete frame;
+      return false;
+    }
+
+    decoded = frame;
+    width = frame->width;
+    height = frame->height;
+    bytes_per_pixel = frame->bytes_per_pixel;
+    data = frame->data;
+    format = frame->format;
+
+    trackFree(MemoryFrames, jpeg.size());
+    std::vector<unsigned char>().swap(jpeg);
+    return true;
+  }
+};
+
+/** Implementation of the Turbo-Jpeg decoder processor. */
+class TurboJpegRgbPacketProcessorImpl: public WithPerfLogging
+{
+public:
+
+  JpegDecoder decoder;
+
+  Frame *frame;
+
+  unsigned int memory_flags;
+
+  unsigned int scale; ///< Decode at 1/scale of 1920x1080.
+  Frame::Format format; ///< Pixel format of decoded frames.
+  bool deferred; ///< Leave decoding to the consumer, see DeferredJpegFrame.
+  JpegRegion region; ///< Part of the image to decode.
+
+  TurboJpegRgbPacketProcessorImpl()
+  {
+    memory_flags = 0;
+    scale = 1;
+    format = Frame::BGRX;
+    deferred = false;
+
+    newFrame(1920, 1080, Frame::BGRX);
+  }
+
+  ~TurboJpegRgbPacketProcessorImpl()
+  {
+    delete frame;
+  }
+
+  void newFrame(size_t width, size_t height, Frame::Format frame_format)
+  {
+    frame = newDecodedFrame(width, height, frame_format, memory_flags);
+  }
+
+  /** Whether TurboJPEG can decode at 1/scale. */
+  static bool supportsScale(unsigned int scale)
+  {
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8)
+      return false;
+
+    int num = 0;
+    tjscalingfactor *factors = tjGetScalingFactors(&num);
+    for (int i = 0; factors != NULL && i < num; ++i)
+    {
+      if (factors[i].num == 1 && factors[i].denom == (int)scale)
+        return true;
+    }
+    return false;
   }
 
-  void newFrame()
+  static bool supportsFormat(Frame::Format format)
   {
-    frame = new Frame(1920, 1080, tjPixelSize[TJPF_BGRX]);
-    frame->format = Frame::BGRX;
+    return format == Frame::BGRX || format == Frame::RGBX || format == Frame::Gray || isPlanar(format);
   }
 };
 
@@ -83,10 +439,81 @@ TurboJpegRgbPacketProcessor::~TurboJpegRgbPacketProcessor()
   delete impl_;
 }
 
+void TurboJpegRgbPacketProcessor::setConfiguration(const libfreenect2::RgbPacketProcessor::Config &config)
+{
+  RgbPacketProcessor::setConfiguration(config);
+
+  if (TurboJpegRgbPacketProcessorImpl::supportsScale(config.ColorScale))
+  {
+    impl_->scale = config.ColorScale;
+  }
+  else
+  {
+    LOG_WARNING << "color scale 1/" << config.ColorScale << " is not supported, decoding full size";
+    impl_->scale = 1;
+  }
+
+  if (TurboJpegRgbPacketProcessorImpl::supportsFormat(config.ColorFormat))
+  {
+    impl_->format = config.ColorFormat;
+  }
+  else
+  {
+    LOG_WARNING << "color format " << config.ColorFormat << " is not supported, decoding BGRX";
+    impl_->format = Frame::BGRX;
+  }
+
+  impl_->deferred = config.DeferColorDecode;
+
+  // Clip the region to the image; an empty region decodes the whole image.
+  JpegRegion region;
+  region.x = std::max(config.ColorRegionX, 0);
+  region.y = std::max(config.ColorRegionY, 0);
+  region.width = std::min(config.ColorRegionX + config.ColorRegionWidth, 1920) - region.x;
+  region.height = std::min(config.ColorRegionY + config.ColorRegionHeight, 1080) - region.y;
+  if (config.ColorRegionWidth <= 0 || config.ColorRegionHeight <= 0 || region.empty())
+    region = JpegRegion();
+  if (!region.empty() && isPlanar(impl_->format))
+  {
+    LOG_WARNING << "color region is not supported for I420 and NV12, decoding the whole image";
+    region = JpegRegion();
+  }
+  impl_->region = region;
+}
+
+void TurboJpegRgbPacketProcessor::setMemoryFlags(unsigned int flags)
+{
+  RgbPacketProcessor::setMemoryFlags(flags);
+  impl_->memory_flags = flags;
+  const size_t width = impl_->frame->width, height = impl_->frame->height;
+  const Frame::Format format = impl_->frame->format;
+  delete impl_->frame;
+  impl_->newFrame(width, height, format);
+}
+
 void TurboJpegRgbPacketProcessor::process(const RgbPacket &packet)
 {
-  if(impl_->decompressor != 0 && listener_ != 0)
+  if(impl_->decoder.decompressor != 0 && listener_ != 0)
   {
+    const size_t width = 1920 / impl_->scale, height = 1080 / impl_->scale;
+    const Frame::Format format = impl_->format;
+
+    if (impl_->deferred)
+    {
+      // Frames the listener rejects or replaces cost only this copy.
+      Frame *deferred = new DeferredJpegFrame(packet, width, height, format, impl_->region, impl_->memory_flags);
+      traceInstant("jpeg_deferred", packet.sequence);
+      if (!listener_->onNewFrame(Frame::Color, deferred))
+        delete deferred;
+      return;
+    }
+
+    if (impl_->frame->width != width || impl_->frame->format != format)
+    {
+      delete impl_->frame;
+      impl_->newFrame(width, height, format);
+    }
+
     impl_->startTiming();
 
     impl_->frame->timestamp = packet.timestamp;
@@ -95,15 +522,17 @@ void TurboJpegRgbPacketProcessor::process(const RgbPacket &packet)
     impl_->frame->gain = packet.gain;
     impl_->frame->gamma = packet.gamma;
 
-    int r = tjDecompress2(impl_->decompressor, packet.jpeg_buffer, packet.jpeg_buffer_length, impl_->frame->data, 1920, 1920 * tjPixelSize[TJPF_BGRX], 1080, TJPF_BGRX, 0);
+    traceBegin("jpeg_decode", packet.sequence);
+    bool ok = impl_->decoder.decode(packet.jpeg_buffer, packet.jpeg_buffer_length, impl_->frame, impl_->region);
 
+    traceEnd();
     impl_->stopTiming(LOG_INFO);
 
-    if(r == 0)
+    if(ok)
     {
       if(listener_->onNewFrame(Frame::Color, impl_->frame))
       {
-        impl_->newFrame();
+        impl_->newFrame(width, height, format);
       }
     }
     else